@@ -1,799 +1,10783 @@
+#define _GNU_SOURCE  // syncfs
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #define FLIGHT_FILE "flights.csv"  // File for saving flights
 #define DESKTOP_PATH "details.csv" // Path for bookings CSV
+#define SEAT_INVENTORY_FILE "seats.dat" // Binary seat bitmaps for every flight
+#define SEAT_INVENTORY_MAGIC "ARSSEAT2"
+#define SEAT_INVENTORY_MAGIC_V1 "ARSSEAT1"  // Entries without a seat layout, upgraded when opened
+#define DEFAULT_SEAT_COUNT 200
+#define DEFAULT_ROW_SEATS 6        // Seats abreast when a flight is given only a seat count
+#define CABIN_MAX_CLASSES 3        // First, business and economy
+#define CABIN_MAX_ROW_SEATS 16
+#define MAX_LAYOUT_SEATS 100000
+#define SEAT_OVERBOOKED -1        // Seat number of a ticket sold past a full cabin; legacy rows without one have 0
+#define SEAT_LAYOUT_SIZE 96        // Text form of a layout, e.g. "F8x4@3+B24x4@1.8+E144x6@1"
+#define JOURNAL_FILE "journal.log"     // Append-only log of operations since the last snapshot
+#define JOURNAL_SYNC_BATCH 32           // Records appended between fsync calls
+#define JOURNAL_COMPACT_THRESHOLD 100000 // Records before the journal is folded into the snapshot
+#define SNAPSHOT_FILE "ars.snap"        // Single-file snapshot of versions 1 and 2, read once then replaced
+#define SNAPSHOT_MAGIC "ARSSNAP"
+#define SNAPSHOT_VERSION 4               // 2 widened refNo to 16 bytes, 3 added request sequence numbers, 4 paise
+#define SHARD_DIR "shards"              // One snapshot per flight and departure date, shards/<YYYYMMDD>/<flightID>.snap
+#define SHARD_PATH_SIZE 64
+#define ARCHIVE_DIR "shards/archive"    // Compressed, read-only days, archive/<YYYYMMDD>.arc
+#define ARCHIVE_MAGIC "ARSARC1"
+#define ARCHIVE_VERSION 1
+#define PACK_HASH_BITS 16               // Match finder table of the archive compressor
+#define SERVER_SOCKET "ars.sock"        // Default socket of the booking server, "tcp:<host>:<port>" for TCP
+#define SERVER_WORKERS 8                // Event loop threads
+#define SERVER_BACKLOG 1024
+#define SERVER_SOCKET_MODE 0660         // Unix socket permissions: the server's user and group may connect
+#define SERVER_MAX_EVENTS 256           // Events handled per epoll_wait
+#define CONNECTION_INPUT_SIZE 4096      // Request bytes buffered per connection
+#define CONNECTION_OUTPUT_LIMIT 65536   // Pending reply bytes before a connection's requests wait
+#define REPLY_SIZE 1024                 // Longest reply, a page of search results
+#define FRAME_MAGIC 0xA7                // First byte of a binary request or reply
+#define FRAME_HEADER_SIZE 8             // Magic, operation or status, 16-bit length, 32-bit tag
+#define FRAME_MAX_PAYLOAD 512
+#define FRAME_OPS 19                    // Binary operations, numbered as in frameVerbs
+#define OP_SEARCH 1
+#define OP_BOOK 2
+#define OP_VIEW 3
+#define OP_CANCEL 4
+#define OP_SEATS 5
+#define OP_HOLD 6
+#define OP_PAY 7
+#define OP_RELEASE 8
+#define OP_HOLDS 9
+#define OP_METRICS 10
+#define OP_APPROVE 11
+#define OP_REJECT 12
+#define OP_APPROVEFLIGHT 13
+#define OP_STATS 14
+#define OP_ADDFLIGHT 15
+#define OP_REMOVEFLIGHT 16
+#define OP_BOOKGROUP 17
+#define OP_GROUP 18
+#define SEARCH_PAGE_SIZE 20             // Flights shown per page of search results
+#define BATCH_GROUP_SIZE 1000           // Batch operations persisted by one flush
+#define REFNO_SIZE 16                   // 'R', 12 base32 digits and the terminator, padded
+#define REFNO_DIGITS 12
+#define REFNO_EPOCH 1704067200          // 2024-01-01 00:00:00 UTC
+#define REFNO_SEQUENCE_BITS 20          // Numbers per second before borrowing the next second
+#define REFNO_NODE_BITS 8               // Set with ARS_NODE when several processes issue numbers
+#define GROUP_MAX_SIZE 1024             // Passengers per group booking, the count takes two digits of its reference
+#define GROUP_PAGE_SIZE 40              // Members listed per GROUP reply
+#define JOURNAL_LINE_SIZE 192           // Longest journal record of a booking, newline included
+#define DATE_TEXT_SIZE 15               // Text of a flight or booking date, terminator included
+#define DATE_INTERNED 0x80000000u       // Set in a packed date that holds a date dictionary code
+#define DICTIONARY_CHUNK_BITS 12
+#define DICTIONARY_CHUNK (1u << DICTIONARY_CHUNK_BITS)  // Interned strings per chunk
+#define DICTIONARY_CHUNKS 4096          // Up to 16M strings per dictionary
+#define DICTIONARY_MAX_WIDTH 32
+#define CSV_MAX_FIELDS 8
+#define CSV_REPORT_LIMIT 10             // Malformed rows printed per file before just counting
+#define MAX_LOADER_THREADS 64
+#define LOAD_MIN_CHUNK_BYTES (256 * 1024)  // Smaller files are not worth splitting further
+#define LOAD_MIN_CHUNK_RECORDS 4096
+#define STARTUP_MAX_PHASES 24
+#define HOLD_TICK_MS 100                // Resolution of seat hold expiry
+#define HOLD_WHEEL_SLOTS 4096           // One turn of the hold wheel covers 409.6 s
+#define HOLD_TTL_SECONDS 300            // How long a seat is held for payment, ARS_HOLD_TTL overrides
+#define REFUND_FILE "refunds.csv"       // Refunds owed for bookings on removed flights, appended to
+#define REMOVAL_BATCH 1024              // Bookings refunded per store lock hold by the removal worker
+#define SEAT_INVENTORY_SLACK (64 * 1024)  // Dead bytes in seats.dat worth a rewrite once they are most of it
+#define METRICS_FILE "metrics.prom"     // Prometheus text dump, ARS_METRICS_FILE overrides
+#define METRICS_DUMP_TICKS 10           // The server rewrites the dump every 10 hold ticks (1 s)
+#define METRIC_SUB_BUCKETS 16
+#define METRIC_BUCKETS 640              // Durations up to 2^40 ns (about 18 minutes)
+#define METRIC_BOOK 0
+#define METRIC_LOOKUP 1
+#define METRIC_CANCEL 2
+#define METRIC_APPROVE 3
+#define METRIC_REJECT 4
+#define METRIC_APPROVE_FLIGHT 5
+#define METRIC_HOLD 6
+#define METRIC_PAY 7
+#define METRIC_RELEASE 8
+#define METRIC_SEARCH 9
+#define METRIC_LOAD 10
+#define METRIC_SNAPSHOT 11
+#define METRIC_EXPORT 12
+#define METRIC_FSYNC 13
+#define METRIC_BOOK_GROUP 14
+#define METRIC_OPS 15
 
 // Booking structure
 typedef struct Booking {
-    char refNo[10];
+    char refNo[REFNO_SIZE];
     char name[30];
-    char flightID[10];
-    char date[15];
+    char archived;   // Loaded from an archive of a past date, read-only
+    char removed;    // Its flight was removed and the refund is pending
+    uint32_t flight; // Flight dictionary code of the flight ID
+    uint32_t date;   // Packed by packDate
+    int64_t paise;   // Payment in whole paise, exact at any amount
     int seatNumber;  // Added seat number
-    float payment;
     int cancelRequested; 
+    uint32_t row;    // Row in the booking columns
+    struct CancelRequest *cancelRequest;  // Pending request in the cancel queue, NULL if none
     struct Booking *next;
+    struct Booking *prev;  // Back link so an indexed booking can be unlinked in O(1)
+    struct Booking *flightNext;   // Next booking on the same flight
+    struct Booking **flightPrev;  // The link pointing at this booking, wherever its list is held
 } Booking;
 
+// Open-addressing hash index over bookings, keyed by refNo
+typedef struct BookingIndex {
+    Booking **slots;   // Contiguous slot array, capacity is a power of two
+    size_t capacity;
+    size_t count;
+    size_t tombstones;
+} BookingIndex;
+
+#define INDEX_TOMBSTONE ((Booking *)1)
+#define EPOCH_RECLAIM_BATCH 256         // Retired records collected before readers are checked
+
+// Flights by flight dictionary code. A code stays with its flight ID for good, so a
+// removed flight only clears its entry.
+typedef struct FlightIndex {
+    struct Flight **byCode;
+    uint32_t capacity;
+    size_t count;
+} FlightIndex;
+
+// Slab allocator for fixed-size records. Records are carved out of large slabs so
+// list neighbours sit next to each other, and freed records are reused first.
+typedef struct PoolSlab {
+    struct PoolSlab *next;
+    void *align;  // Keeps the records that follow 16-byte aligned
+} PoolSlab;
+
+typedef struct Pool {
+    size_t itemSize;
+    size_t perSlab;
+    PoolSlab *slabs;   // Most recent slab first
+    size_t used;       // Records carved from the most recent slab
+    void *freeList;
+    size_t live;
+} Pool;
+
+#define POOL_INIT(type, perSlab) {sizeof(type), (perSlab), NULL, 0, NULL, 0}
+
+
+// One cabin class of an aircraft. Seats are numbered from the front cabin back, row by
+// row, left to right within a row.
+typedef struct CabinSpec {
+    char code;            // 'F', 'B' or 'E'
+    uint8_t rowSeats;     // Seats abreast
+    uint16_t reserved;
+    uint32_t seats;
+    float priceFactor;    // A seat's fare is the flight's price times this
+} CabinSpec;
+
+// Seat map of an aircraft: its cabins front to back, and how many tickets may be sold
+// past the last free seat
+typedef struct SeatLayout {
+    uint32_t overbookLimit;
+    uint32_t cabinCount;
+    CabinSpec cabins[CABIN_MAX_CLASSES];
+} SeatLayout;
+
+// Free-run index of one cabin, refreshed row by row as seats change. Bit r of runs[k - 1]
+// is set while row r has k adjacent free seats, so the front row that fits a party of k
+// is the first set bit of a bitmap of a few words.
+typedef struct Cabin {
+    int firstSeat;
+    int rows;
+    int runWords;       // Words in each of the cabin's run bitmaps
+    int freeSeats;
+    uint8_t *rowFree;   // Free seats in each row
+    uint64_t *runs;     // rowSeats bitmaps of runWords words
+} Cabin;
+
+// A rendered view kept in memory until what it shows changes. version is the version of
+// the data it was rendered from; 0 while nothing is rendered.
+typedef struct ViewCache {
+    char *text;
+    size_t length;
+    uint64_t version;
+    uint64_t hits;
+    uint64_t renders;
+} ViewCache;
+
+// Seat bitmap of one flight, bit set = seat booked
+typedef struct SeatMap {
+    char flightID[10];
+    int seatCount;
+    int wordCount;
+    uint64_t *bits;
+    long fileOffset;  // Offset of the first bitmap word in the inventory file
+    pthread_mutex_t writeLock;  // Orders concurrent in-place writes of this flight's words
+    int dirty;  // Changed while seat writes were deferred for a batch
+    int seatsBooked;  // Set bits in the bitmap, kept in step by claims and releases
+    uint64_t *held;   // Seats on hold: set in bits too, but never written to the inventory
+    int seatsHeld;
+    SeatLayout layout;
+    Cabin cabins[CABIN_MAX_CLASSES];
+    pthread_mutex_t allocLock;  // Guards the cabins' free-run index; taken before writeLock
+    int overbooked;   // Tickets sold without a seat (SEAT_OVERBOOKED)
+    uint64_t version;  // Bumped whenever a seat is booked, held or released
+    uint64_t serial;   // Numbers every seat map created, so a re-added flight's map is told apart
+    ViewCache availability;
+    struct SeatMap *next;
+} SeatMap;
+
+// Seats claimed under the shared store lock, to be recorded as bookings under the
+// exclusive one once the flight is known to still have the map they were claimed from
+typedef struct SeatClaim {
+    char flightID[10];
+    uint64_t serial;  // Of the seat map claimed from
+    SeatMap *map;
+    int from, to;     // Bitmap words the claim changed, written after the journal record
+} SeatClaim;
+
+// On-disk header preceding each flight's bitmap words in the inventory file
+typedef struct SeatInventoryEntry {
+    char flightID[16];  // Empty once the flight is removed
+    uint32_t seatCount;
+    uint32_t wordCount;
+    SeatLayout layout;
+    uint32_t reserved;
+} SeatInventoryEntry;
+
+// Entry of a version 1 inventory, written before seat maps had cabins
+typedef struct SeatInventoryEntryV1 {
+    char flightID[16];
+    uint32_t seatCount;
+    uint32_t wordCount;
+} SeatInventoryEntryV1;
+
+_Static_assert(sizeof(SeatLayout) == 44, "seat layout changed");
+_Static_assert(sizeof(SeatInventoryEntry) == 72, "seat inventory entry layout changed");
+_Static_assert(sizeof(SeatInventoryEntryV1) == 24, "seat inventory v1 entry layout changed");
+
+// A seat held while its passenger pays. Holds live in one table and are hashed by
+// expiry tick into the buckets of a timer wheel, so expiring them never scans the table.
+typedef struct SeatHold {
+    SeatMap *map;          // NULL while the entry is free
+    int seatNumber;
+    uint32_t generation;   // Bumped when the entry is reused, so stale hold IDs miss
+    uint64_t expiresAt;    // Tick at which the hold lapses
+    uint32_t next, prev;   // Bucket neighbours (or the next free entry), index + 1, 0 for none
+} SeatHold;
+
+typedef struct HoldTable {
+    SeatHold *entries;
+    uint32_t capacity;
+    uint32_t freeHead;     // Index + 1 of the first free entry
+    uint32_t wheel[HOLD_WHEEL_SLOTS];  // Index + 1 of the first hold in each bucket
+    uint64_t tick;         // Every tick up to this one has been expired
+    long active, created, committed, released, expired;
+} HoldTable;
+
+// Latency histograms, one shard per thread. Only the owning thread writes a shard, so
+// recording is two plain stores; a dump merges every shard. Buckets are log-linear:
+// 16 per power of two, so a reported quantile is within about 6% of the true value.
+typedef struct MetricShard {
+    uint64_t counts[METRIC_OPS][METRIC_BUCKETS];
+    uint64_t sumNanos[METRIC_OPS];
+    struct MetricShard *next;
+} MetricShard;
+
+// A reader thread's epoch: the global epoch when its lock-free read began, 0 between
+// reads. Each slot has a cache line to itself.
+typedef struct EpochSlot {
+    uint64_t epoch;
+    struct EpochSlot *next;
+    char pad[48];
+} EpochSlot;
+
+// A record unlinked from the published structures, freed once no reader can hold it
+typedef struct Retired {
+    void *item;
+    void (*release)(void *);
+    uint64_t epoch;              // Global epoch when it was retired
+} Retired;
+
+typedef struct EpochState {
+    uint64_t global;
+    EpochSlot *slots;            // Every thread that ever read without the lock
+    Retired *retired;
+    size_t count, capacity;
+} EpochState;
+
+typedef struct HoldCounts {
+    long active, created, committed, released, expired;
+} HoldCounts;
+
+typedef struct RemovalCounts {
+    long pending, refunded;
+    int64_t refundedPaise;
+} RemovalCounts;
 
 // Flight structure
 typedef struct Flight {
     char flightID[10];
     char date[15];
-    char time[10];
-    char destination[30];
-    char source[30];
+    char archived;   // Loaded from an archive of a past date, read-only
+    uint32_t code;   // Flight dictionary code
+    uint32_t time;   // Time dictionary code
+    uint32_t from;   // Airport dictionary codes of source and destination
+    uint32_t to;
+    uint32_t departure;  // The date, packed by packDate
     float price;
+    SeatMap *seats;
     struct Flight *next;
 } Flight;
 
+// The flight fields a lock-free reader uses, copied into the flight snapshot
+typedef struct FlightEntry {
+    char flightID[10];
+    char date[15];
+    char time[10];
+    uint32_t from;               // Airport dictionary codes
+    uint32_t to;
+    float price;
+    int dateKey;
+    SeatMap *seats;              // Seat maps are freed through epoch reclamation too
+} FlightEntry;
+
+// Immutable copy of the flight table for readers that take no lock, rebuilt and
+// published by the first reader after flights are added or removed. Entries are in route index order
+// for searches and hashed by flightID for lookups.
+typedef struct FlightSnapshot {
+    uint64_t version;            // flightListVersion it was built from
+    int count;
+    size_t mask;
+    int32_t *slots;              // Entry of each hash slot, -1 if empty
+    FlightEntry entries[];
+} FlightSnapshot;
+
 typedef struct CancelRequest {
+    char refNo[REFNO_SIZE];
+    char name[30];
+    uint32_t flight;    // Flight dictionary code
+    uint32_t date;      // Packed by packDate
+    int64_t paise;      // Payment in whole paise
+    uint64_t sequence;  // Arrival order, kept across shards
+    size_t slot;  // Position in the cancel queue
+} CancelRequest;
+
+// Pending cancellation requests in arrival order, so the admin sees them first come
+// first served. Approving or rejecting a request leaves a NULL tombstone in its slot;
+// tombstones are squeezed out when the queue fills rather than on every removal.
+typedef struct CancelQueue {
+    CancelRequest **slots;
+    size_t head;      // Oldest slot that may still hold a request
+    size_t tail;      // Next free slot
+    size_t capacity;
+    size_t live;      // Requests still pending; tail - live slots are tombstones
+} CancelQueue;
+
+// Snapshot file header, followed by the three fixed-width record arrays
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bookingCount;
+    uint32_t flightCount;
+    uint32_t cancelCount;
+    uint64_t bookingOffset;
+    uint64_t flightOffset;
+    uint64_t cancelOffset;
+} SnapshotHeader;
+
+// Fixed-width snapshot records, copied into nodes without any parsing
+typedef struct SnapshotBooking {
+    char refNo[REFNO_SIZE];
+    char name[30];
+    char flightID[10];
+    char date[15];
+    char reserved[1];
+    int32_t seatNumber;
+    int32_t cancelRequested;
+    int64_t paise;
+} SnapshotBooking;
+
+typedef struct SnapshotFlight {
+    char flightID[10];
+    char date[15];
+    char time[10];
+    char destination[30];
+    char source[30];
+    char reserved[1];
+    float price;
+} SnapshotFlight;
+
+typedef struct SnapshotCancel {
+    char refNo[REFNO_SIZE];
+    char name[30];
+    char flightID[10];
+    char date[15];
+    char reserved[1];
+    int64_t paise;
+    uint64_t sequence;  // Requests of every shard are queued back in this order
+} SnapshotCancel;
+
+// Version 3 records, still readable from shards; version 2 bookings share the layout
+typedef struct SnapshotBookingV3 {
+    char refNo[REFNO_SIZE];
+    char name[30];
+    char flightID[10];
+    char date[15];
+    char reserved[1];
+    int32_t seatNumber;
+    float payment;
+    int32_t cancelRequested;
+} SnapshotBookingV3;
+
+typedef struct SnapshotCancelV3 {
+    char refNo[REFNO_SIZE];
+    char name[30];
+    char flightID[10];
+    char date[15];
+    char reserved[1];
+    float payment;
+    uint32_t reserved2;
+    uint64_t sequence;
+} SnapshotCancelV3;
+
+// Version 2 and 1 records, still readable from a single-file snapshot
+typedef struct SnapshotCancelV2 {
+    char refNo[REFNO_SIZE];
+    char name[30];
+    char flightID[10];
+    char date[15];
+    char reserved[1];
+    float payment;
+} SnapshotCancelV2;
+
+typedef struct SnapshotBookingV1 {
     char refNo[10];
     char name[30];
     char flightID[10];
     char date[15];
+    char reserved[3];
+    int32_t seatNumber;
     float payment;
-    struct CancelRequest *next;
-} CancelRequest;
+    int32_t cancelRequested;
+} SnapshotBookingV1;
+
+typedef struct SnapshotCancelV1 {
+    char refNo[10];
+    char name[30];
+    char flightID[10];
+    char date[15];
+    char reserved[3];
+    float payment;
+} SnapshotCancelV1;
+
+_Static_assert(sizeof(SnapshotHeader) == 48, "snapshot header layout changed");
+_Static_assert(sizeof(SnapshotBooking) == 88, "snapshot booking layout changed");
+_Static_assert(sizeof(SnapshotFlight) == 100, "snapshot flight layout changed");
+_Static_assert(sizeof(SnapshotCancel) == 88, "snapshot cancel layout changed");
+_Static_assert(sizeof(SnapshotBookingV3) == 84, "snapshot v3 booking layout changed");
+_Static_assert(sizeof(SnapshotCancelV3) == 88, "snapshot v3 cancel layout changed");
+_Static_assert(sizeof(SnapshotCancelV2) == 76, "snapshot v2 cancel layout changed");
+_Static_assert(sizeof(SnapshotBookingV1) == 80, "snapshot v1 booking layout changed");
+_Static_assert(sizeof(SnapshotCancelV1) == 72, "snapshot v1 cancel layout changed");
+
+// A shard changed since the last compaction, with its records counted and placed
+// while saving
+typedef struct Shard {
+    int used;
+    int dateKey;
+    char flightID[10];
+    uint32_t bookings, cancels;
+    size_t bookingsAt, cancelsAt;
+    struct Flight *flight;
+} Shard;
+
+// Open-addressing set of changed shards. all is set when every shard must be written,
+// after loading from CSV or from a single-file snapshot.
+typedef struct ShardTable {
+    Shard *slots;
+    size_t capacity;   // Power of two
+    size_t count;
+    int all;
+} ShardTable;
+
+// A shard image to load: a file, or a segment of an unpacked archive when data is set
+typedef struct ShardSource {
+    char path[SHARD_PATH_SIZE];
+    const char *data;
+    size_t size;
+} ShardSource;
+
+// Archive file header. A sorted table of the day's refNos follows, then the day's shard
+// images packed together, each stored as a uint64 size and its bytes padded to 8.
+typedef struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t dateKey;
+    uint32_t shardCount;
+    uint32_t flightCount;
+    uint32_t bookingCount;
+    uint32_t cancelCount;
+    int64_t revenue;        // Paise
+    uint64_t rawSize;       // Shard images before packing
+    uint64_t packedSize;
+    uint64_t refNoOffset;
+    uint64_t packedOffset;
+} ArchiveHeader;
+
+_Static_assert(sizeof(ArchiveHeader) == 72, "archive header layout changed");
+
+// An archive mapped at startup; its records are unpacked into the store on first use
+typedef struct Archive {
+    char path[SHARD_PATH_SIZE];
+    const char *data;
+    size_t size;
+    ArchiveHeader header;
+    int loaded;
+} Archive;
+
+CancelQueue cancelQueue = {NULL, 0, 0, 0, 0};
+
+// Revenue and bookings of one flight, date or route
+typedef struct Aggregate {
+    char key[64];
+    char route[64];    // Flight table only: the "SRC-DST" route its takings count under
+    int64_t revenue;   // Paise, so sums are exact
+    long bookings;
+    long unseated;     // Flight table only: overbooked tickets, sold without a seat
+} Aggregate;
+
+// Open-addressing table of aggregates keyed by string; entries are never removed
+typedef struct AggregateTable {
+    Aggregate *slots;
+    size_t capacity;   // Power of two
+    size_t count;
+} AggregateTable;
+
+// Running totals updated as bookings are linked and unlinked, so reports never scan
+typedef struct Totals {
+    int64_t revenue;   // Paise
+    long bookings;
+    AggregateTable byFlight;
+    AggregateTable byDate;
+    AggregateTable byRoute;
+} Totals;
+
+Totals totals;
+
+// Open addressing over a dictionary's codes, stored as code + 1 so 0 is empty
+typedef struct DictionarySlots {
+    size_t mask;
+    struct DictionarySlots *previous;  // Outgrown table, freed with the dictionary
+    uint32_t codes[];
+} DictionarySlots;
+
+// Strings numbered densely, so records hold a 4-byte code instead of the text and compare
+// codes instead of strings. Codes are never reused. The text sits in fixed-width cells in
+// chunks that never move, so a code is turned back into text without a lock.
+typedef struct StringDictionary {
+    size_t width;        // Bytes per cell, terminator included
+    const char *name;
+    char *chunks[DICTIONARY_CHUNKS];
+    uint32_t count;
+    DictionarySlots *slots;
+    pthread_mutex_t lock;  // Held while adding; lookups take no lock
+} StringDictionary;
 
-CancelRequest *headCancelRequests = NULL;
+StringDictionary flightDictionary = {10, "flight", {NULL}, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+StringDictionary airportDictionary = {30, "airport", {NULL}, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+StringDictionary dateDictionary = {DATE_TEXT_SIZE, "date", {NULL}, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+StringDictionary timeDictionary = {10, "time", {NULL}, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+#define STATUS_CANCEL_REQUESTED 1
+
+// The booking fields reports filter and sum on, one array per field. Row i of every
+// column belongs to owner[i]; removing a booking moves the last row into its place.
+typedef struct BookingColumns {
+    uint32_t *flight;    // Flight dictionary code
+    uint32_t *date;      // YYYYMMDD
+    uint32_t *paise;
+    uint8_t *status;     // STATUS_* bits
+    Booking **owner;
+    size_t count;
+    size_t capacity;
+} BookingColumns;
+
+BookingColumns bookingColumns;
+
+// Bookings of each flight, indexed by flight dictionary code. Each list is threaded
+// through the bookings, so a flight's bookings are found without scanning the others.
+typedef struct FlightBookings {
+    Booking **heads;
+    uint32_t capacity;
+} FlightBookings;
+
+FlightBookings flightBookings;
+
+// A removed flight whose bookings are still to be refunded
+typedef struct FlightRemoval {
+    char flightID[10];
+    Booking *bookings;   // Detached from the flight index, threaded through flightNext
+    long pending;        // Bookings counted when the flight was removed and not yet refunded
+    struct FlightRemoval *next;
+} FlightRemoval;
+
+// Removed flights waiting for the removal worker, oldest first
+typedef struct RemovalQueue {
+    FlightRemoval *head;
+    FlightRemoval *tail;
+    long pending;
+    long refunded;
+    int64_t refundedPaise;
+    int workerStarted;
+} RemovalQueue;
+
+RemovalQueue removals;
+pthread_mutex_t removalLock = PTHREAD_MUTEX_INITIALIZER;  // Taken after storeLock
+
+// Reference numbers already in REFUND_FILE, sorted, held while a journal that removes
+// flights is replayed so refunds paid before a crash are not listed twice
+typedef struct RefundLog {
+    char (*refNos)[REFNO_SIZE];
+    size_t count;
+    int loaded;
+} RefundLog;
+
+RefundLog refundLog;
+pthread_cond_t removalReady = PTHREAD_COND_INITIALIZER;
+
+// Row filter for the scan kernels: flight code, inclusive date range and status bits
+typedef struct ColumnFilter {
+    uint32_t flight;
+    int anyFlight;
+    uint32_t fromDate;
+    uint32_t toDate;     // At most INT32_MAX - 1, the SIMD kernels compare signed
+    int statusMask;
+    int statusValue;
+} ColumnFilter;
+
+// A reporting query over bookings; unset fields match everything
+typedef struct BookingQuery {
+    const char *flightID;
+    int fromDate;        // YYYYMMDD, inclusive
+    int toDate;
+    int pendingOnly;     // Only bookings with a cancellation requested
+} BookingQuery;
+
+typedef struct QueryResult {
+    long count;
+    int64_t paise;
+} QueryResult;
+
+// Rows skipped by a reader whose reports are printed later by its owner
+typedef struct CsvReport {
+    long line;
+    const char *reason;
+} CsvReport;
+
+// A CSV file mapped into memory; rows are split in place without copying
+typedef struct CsvReader {
+    const char *path;
+    const char *data;
+    size_t size;
+    size_t pos;        // Start of the next row
+    long line;         // Line number of the row last returned
+    long malformed;
+    int deferReports;  // Keep the first reports for the owner instead of printing them
+    CsvReport reports[CSV_REPORT_LIMIT];
+} CsvReader;
+
+// One field of the current row, pointing into the mapping (not NUL-terminated)
+typedef struct CsvField {
+    const char *start;
+    size_t length;
+} CsvField;
+
+// One unit of startup work: parsing a chunk of bookings, loading flights or building
+// one lookup structure. Tasks are spread over the loader threads.
+typedef struct LoadTask {
+    void (*run)(struct LoadTask *task);
+    CsvReader reader;        // Chunk of details.csv
+    const char *records;     // Snapshot records, parsed from last - 1 down to first
+    uint32_t first, last;
+    uint32_t version;        // Snapshot version the records are laid out in
+    ShardSource *shards;     // Shard images, parsed from last - 1 down to first
+    int archived;
+    SnapshotFlight *flights; // Flights and requests of the parsed shards, last first
+    SnapshotCancel *cancels;
+    uint32_t flightCount, flightCapacity, cancelCount, cancelCapacity;
+    Pool pool;               // Records parsed by this task, adopted by the global pool
+    Booking *head, *tail;    // Parsed bookings, newest first like the main list
+    long count;
+    long *lines;             // Line of each parsed booking in parse order (CSV only)
+    long lineBase;           // Lines in the chunks before this one
+    double ms;
+} LoadTask;
+
+// Bookings just spliced into the list by a parallel load, waiting to be indexed
+typedef struct LoadBatch {
+    Booking *first;          // First one linked; the rest follow through prev
+    long count;
+    LoadTask *chunks;
+    int chunkCount;
+    Booking **duplicates;    // Later bookings reusing a refNo, removed after the build
+    long *duplicateLines;
+    long duplicateCount;
+    long duplicateCapacity;
+} LoadBatch;
+
+// Time spent in each phase of the last loadStore
+typedef struct StartupPhase {
+    const char *name;
+    double ms;
+    int parallel;  // Ran alongside the other parallel phases that follow the same phase
+} StartupPhase;
+
+typedef struct StartupReport {
+    StartupPhase phases[STARTUP_MAX_PHASES];
+    int count;
+    int threads;
+    int chunks;
+} StartupReport;
+
+#define SCAN_UNKNOWN 0
+#define SCAN_SCALAR 1
+#define SCAN_SSE2 2
+#define SCAN_AVX2 3
+
+// Flights sorted by (source, destination, date, time) for route searches
+typedef struct RouteEntry {
+    uint64_t route;  // Source and destination airport codes, source in the high half
+    int date;        // Departure date as YYYYMMDD
+    Flight *flight;
+} RouteEntry;
+
+typedef struct RouteIndex {
+    RouteEntry *entries;
+    int count;
+    int capacity;
+    int dirty;  // Set when flights change, the index is rebuilt on the next search
+} RouteIndex;
+
+RouteIndex routeIndex = {NULL, 0, 0, 1};
+
+uint64_t flightListVersion = 1;  // Bumped whenever a flight is added or removed
+FlightSnapshot *flightSnapshot = NULL;  // Published flight table, see publishFlights
+EpochState epochs = {1, NULL, NULL, 0, 0};
+pthread_mutex_t epochLock = PTHREAD_MUTEX_INITIALIZER;  // Epoch slots and retired records, taken after storeLock
+static __thread EpochSlot *epochSlot = NULL;
+ViewCache flightListView;
+pthread_mutex_t viewCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
 // Function prototypes for cancellation requests
-void saveCancelRequestToFile(CancelRequest *request);
 void loadCancelRequestsFromFile();
-void removeCancelRequestFromFile(char *refNo);
 void approveCancellationFromRequest(char *refNo);
 
 Booking *head = NULL;
 Flight *flightHead = NULL;
+BookingIndex bookingIndex = {NULL, 0, 0, 0};
+FlightIndex flightIndex = {NULL, 0, 0};
+Pool bookingPool = POOL_INIT(Booking, 4096);
+Pool flightPool = POOL_INIT(Flight, 1024);
+Pool cancelPool = POOL_INIT(CancelRequest, 1024);
+SeatMap *seatMapHead = NULL;
+uint64_t seatMapSerial = 0;  // Serial of the last seat map created
+FILE *seatInventory = NULL;
+long seatInventoryDead = 0;  // Bytes of removed flights' entries in the seat inventory
+FILE *journal = NULL;
+int journalUnsynced = 0;
+long journalRecords = 0;
+int journalGroupDepth = 0;   // Open groups, appends are only flushed once none is; guarded by journalLock
+static __thread int seatWritesDeferred = 0;  // This thread writes changed seat maps once per group
+uint64_t bytesWritten = 0;   // Bytes written to data files, reported by the benchmarks
+uint64_t bytesRead = 0;      // Bytes read from data files
+uint64_t fsyncCount = 0;
+MetricShard *metricShards = NULL;
+ShardTable shardTable;       // Shards to rewrite at the next compaction
+Archive *archives = NULL;
+int archiveCount = 0;
+uint64_t cancelSequence = 0; // Sequence number of the last queued cancellation request
+uint64_t refNoCounter = 0;   // Seconds since REFNO_EPOCH and sequence of the next reference number
+uint64_t refNoNode = 0;
+int loaderThreads = 0;       // Overrides ARS_THREADS when set
+LoadBatch loadBatch;
+StartupReport startupReport;
+HoldTable holds;
+
+// Lists, index and pools are shared by server workers under this lock. Seat bits are
+// claimed with atomic compare-and-swap, so seat claims only need it in shared mode.
+pthread_rwlock_t storeLock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t holdLock = PTHREAD_MUTEX_INITIALIZER;  // Hold table and wheel, taken after storeLock
+pthread_mutex_t metricLock = PTHREAD_MUTEX_INITIALIZER;  // Shard list; recording never takes it
+pthread_mutex_t metricDumpLock = PTHREAD_MUTEX_INITIALIZER;
+
+// A client connection, owned by one event loop. Requests are text lines or binary frames
+// and may be pipelined: every complete request read is answered, in order.
+typedef struct Connection {
+    int fd;
+    int admin;                   // Accepted on the admin socket
+    int quit;                    // QUIT received: close once the replies are written
+    int eof;                     // The client closed its side
+    int blocked;                 // Requests wait for the pending replies to drain
+    uint32_t events;             // Events the loop waits for
+    size_t inLength;
+    char in[CONNECTION_INPUT_SIZE];
+    char *out;
+    size_t outLength, outSent, outCapacity;
+} Connection;
+
+typedef struct EventLoop {
+    int epollFd;
+    pthread_t thread;
+} EventLoop;
+
+typedef struct Server {
+    int listeners[2];            // Clients, then admin clients
+    int listenerCount;
+    int epollFd;
+    int wakeFd;                  // Written to stop the accepting thread from another thread
+    char adminAddress[sizeof(((struct sockaddr_un *)0)->sun_path) + 8];
+    EventLoop *loops;
+    int loopCount;
+    unsigned long accepted;
+} Server;
+
+long serverConnections = 0;
+
+// Verb of each binary request operation
+static const char *frameVerbs[FRAME_OPS] = {
+    NULL, "SEARCH", "BOOK", "VIEW", "CANCEL", "SEATS", "HOLD", "PAY", "RELEASE", "HOLDS", "METRICS",
+    "APPROVE", "REJECT", "APPROVEFLIGHT", "STATS", "ADDFLIGHT", "REMOVEFLIGHT", "BOOKGROUP", "GROUP",
+};
 
 // Function prototypes
 void trimWhitespace(char *str);
 void createCSVIfNotExists();
-void removeCancellationRequest(char *refNo) ;
 void createCancellationFileIfNotExists();
-void saveBookingToFile(Booking *booking);
-void updateCSV();
-char *generateRefNo();
+int saveDataToCSV();
+int saveCancelRequestsToFile();
+void generateRefNo(char *refNo);
+uint64_t decodeRefNo(const char *refNo);
+int groupMemberRef(const char *groupRef, int member, char *refNo);
+void seedRefNoGenerator();
 void viewAvailableFlights();
+void showSeatAvailability(Flight *flight);
 void bookFlight();
+void bookGroup();
 void viewTicket();
 void cancelBooking();
 void adminMenu();
 void viewCancelRequests();
-void approveCancelRequest();
+void rejectCancelRequest();
+void approveFlightCancellationsMenu();
 void addFlight();
 void removeFlight();
 void viewTotalPayments();
 int verifyPayment(float enteredPayment, float flightPrice);
 void adminAuthentication();
 void loadFlightsFromFile();
-void saveFlightsToFile();
+int saveFlightsToFile();
+int commitFile(FILE *file, const char *tempPath, const char *path);
+void openJournal();
+void journalSync();
+void journalAppend(const char *format, ...);
+void compactJournal();
+void replayJournal();
+int saveSnapshot();
+int loadSnapshot();
+int exportCSV();
+void loadStore(int fromCSV);
+void freeStore();
+void journalSeatChange(SeatClaim *claim, const char *lines, size_t length, int records);
+void approveBooking(const char *refNo);
+void journalAppendLines(const char *lines, size_t length, int records);
+int storeBook(const char *flightID, int seatNumber, const char *name, char *refNo, const char **error);
+int storeHold(const char *flightID, int seatNumber, uint64_t *holdID, const char **error);
+int storeCommitHold(uint64_t holdID, const char *name, char *refNo, const char **error);
+int storeReleaseHold(uint64_t holdID, const char **error);
+void storeExpireHolds();
+void dropFlightHolds(SeatMap *map);
+HoldCounts storeHoldCounts();
+RemovalCounts storeRemovalCounts();
+void finishFlightRemovals();
+double holdTtlSeconds();
+int storeCancel(const char *refNo, const char **error);
+int storeView(const char *refNo, Booking *copy);
+int storeSeatsRemaining(const char *flightID);
+void storeSearch(const char *source, const char *destination, const char *date, int limit, char *reply,
+                 size_t replySize);
+void executeCommand(char *line, char *reply, size_t replySize, int allowAdmin);
+int storeApprove(const char *refNo, const char **error);
+int storeReject(const char *refNo, const char **error);
+int storeApproveFlight(const char *flightID, const char **error);
+int storeAddFlight(const Flight *details, const SeatLayout *layout, const char **error);
+int storeBookCabin(const char *flightID, char cabinCode, const char *name, char *refNo, int *seatNumber,
+                   const char **error);
+int storeBookGroup(const char *flightID, char cabinCode, int count, int adjacent, const char *const *names,
+                   int nameCount, char *groupRef, int *seats, const char **error);
+int storeGroup(const char *groupRef, int offset, int limit, char *reply, size_t replySize);
+int storeRemoveFlight(const char *flightID, const char **error);
+void flushSeatMap(SeatMap *map);
+void flushDirtySeatMaps();
+void journalBeginGroup();
+void journalEndGroup();
+int runBatch(FILE *input, int groupSize);
+double nowNanos();
+int dateKey(const char *date);
+int todayKey();
+void markShard(const char *date, const char *flightID);
+void markRecordShard(uint32_t date, uint32_t flight);
+Booking *findStoredBooking(const char *refNo);
+int loadArchives(int fromKey, int toKey);
+int archiveShards(int beforeKey);
+void printArchivedTotals();
+void listArchives();
+void rebuildRouteIndex();
+int searchFlights(const char *source, const char *destination, const char *date,
+                  float minPrice, float maxPrice, int offset, int limit,
+                  Flight **results, int *total);
+void searchFlightsMenu();
+int runSearchCommand(int argc, char *argv[]);
+int runServer(const char *socketPath, int workers);
+int requestCancellation(Booking *booking);
+int removeBooking(const char *refNo);
+int resolveCancelRequest(const char *refNo);
+int enqueueCancelRequest(CancelRequest *request);
+void dequeueCancelRequest(Booking *booking);
+void compactCancelQueue();
+int approveFlightCancellations(const char *flightID);
+int64_t toPaise(double amount);
+Aggregate *aggregateLookup(AggregateTable *table, const char *key, int create);
+void setFlightRoute(Flight *flight);
+int checkAggregates();
+void resetAggregates();
+void viewRevenueReport();
+int storeStats(const char *flightID, char *reply, size_t replySize);
+const char *stringText(const StringDictionary *dict, uint32_t code);
+uint32_t findString(StringDictionary *dict, const char *text);
+uint32_t internString(StringDictionary *dict, const char *text);
+void setFlightText(Flight *flight, const char *time, const char *source, const char *destination);
+const char *flightTime(const Flight *flight);
+const char *flightSource(const Flight *flight);
+const char *flightDestination(const Flight *flight);
+uint32_t flightCode(const char *flightID, int create);
+const char *flightName(uint32_t code);
+uint32_t packDate(const char *date);
+const char *dateText(uint32_t date, char *text);
+int packedDateKey(uint32_t date);
+Flight *flightByCode(uint32_t code);
+int csvOpen(CsvReader *reader, const char *path);
+int csvNextRow(CsvReader *reader, CsvField *fields);
+int csvCopy(char *dest, size_t size, CsvField field);
+int csvNumber(CsvField field, double *value);
+int csvInt(CsvField field, int *value);
+void csvMalformed(CsvReader *reader, const char *reason);
+void csvClose(CsvReader *reader);
+const char *parseBookingRow(CsvField *fields, int count, Booking *booking);
+void setCancelRequested(Booking *booking, int requested);
+int bestScanKernel();
+QueryResult scanColumns(const ColumnFilter *filter, int kernel);
+QueryResult queryBookings(const BookingQuery *query);
+void registerFlight(Flight *flight, int seatCount);
+void registerFlightLayout(Flight *flight, const SeatLayout *layout);
+int deleteFlight(const char *flightID);
+void *poolAlloc(Pool *pool);
+void poolFree(Pool *pool, void *item);
+void poolRelease(Pool *pool);
+Booking *allocBooking();
+void freeBooking(Booking *booking);
+Flight *allocFlight();
+void freeFlight(Flight *flight);
+CancelRequest *allocCancelRequest();
+void freeCancelRequest(CancelRequest *request);
+Booking *bookingIndexFind(BookingIndex *index, const char *refNo);
+Booking *bookingIndexRead(BookingIndex *index, const char *refNo);
+void epochEnter();
+void epochExit();
+void epochRetire(void *item, void (*release)(void *));
+void publishFlights();
+void bookingIndexInsert(BookingIndex *index, Booking *booking);
+void bookingIndexRemove(BookingIndex *index, const char *refNo);
+Flight *flightIndexFind(FlightIndex *index, const char *flightID);
+void flightIndexInsert(FlightIndex *index, Flight *flight);
+void flightIndexRemove(FlightIndex *index, const char *flightID);
+void poolAdopt(Pool *into, Pool *from);
+int startupThreads();
+double startupPhase(const char *name, double since, int parallel);
+void printStartupReport();
+void runLoadTasks(LoadTask *tasks, int count);
+void linkBooking(Booking *booking);
+void unlinkBooking(Booking *booking);
+int runBenchmark(int argc, char *argv[]);
+int runLoadGenerator(int argc, char *argv[]);
+void countWrite(size_t bytes);
+void countRead(size_t bytes);
+void metricRecord(int op, double start);
+int syncFile(int fd);
+void writeMetrics(FILE *out);
+const char *dumpMetrics();
+double totalPayments();
+void generateDataset(int flights, int seatsPerFlight, long bookings);
+int runGenerate(int argc, char *argv[]);
+Flight *findFlight(char *flightID);
+SeatMap *findSeatMap(const char *flightID);
+void loadSeatInventory();
+SeatMap *createSeatMap(const char *flightID, const SeatLayout *layout);
+void dropSeatMap(const char *flightID);
+int isSeatBooked(SeatMap *map, int seatNumber);
+int claimSeat(SeatMap *map, int seatNumber);
+void releaseSeat(SeatMap *map, int seatNumber);
+int seatsRemaining(SeatMap *map);
+void defaultSeatLayout(SeatLayout *layout, int seatCount);
+int parseSeatLayout(const char *text, SeatLayout *layout);
+void formatSeatLayout(const SeatLayout *layout, char *text, size_t size);
+int findCabin(const SeatMap *map, char code);
+int allocateSeats(SeatMap *map, int cabin, int count, int adjacent, int *seats);
+int bestSeat(SeatMap *map, int cabin);
+int claimOverbooked(SeatMap *map);
+float seatFare(const SeatMap *map, float price, int seatNumber);
+int checkSeatIndex(SeatMap *map);
+SeatMap *importSeatCSV(const char *flightID);
+void attachSeatMaps();
 
 
-void saveCancelRequestToFile(CancelRequest *request) {
-    FILE *file = fopen("cancellation_requests.csv", "a");
-    if (!file) {
-        printf("Error opening cancellation requests file.\n");
-        return;
+// Map a CSV file for reading. Returns 0 if it cannot be opened.
+int csvOpen(CsvReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->path = path;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
     }
-    fprintf(file, "%s,%s,%s,%s,%.2f\n", request->refNo, request->name, 
-            request->flightID, request->date, request->payment);
-    fclose(file);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+    reader->size = info.st_size;
+    countRead(reader->size);
+    if (reader->size > 0) {
+        void *data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        madvise(data, reader->size, MADV_SEQUENTIAL);
+        reader->data = (const char *)data;
+    }
+    close(fd);
+    return 1;
 }
 
-void loadCancelRequestsFromFile() {
-    FILE *file = fopen("cancellation_requests.csv", "r");
-    if (!file) {
-        printf("Error opening cancellation requests file.\n");
-        return;
+// Split the next non-empty row into fields pointing into the mapping.
+// Returns the number of fields (at most CSV_MAX_FIELDS), or -1 at the end of the file.
+int csvNextRow(CsvReader *reader, CsvField *fields) {
+    const char *end = reader->data + reader->size;
+    while (reader->pos < reader->size) {
+        // One pass over the row finds both the commas and the end of line
+        const char *row = reader->data + reader->pos, *start = row, *c = row;
+        int count = 0;
+        for (; c < end && *c != '\n'; c++) {
+            if (*c == ',') {
+                if (count < CSV_MAX_FIELDS - 1) {
+                    fields[count].start = start;
+                    fields[count].length = c - start;
+                }
+                count++;
+                start = c + 1;
+            }
+        }
+        reader->pos = (c - reader->data) + (c < end);
+        reader->line++;
+        const char *rowEnd = (c > start && c[-1] == '\r') ? c - 1 : c;
+        if (rowEnd == row) {
+            continue;
+        }
+        if (count >= CSV_MAX_FIELDS) {
+            return CSV_MAX_FIELDS + 1;  // Too many fields for any of our formats
+        }
+        fields[count].start = start;
+        fields[count].length = rowEnd - start;
+        return count + 1;
     }
+    return -1;
+}
 
-    CancelRequest *tail = NULL;
-    while (1) {
-        CancelRequest *newRequest = (CancelRequest *)malloc(sizeof(CancelRequest));
-        if (fscanf(file, "%[^,],%[^,],%[^,],%[^,],%f\n",
-                   newRequest->refNo, newRequest->name, newRequest->flightID, 
-                   newRequest->date, &newRequest->payment) != 5) {
-            free(newRequest);
-            break;
+// Copy a field into a fixed-width struct member. Returns 0 if it is empty or does not fit.
+int csvCopy(char *dest, size_t size, CsvField field) {
+    if (field.length == 0 || field.length >= size) {
+        return 0;
+    }
+    memcpy(dest, field.start, field.length);
+    dest[field.length] = '\0';
+    return 1;
+}
+
+// Parse a whole field as a decimal number such as 42, -3 or 5000.25
+int csvNumber(CsvField field, double *value) {
+    static const double scales[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    const char *c = field.start, *end = field.start + field.length;
+    int negative = c < end && *c == '-';
+    c += negative;
+    uint64_t mantissa = 0;
+    int digits = 0, decimals = -1;  // -1 until the decimal point
+    for (; c < end; c++) {
+        if (*c >= '0' && *c <= '9') {
+            mantissa = mantissa * 10 + (*c - '0');
+            digits++;
+            decimals += decimals >= 0;
+        } else if (*c == '.' && decimals < 0) {
+            decimals = 0;
+        } else {
+            return 0;
         }
+    }
+    if (digits == 0 || digits > 18) {
+        return 0;
+    }
+    *value = (negative ? -(double)mantissa : (double)mantissa) / scales[decimals > 0 ? decimals : 0];
+    return 1;
+}
 
-        newRequest->next = NULL;
-        if (tail) {
-            tail->next = newRequest;
+// Parse a whole field as an integer
+int csvInt(CsvField field, int *value) {
+    const char *c = field.start, *end = field.start + field.length;
+    int negative = c < end && *c == '-';
+    c += negative;
+    if (c == end || end - c > 9) {
+        return 0;
+    }
+    int number = 0;
+    for (; c < end; c++) {
+        if (*c < '0' || *c > '9') {
+            return 0;
+        }
+        number = number * 10 + (*c - '0');
+    }
+    *value = negative ? -number : number;
+    return 1;
+}
+
+// Note a row that could not be loaded; the first few are printed with their line numbers
+void csvMalformed(CsvReader *reader, const char *reason) {
+    if (++reader->malformed <= CSV_REPORT_LIMIT) {
+        if (reader->deferReports) {
+            reader->reports[reader->malformed - 1].line = reader->line;
+            reader->reports[reader->malformed - 1].reason = reason;
         } else {
-            headCancelRequests = newRequest;
+            printf("%s:%ld: skipped row, %s\n", reader->path, reader->line, reason);
         }
-        tail = newRequest;
     }
+}
 
-    fclose(file);
+// Unmap the file and summarise the rows that were skipped
+void csvClose(CsvReader *reader) {
+    if (reader->malformed > CSV_REPORT_LIMIT) {
+        printf("%s: %ld malformed rows skipped in total\n", reader->path, reader->malformed);
+    }
+    if (reader->data) {
+        munmap((void *)reader->data, reader->size);
+    }
+    reader->data = NULL;
 }
 
-void removeCancelRequestFromFile(char *refNo) {
-    FILE *file = fopen("cancellation_requests.csv", "r+");
-    if (!file) {
+// Fill a booking from a details.csv row. Rows carry the seat number since it was
+// added; older rows have six fields. Returns NULL if the row is valid, else the reason.
+const char *parseBookingRow(CsvField *fields, int count, Booking *booking) {
+    double payment;
+    int cancelRequested;
+    char flightID[10], date[DATE_TEXT_SIZE];
+    if (count != 6 && count != 7) {
+        return "expected 6 or 7 fields";
+    }
+    if (!csvCopy(booking->refNo, sizeof(booking->refNo), fields[0])) return "bad reference number";
+    if (!csvCopy(booking->name, sizeof(booking->name), fields[1])) return "bad name";
+    if (!csvCopy(flightID, sizeof(flightID), fields[2])) return "bad flight ID";
+    if (!csvCopy(date, sizeof(date), fields[3])) return "bad date";
+    booking->flight = flightCode(flightID, 1);
+    booking->date = packDate(date);
+    booking->seatNumber = 0;
+    if (count == 7 && !csvInt(fields[4], &booking->seatNumber)) return "bad seat number";
+    if (!csvNumber(fields[count - 2], &payment)) return "bad payment";
+    if (!csvInt(fields[count - 1], &cancelRequested)) return "bad cancellation flag";
+    booking->paise = toPaise(payment);
+    booking->cancelRequested = cancelRequested != 0;
+    return NULL;
+}
+
+void loadCancelRequestsFromFile() {
+    CsvReader reader;
+    if (!csvOpen(&reader, "cancellation_requests.csv")) {
         printf("Error opening cancellation requests file.\n");
         return;
     }
 
-    char tempFilename[] = "temp.csv";
-    FILE *tempFile = fopen(tempFilename, "w");
-    if (!tempFile) {
-        printf("Error creating temporary file.\n");
-        fclose(file);
+    CsvField fields[CSV_MAX_FIELDS];
+    int count;
+    while ((count = csvNextRow(&reader, fields)) >= 0) {
+        CancelRequest *newRequest = allocCancelRequest();
+        double payment;
+        char flightID[10], date[DATE_TEXT_SIZE];
+        const char *error = NULL;
+        if (count != 5) error = "expected 5 fields";
+        else if (!csvCopy(newRequest->refNo, sizeof(newRequest->refNo), fields[0])) error = "bad reference number";
+        else if (!csvCopy(newRequest->name, sizeof(newRequest->name), fields[1])) error = "bad name";
+        else if (!csvCopy(flightID, sizeof(flightID), fields[2])) error = "bad flight ID";
+        else if (!csvCopy(date, sizeof(date), fields[3])) error = "bad date";
+        else if (!csvNumber(fields[4], &payment)) error = "bad payment";
+        else {
+            newRequest->flight = flightCode(flightID, 1);
+            newRequest->date = packDate(date);
+            newRequest->paise = toPaise(payment);
+            // Requests for bookings that no longer exist could never be resolved
+            if (!enqueueCancelRequest(newRequest)) error = "no pending booking with this reference number";
+        }
+        if (error) {
+            csvMalformed(&reader, error);
+            freeCancelRequest(newRequest);
+        }
+    }
+
+    csvClose(&reader);
+}
+
+void approveCancellationFromRequest(char *refNo) {
+    double start = nowNanos();
+    Booking *booking = findStoredBooking(refNo);
+    if (!booking) {
+        printf("Booking not found.\n");
+        metricRecord(METRIC_APPROVE, start);
+        return;
+    }
+    if (booking->archived) {
+        printf("Booking is archived and cannot be changed.\n");
+        metricRecord(METRIC_APPROVE, start);
+        return;
+    }
+    if (!booking->cancelRequested) {
+        printf("Booking %s has no pending cancellation request.\n", refNo);
+        metricRecord(METRIC_APPROVE, start);
         return;
     }
 
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        char *token = strtok(line, ",");
-        if (token && strcmp(token, refNo) != 0) {
-            fputs(line, tempFile);
+    // Remove the booking and free its seat, recording the approval in the journal
+    // instead of rewriting the CSV files
+    approveBooking(refNo);
+
+    printf("Cancellation approved and booking removed successfully.\n");
+    metricRecord(METRIC_APPROVE, start);
+}
+
+// Append a request to the cancel queue and attach it to its booking.
+// Returns 0, leaving the request to the caller, if no booking is waiting for it.
+int enqueueCancelRequest(CancelRequest *request) {
+    Booking *booking = bookingIndexFind(&bookingIndex, request->refNo);
+    if (!booking || booking->cancelRequest) {
+        return 0;
+    }
+    if (cancelQueue.tail == cancelQueue.capacity) {
+        // Reuse tombstoned space when at least half the slots are dead, otherwise grow
+        if (cancelQueue.capacity > 0 && cancelQueue.tail - cancelQueue.live >= cancelQueue.capacity / 2) {
+            compactCancelQueue();
+        } else {
+            size_t capacity = cancelQueue.capacity ? cancelQueue.capacity * 2 : 1024;
+            CancelRequest **slots = (CancelRequest **)realloc(cancelQueue.slots, capacity * sizeof(CancelRequest *));
+            if (!slots) {
+                printf("Memory allocation failed for cancel queue.\n");
+                exit(1);
+            }
+            cancelQueue.slots = slots;
+            cancelQueue.capacity = capacity;
         }
     }
+    if (request->sequence == 0) {
+        request->sequence = ++cancelSequence;
+    } else if (request->sequence > cancelSequence) {
+        cancelSequence = request->sequence;
+    }
+    request->slot = cancelQueue.tail;
+    cancelQueue.slots[cancelQueue.tail++] = request;
+    cancelQueue.live++;
+    booking->cancelRequest = request;
+    setCancelRequested(booking, 1);
+    return 1;
+}
 
-    fclose(file);
-    fclose(tempFile);
-    remove("cancellation_requests.csv");
-    rename(tempFilename, "cancellation_requests.csv");
+// Take a booking's request out of the queue, leaving a tombstone in its slot
+void dequeueCancelRequest(Booking *booking) {
+    CancelRequest *request = booking->cancelRequest;
+    if (!request) {
+        return;
+    }
+    cancelQueue.slots[request->slot] = NULL;
+    cancelQueue.live--;
+    if (cancelQueue.live == 0) {
+        cancelQueue.head = cancelQueue.tail = 0;
+    } else {
+        while (!cancelQueue.slots[cancelQueue.head]) {
+            cancelQueue.head++;
+        }
+    }
+    booking->cancelRequest = NULL;
+    freeCancelRequest(request);
 }
 
-void approveCancellationFromRequest(char *refNo) {
-    // 1. Find and remove the booking from the details list
-    Booking *current = head, *prev = NULL;
+// Squeeze the tombstones out of the cancel queue, keeping arrival order
+void compactCancelQueue() {
+    size_t live = 0;
+    for (size_t i = cancelQueue.head; i < cancelQueue.tail; i++) {
+        CancelRequest *request = cancelQueue.slots[i];
+        if (request) {
+            request->slot = live;
+            cancelQueue.slots[live++] = request;
+        }
+    }
+    cancelQueue.head = 0;
+    cancelQueue.tail = live;
+}
+
+// Flag a booking for cancellation and queue a request for the admin
+int requestCancellation(Booking *booking) {
+    if (booking->cancelRequested) {
+        return 0;
+    }
+    CancelRequest *newRequest = allocCancelRequest();
+    strcpy(newRequest->refNo, booking->refNo);
+    strcpy(newRequest->name, booking->name);
+    newRequest->flight = booking->flight;
+    newRequest->date = booking->date;
+    newRequest->paise = booking->paise;
+    enqueueCancelRequest(newRequest);
+    markRecordShard(booking->date, booking->flight);
+    return 1;
+}
+
+// Drop a booking whose cancellation was approved, releasing its seat
+int removeBooking(const char *refNo) {
+    Booking *current = bookingIndexFind(&bookingIndex, refNo);
+    if (!current) {
+        return 0;
+    }
+    Flight *flight = flightByCode(current->flight);
+    if (flight && flight->seats) {
+        releaseSeat(flight->seats, current->seatNumber);
+    }
+    dequeueCancelRequest(current);
+    unlinkBooking(current);
+    freeBooking(current);
+    return 1;
+}
+
+// Clear a booking's cancellation flag and its pending request
+int resolveCancelRequest(const char *refNo) {
+    Booking *current = bookingIndexFind(&bookingIndex, refNo);
+    if (!current) {
+        return 0;
+    }
+    setCancelRequested(current, 0);
+    dequeueCancelRequest(current);
+    markRecordShard(current->date, current->flight);
+    return 1;
+}
+
+// Approve every pending cancellation on a flight in one pass over the queue.
+// The freed seats reach the inventory file as one bitmap write. Returns the count.
+int approveFlightCancellations(const char *flightID) {
+    Flight *flight = findFlight((char *)flightID);
+    SeatMap *seats = flight ? flight->seats : NULL;
+    uint32_t code = flightCode(flightID, 0);
+    int deferred = seatWritesDeferred;
+    seatWritesDeferred = 1;
+
+    int approved = 0;
+    for (size_t i = cancelQueue.head; i < cancelQueue.tail && code != UINT32_MAX; i++) {
+        CancelRequest *request = cancelQueue.slots[i];
+        if (!request || request->flight != code) {
+            continue;
+        }
+        Booking *booking = bookingIndexFind(&bookingIndex, request->refNo);
+        if (booking->archived) {
+            continue;
+        }
+        if (seats) {
+            releaseSeat(seats, booking->seatNumber);
+        }
+        dequeueCancelRequest(booking);
+        unlinkBooking(booking);
+        freeBooking(booking);
+        approved++;
+    }
+
+    seatWritesDeferred = deferred;
+    if (seats && seats->dirty && !deferred) {
+        flushSeatMap(seats);
+    }
+    return approved;
+}
+
+// Add a flight with one economy cabin of seatCount seats
+void registerFlight(Flight *flight, int seatCount) {
+    SeatLayout layout;
+    defaultSeatLayout(&layout, seatCount);
+    registerFlightLayout(flight, &layout);
+}
+
+static int removalQueued(const char *flightID);
+
+// Add a flight to the list, reusing its seat map from the inventory if present. Bookings
+// of an earlier flight with the same ID still waiting for refund are refunded first, so
+// their takings never move over to the new flight's route.
+void registerFlightLayout(Flight *flight, const SeatLayout *layout) {
+    if (removalQueued(flight->flightID)) {
+        finishFlightRemovals();
+    }
+    flight->seats = findSeatMap(flight->flightID);
+    if (!flight->seats) {
+        flight->seats = createSeatMap(flight->flightID, layout);
+    }
+    flight->archived = 0;
+    flight->next = flightHead;
+    flightHead = flight;
+    flightIndexInsert(&flightIndex, flight);
+    setFlightRoute(flight);
+    routeIndex.dirty = 1;
+    markShard(flight->date, flight->flightID);
+}
+
+static void queueFlightRemoval(const char *flightID);
+
+// Unlink a flight, drop its seat map and queue its bookings for refund; returns 0 if it
+// does not exist
+int deleteFlight(const char *flightID) {
+    uint32_t code = flightCode(flightID, 0);
+    Flight *current = code == UINT32_MAX ? NULL : flightHead, *prev = NULL;
     while (current) {
-        if (strcmp(current->refNo, refNo) == 0) {
+        if (current->code == code) {
             if (prev) {
                 prev->next = current->next;
             } else {
-                head = current->next;
+                flightHead = current->next;
             }
-            free(current);
-            break;
+            flightIndexRemove(&flightIndex, current->flightID);
+            queueFlightRemoval(current->flightID);
+            if (current->seats) {
+                dropFlightHolds(current->seats);
+            }
+            dropSeatMap(current->flightID);
+            markShard(current->date, current->flightID);
+            freeFlight(current);
+            routeIndex.dirty = 1;
+            return 1;
         }
         prev = current;
         current = current->next;
     }
-
-    // 2. Remove the request from cancellation_requests.csv
-    removeCancelRequestFromFile(refNo);
-
-    // 3. Update the details CSV after removal
-    updateCSV();
-
-    printf("Cancellation approved and booking removed successfully.\n");
+    return 0;
 }
 
 
-
 // Save the current booking list to the CSV file
-void saveDataToCSV() {
-    FILE *file = fopen("details.csv", "w");
+int saveDataToCSV() {
+    FILE *file = fopen("details.csv.tmp", "w");
     if (!file) {
         printf("Error opening file for saving data.\n");
-        return;
+        return 0;
     }
 
     Booking *current = head;
+    char date[DATE_TEXT_SIZE];
     while (current) {
-        fprintf(file, "%s,%s,%s,%s,%.2f,%d\n", current->refNo, current->name,
-                current->flightID, current->date, current->payment, current->cancelRequested);
+        fprintf(file, "%s,%s,%s,%s,%d,%.2f,%d\n", current->refNo, current->name,
+                flightName(current->flight), dateText(current->date, date), current->seatNumber,
+                current->paise / 100.0, current->cancelRequested);
         current = current->next;
     }
     
-    fclose(file);
+    if (!commitFile(file, "details.csv.tmp", "details.csv")) {
+        return 0;
+    }
     printf("Data saved successfully to details.csv\n");
+    return 1;
 }
 
 // Helper to find a flight by ID
 Flight *findFlight(char *flightID) {
-    Flight *current = flightHead;
-    while (current) {
-        if (strcmp(current->flightID, flightID) == 0) {
-            return current;
+    return flightIndexFind(&flightIndex, flightID);
+}
+
+// Hand out one record from a pool, reusing freed records before carving new slab space
+void *poolAlloc(Pool *pool) {
+    if (pool->freeList) {
+        void *item = pool->freeList;
+        pool->freeList = *(void **)item;
+        pool->live++;
+        return item;
+    }
+    if (!pool->slabs || pool->used == pool->perSlab) {
+        PoolSlab *slab = (PoolSlab *)malloc(sizeof(PoolSlab) + pool->perSlab * pool->itemSize);
+        if (!slab) {
+            printf("Error allocating memory.\n");
+            exit(1);
         }
-        current = current->next;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->used = 0;
     }
-    return NULL;
+    void *item = (char *)(pool->slabs + 1) + pool->used * pool->itemSize;
+    pool->used++;
+    pool->live++;
+    return item;
 }
 
-// Generate a random reference number for bookings
-char *generateRefNo() {
-    static char refNo[10];
-    srand(time(NULL));
-    sprintf(refNo, "R%04d", rand() % 10000);
-    return refNo;
+// Return a record to its pool's free list
+void poolFree(Pool *pool, void *item) {
+    *(void **)item = pool->freeList;
+    pool->freeList = item;
+    pool->live--;
 }
 
-// Create the CSV file if it doesn't exist
-void createCSVIfNotExists() {
-    FILE *file = fopen(DESKTOP_PATH, "a");
-    if (!file) {
-        printf("Error creating or accessing the file.\n");
-        exit(1);
+// Release every slab of a pool at once
+void poolRelease(Pool *pool) {
+    while (pool->slabs) {
+        PoolSlab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
     }
-    fclose(file);
+    pool->used = 0;
+    pool->live = 0;
+    pool->freeList = NULL;
 }
 
-// Save booking data to the CSV file
-void saveBookingToFile(Booking *booking) {
-    FILE *file = fopen(DESKTOP_PATH, "a");
-    if (!file) {
-        printf("Error opening the file.\n");
-        exit(1);
+// Move every record of one pool into another, e.g. the bookings a loader thread parsed
+void poolAdopt(Pool *into, Pool *from) {
+    if (from->slabs) {
+        if (into->slabs) {
+            // Keep carving from into's current slab; the adopted slabs go behind it
+            PoolSlab *last = from->slabs;
+            while (last->next) {
+                last = last->next;
+            }
+            last->next = into->slabs->next;
+            into->slabs->next = from->slabs;
+        } else {
+            into->slabs = from->slabs;
+            into->used = from->used;
+        }
     }
-    fprintf(file, "%s,%s,%s,%s,%d,%.2f,%d\n", booking->refNo, booking->name,
-            booking->flightID, booking->date, booking->seatNumber,
-            booking->payment, booking->cancelRequested);
-    fclose(file);
+    while (from->freeList) {
+        void *item = from->freeList;
+        from->freeList = *(void **)item;
+        *(void **)item = into->freeList;
+        into->freeList = item;
+    }
+    into->live += from->live;
+    from->slabs = NULL;
+    from->used = 0;
+    from->live = 0;
 }
 
-
-// Update the CSV file with the current booking list
-void updateCSV() {
-    FILE *file = fopen(DESKTOP_PATH, "w");
-    if (!file) {
-        printf("Error opening the file.\n");
+// Register this thread's epoch slot, the first time it reads without the store lock
+static EpochSlot *epochRegister() {
+    EpochSlot *slot = (EpochSlot *)aligned_alloc(64, sizeof(EpochSlot));
+    if (!slot) {
+        printf("Memory allocation failed for epoch slot.\n");
         exit(1);
     }
-    Booking *current = head;
-    while (current) {
-        fprintf(file, "%s,%s,%s,%s,%.2f,%d\n", current->refNo, current->name,
-                current->flightID, current->date, current->payment,
-                current->cancelRequested);
-        current = current->next;
-    }
-    fclose(file);
+    memset(slot, 0, sizeof(*slot));
+    pthread_mutex_lock(&epochLock);
+    slot->next = epochs.slots;
+    __atomic_store_n(&epochs.slots, slot, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&epochLock);
+    epochSlot = slot;
+    return slot;
 }
 
-// Load the booking data from the CSV file into the linked list
-void loadDataFromCSV() {
-    FILE *file = fopen("details.csv", "r");
-    if (!file) {
-        printf("No existing data found. Starting fresh.\n");
-        return;  // No data to load
-    }
+// Start a lock-free read. Until epochExit, nothing the thread can reach from the
+// published index or flight snapshot is freed. Only the thread's own slot is written.
+void epochEnter() {
+    EpochSlot *slot = epochSlot ? epochSlot : epochRegister();
+    __atomic_store_n(&slot->epoch, __atomic_load_n(&epochs.global, __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epochExit() {
+    __atomic_store_n(&epochSlot->epoch, 0, __ATOMIC_RELEASE);
+}
 
-    while (!feof(file)) {
-        Booking *newBooking = (Booking *)malloc(sizeof(Booking));
-        if (fscanf(file, "%[^,],%[^,],%[^,],%[^,],%lf,%d\n", 
-                   newBooking->refNo, newBooking->name, newBooking->flightID,
-                   newBooking->date, &newBooking->payment, &newBooking->cancelRequested) == 6) {
-            newBooking->next = head;
-            head = newBooking;  // Insert at the beginning of the list
+// Advance the epoch and release every retired record that no reader can still hold:
+// those retired before the oldest epoch a reader is in. Caller holds epochLock.
+static void reclaimRetiredLocked() {
+    __atomic_fetch_add(&epochs.global, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64_t oldest = UINT64_MAX;
+    for (EpochSlot *slot = epochs.slots; slot; slot = slot->next) {
+        uint64_t epoch = __atomic_load_n(&slot->epoch, __ATOMIC_SEQ_CST);
+        if (epoch && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < epochs.count; i++) {
+        Retired *retired = &epochs.retired[i];
+        if (retired->epoch < oldest) {
+            retired->release(retired->item);
         } else {
-            free(newBooking);  // Invalid data format, free the allocated memory
+            epochs.retired[kept++] = *retired;
         }
     }
-    fclose(file);
-    printf("Data loaded from details.csv\n");
+    epochs.count = kept;
 }
 
+// Free a record once lock-free readers are done with it. The caller has already made
+// it unreachable from anything published.
+void epochRetire(void *item, void (*release)(void *)) {
+    pthread_mutex_lock(&epochLock);
+    if (epochs.count == epochs.capacity) {
+        size_t capacity = epochs.capacity ? epochs.capacity * 2 : EPOCH_RECLAIM_BATCH * 2;
+        Retired *retired = (Retired *)realloc(epochs.retired, capacity * sizeof(Retired));
+        if (!retired) {
+            printf("Memory allocation failed for retired records.\n");
+            exit(1);
+        }
+        epochs.retired = retired;
+        epochs.capacity = capacity;
+    }
+    Retired *retired = &epochs.retired[epochs.count++];
+    retired->item = item;
+    retired->release = release;
+    retired->epoch = __atomic_load_n(&epochs.global, __ATOMIC_SEQ_CST);
+    if (epochs.count % EPOCH_RECLAIM_BATCH == 0) {  // Not on every retirement while a reader stalls
+        reclaimRetiredLocked();
+    }
+    pthread_mutex_unlock(&epochLock);
+}
 
-// Load flights from the file into the linked list
-void loadFlightsFromFile() {
-    FILE *file = fopen(FLIGHT_FILE, "r");
-    if (!file) {
-        printf("Error opening flight data file.\n");
-        return;
+// Release every retired record, when no reader can be running
+static void drainRetired() {
+    pthread_mutex_lock(&epochLock);
+    for (size_t i = 0; i < epochs.count; i++) {
+        epochs.retired[i].release(epochs.retired[i].item);
     }
+    epochs.count = 0;
+    pthread_mutex_unlock(&epochLock);
+}
 
-    printf("Loading flights from file...\n");
+static void releaseBooking(void *booking) {
+    poolFree(&bookingPool, booking);
+}
 
-    Flight *tail = flightHead;
-    while (tail && tail->next) {
-        tail = tail->next;
-    }
+Booking *allocBooking() {
+    Booking *booking = (Booking *)poolAlloc(&bookingPool);
+    booking->archived = 0;
+    booking->removed = 0;
+    return booking;
+}
 
-    while (1) {
-        Flight *newFlight = (Flight *)malloc(sizeof(Flight));
-        if (fscanf(file, "%[^,],%[^,],%[^,],%[^,],%[^,],%f\n",
-                   newFlight->flightID, newFlight->date, newFlight->time,
-                   newFlight->source, newFlight->destination, &newFlight->price) != 6) {
-            free(newFlight);
-            break;
-        }
+// Give a booking back to the pool once lock-free readers can no longer see it
+void freeBooking(Booking *booking) {
+    epochRetire(booking, releaseBooking);
+}
 
-        newFlight->next = NULL;
+Flight *allocFlight() {
+    Flight *flight = (Flight *)poolAlloc(&flightPool);
+    flight->archived = 0;
+    return flight;
+}
 
-        if (tail) {
-            tail->next = newFlight;
-            tail = newFlight;
-        } else {
-            flightHead = newFlight;
-            tail = newFlight;
-        }
+void freeFlight(Flight *flight) {
+    poolFree(&flightPool, flight);
+}
 
-        printf("Loaded flight: %s, %s, %s, %s, %s, %.2f\n",
-               newFlight->flightID, newFlight->date, newFlight->time,
-               newFlight->source, newFlight->destination, newFlight->price);
-    }
+CancelRequest *allocCancelRequest() {
+    CancelRequest *request = (CancelRequest *)poolAlloc(&cancelPool);
+    request->sequence = 0;
+    return request;
+}
 
-    fclose(file);
+void freeCancelRequest(CancelRequest *request) {
+    poolFree(&cancelPool, request);
 }
 
-// Save flight data to file
-void saveFlightsToFile() {
-    FILE *file = fopen(FLIGHT_FILE, "w");
-    if (!file) {
-        printf("Error saving flight data.\n");
-        return;
+// FNV-1a hash of a reference number
+static size_t hashRefNo(const char *refNo) {
+    size_t hash = 2166136261u;
+    while (*refNo) {
+        hash ^= (unsigned char)*refNo++;
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    Flight *current = flightHead;
-    while (current) {
-        fprintf(file, "%s,%s,%s,%s,%s,%.2f\n", current->flightID, current->date,
-                current->time, current->source, current->destination, current->price);
-        current = current->next;
+// Slot arrays keep their capacity in the word before the first slot, so a reader that
+// loads the slots pointer alone probes with the matching mask
+static Booking **allocIndexSlots(size_t capacity) {
+    Booking **block = (Booking **)calloc(capacity + 1, sizeof(Booking *));
+    if (!block) {
+        printf("Error allocating booking index.\n");
+        exit(1);
     }
+    block[0] = (Booking *)(uintptr_t)capacity;
+    return block + 1;
+}
 
-    fclose(file);
+static void releaseIndexSlots(void *slots) {
+    free((Booking **)slots - 1);
 }
 
-// Display available flights
-void viewAvailableFlights() {
-    printf("\n=== Available Flights ===\n");
-    printf("FlightID  |    Source   |   Destination | Date | Time | Price\n");
-    Flight *current = flightHead;
-    while (current) {
-        printf("%s       |  %s     |     %s     | %s   | %s   |%.2f\n",
-               current->flightID, current->source, current->destination,
-               current->date, current->time, current->price);
-        current = current->next;
+// Rehash every live booking into a new slot array of the given capacity. Readers move
+// to it once it holds every booking; the old array is retired.
+static void bookingIndexResize(BookingIndex *index, size_t capacity) {
+    Booking **oldSlots = index->slots;
+    Booking **slots = allocIndexSlots(capacity);
+    size_t mask = capacity - 1, count = 0;
+    for (size_t i = 0; i < index->capacity; i++) {
+        Booking *booking = oldSlots[i];
+        if (booking && booking != INDEX_TOMBSTONE) {
+            size_t j = hashRefNo(booking->refNo) & mask;
+            while (slots[j]) {
+                j = (j + 1) & mask;
+            }
+            slots[j] = booking;
+            count++;
+        }
+    }
+    index->capacity = capacity;
+    index->count = count;
+    index->tombstones = 0;
+    __atomic_store_n(&index->slots, slots, __ATOMIC_RELEASE);
+    if (oldSlots) {
+        epochRetire(oldSlots, releaseIndexSlots);
     }
 }
 
-// Function to book a flight
-void bookFlight() {
-    char flightID[10];
-    printf("\nEnter Flight ID to book: ");
-    scanf("%s", flightID);
+// Look up a booking without the store lock. The caller is inside an epoch, which keeps
+// the slot array and the booking from being freed until it leaves.
+Booking *bookingIndexRead(BookingIndex *index, const char *refNo) {
+    Booking **slots = __atomic_load_n(&index->slots, __ATOMIC_ACQUIRE);
+    if (!slots) {
+        return NULL;
+    }
+    size_t mask = (size_t)(uintptr_t)slots[-1] - 1;
+    size_t i = hashRefNo(refNo) & mask;
+    Booking *booking;
+    while ((booking = __atomic_load_n(&slots[i], __ATOMIC_ACQUIRE))) {
+        if (booking != INDEX_TOMBSTONE && strcmp(booking->refNo, refNo) == 0) {
+            return booking;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
 
-    Flight *flight = findFlight(flightID);
-    if (!flight) {
-        printf("Flight not found.\n");
-        return;
+// Look up a booking by reference number, NULL if absent. Caller holds the store lock.
+Booking *bookingIndexFind(BookingIndex *index, const char *refNo) {
+    if (index->capacity == 0) {
+        return NULL;
     }
+    size_t mask = index->capacity - 1;
+    size_t i = hashRefNo(refNo) & mask;
+    while (index->slots[i]) {
+        if (index->slots[i] != INDEX_TOMBSTONE && strcmp(index->slots[i]->refNo, refNo) == 0) {
+            return index->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
 
-    // Display seat availability
-    char seatFile[50];
-    sprintf(seatFile, "%s_seats.csv", flightID);
+// Insert a booking, replacing any existing entry with the same refNo
+void bookingIndexInsert(BookingIndex *index, Booking *booking) {
+    // Keep the load factor (live + tombstones) under 70%
+    if ((index->count + index->tombstones + 1) * 10 >= index->capacity * 7) {
+        size_t capacity = index->capacity ? index->capacity : 64;
+        while ((index->count + 1) * 10 >= capacity * 5) {
+            capacity *= 2;
+        }
+        bookingIndexResize(index, capacity);
+    }
 
-    FILE *seatFilePtr = fopen(seatFile, "r+");
-    if (!seatFilePtr) {
-        printf("Error: Seat data for flight %s not found.\n", flightID);
+    size_t mask = index->capacity - 1;
+    size_t i = hashRefNo(booking->refNo) & mask;
+    size_t firstFree = index->capacity;
+    while (index->slots[i]) {
+        if (index->slots[i] == INDEX_TOMBSTONE) {
+            if (firstFree == index->capacity) {
+                firstFree = i;
+            }
+        } else if (strcmp(index->slots[i]->refNo, booking->refNo) == 0) {
+            __atomic_store_n(&index->slots[i], booking, __ATOMIC_RELEASE);
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    if (firstFree != index->capacity) {
+        i = firstFree;
+        index->tombstones--;
+    }
+    // Published with release, so a reader that finds the booking sees it filled in
+    __atomic_store_n(&index->slots[i], booking, __ATOMIC_RELEASE);
+    index->count++;
+}
+
+// Remove a booking from the index, leaving a tombstone in its slot
+void bookingIndexRemove(BookingIndex *index, const char *refNo) {
+    if (index->capacity == 0) {
         return;
     }
+    size_t mask = index->capacity - 1;
+    size_t i = hashRefNo(refNo) & mask;
+    while (index->slots[i]) {
+        if (index->slots[i] != INDEX_TOMBSTONE && strcmp(index->slots[i]->refNo, refNo) == 0) {
+            __atomic_store_n(&index->slots[i], INDEX_TOMBSTONE, __ATOMIC_RELEASE);
+            index->count--;
+            index->tombstones++;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
 
-    char line[100];
-    int seatGrid[200] = {0}; // 0 = available, 1 = booked
-    int totalSeats = 0;
+// Look up a flight by ID, NULL if absent
+Flight *flightIndexFind(FlightIndex *index, const char *flightID) {
+    uint32_t code = flightCode(flightID, 0);
+    return code < index->capacity ? index->byCode[code] : NULL;
+}
 
-    // Skip the header line
-    fgets(line, sizeof(line), seatFilePtr);
+// Flight of a dictionary code, as bookings hold it; no string is hashed or compared
+Flight *flightByCode(uint32_t code) {
+    return code < flightIndex.capacity ? flightIndex.byCode[code] : NULL;
+}
 
-    while (fgets(line, sizeof(line), seatFilePtr)) {
-        char *seat = strtok(line, ",");
-        char *status = strtok(NULL, ",");
-        int seatNum = atoi(seat);
-        if (seatNum > 0 && strcmp(status, "Available\n") == 0) {
-            seatGrid[seatNum - 1] = 0; // Available
-        } else {
-            seatGrid[seatNum - 1] = 1; // Booked
+// Insert a flight, replacing any existing entry with the same flightID
+void flightIndexInsert(FlightIndex *index, Flight *flight) {
+    flight->code = flightCode(flight->flightID, 1);
+    if (flight->code >= index->capacity) {
+        uint32_t capacity = index->capacity ? index->capacity : 1024;
+        while (flight->code >= capacity) {
+            capacity *= 2;
+        }
+        Flight **byCode = (Flight **)realloc(index->byCode, capacity * sizeof(Flight *));
+        if (!byCode) {
+            printf("Error allocating flight index.\n");
+            exit(1);
         }
-        totalSeats++;
+        memset(byCode + index->capacity, 0, (capacity - index->capacity) * sizeof(Flight *));
+        index->byCode = byCode;
+        index->capacity = capacity;
     }
-    fclose(seatFilePtr);
+    if (!index->byCode[flight->code]) {
+        index->count++;
+    }
+    index->byCode[flight->code] = flight;
+    __atomic_fetch_add(&flightListVersion, 1, __ATOMIC_RELEASE);
+}
 
-    printf("\nAvailable Seats (0 = Available, X = Booked):\n\n");
-    for (int i = 0; i < totalSeats; i++) {
-        if (seatGrid[i] == 0) {
-            printf("%10d", i + 1);
-        } else {
-            printf("%10c", 'X');
-        }
-        if ((i + 1) % 10 == 0) {
-            printf("\n");
-        }
+// Remove a flight from the index; its code stays in the dictionary for reuse
+void flightIndexRemove(FlightIndex *index, const char *flightID) {
+    uint32_t code = flightCode(flightID, 0);
+    if (code < index->capacity && index->byCode[code]) {
+        index->byCode[code] = NULL;
+        index->count--;
+        __atomic_fetch_add(&flightListVersion, 1, __ATOMIC_RELEASE);
     }
+}
 
-    int seatNumber;
-    printf("\nEnter seat number to book: ");
-    scanf("%d", &seatNumber);
+// Whole paise of an amount, so running sums never drift the way float sums do
+int64_t toPaise(double amount) {
+    return (int64_t)(amount * 100.0 + (amount < 0 ? -0.5 : 0.5));
+}
 
-    if (seatNumber <= 0 || seatNumber > totalSeats || seatGrid[seatNumber - 1] == 1) {
-        printf("Invalid or already booked seat.\n");
-        return;
+// Find the aggregate for key, adding an empty one if create is set
+Aggregate *aggregateLookup(AggregateTable *table, const char *key, int create) {
+    if (create && (table->count + 1) * 10 > table->capacity * 7) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 256;
+        Aggregate *oldSlots = table->slots;
+        size_t oldCapacity = table->capacity;
+        table->slots = (Aggregate *)calloc(capacity, sizeof(Aggregate));
+        if (!table->slots) {
+            printf("Memory allocation failed for aggregates.\n");
+            exit(1);
+        }
+        table->capacity = capacity;
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldSlots[i].key[0]) {
+                size_t j = hashRefNo(oldSlots[i].key) & (capacity - 1);
+                while (table->slots[j].key[0]) {
+                    j = (j + 1) & (capacity - 1);
+                }
+                table->slots[j] = oldSlots[i];
+            }
+        }
+        free(oldSlots);
+    }
+    if (table->capacity == 0) {
+        return NULL;
     }
 
-    // Update seat file
-    FILE *tempFile = fopen("temp.csv", "w");
-    if (!tempFile) {
-        printf("Error creating temporary file.\n");
-        return;
+    size_t mask = table->capacity - 1;
+    size_t i = hashRefNo(key) & mask;
+    while (table->slots[i].key[0]) {
+        if (strcmp(table->slots[i].key, key) == 0) {
+            return &table->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    if (!create) {
+        return NULL;
     }
+    strncpy(table->slots[i].key, key, sizeof(table->slots[i].key) - 1);
+    table->count++;
+    return &table->slots[i];
+}
+
+static void freeAggregates(AggregateTable *table) {
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
 
-    seatFilePtr = fopen(seatFile, "r");
-    fgets(line, sizeof(line), seatFilePtr); // Skip header
-    fprintf(tempFile, "SeatNumber,Status\n");
+// Add (sign 1) or remove (sign -1) a booking from every running total it counts towards
+static void countBooking(Totals *totals, const Booking *booking, const char *route, int sign) {
+    int64_t amount = booking->paise * sign;
+    totals->revenue += amount;
+    totals->bookings += sign;
 
-    while (fgets(line, sizeof(line), seatFilePtr)) {
-        char *seat = strtok(line, ",");
-        char *status = strtok(NULL, ",");
-        if (atoi(seat) == seatNumber && strcmp(status, "Available\n") == 0) {
-            fprintf(tempFile, "%s,Booked\n", seat);
-        } else {
-            fprintf(tempFile, "%s,%s", seat, status);
-        }
+    char date[DATE_TEXT_SIZE];
+    Aggregate *entry = aggregateLookup(&totals->byFlight, flightName(booking->flight), 1);
+    entry->revenue += amount;
+    entry->bookings += sign;
+    if (booking->seatNumber == SEAT_OVERBOOKED) {
+        entry->unseated += sign;
+    }
+    entry = aggregateLookup(&totals->byDate, dateText(booking->date, date), 1);
+    entry->revenue += amount;
+    entry->bookings += sign;
+    if (route && route[0]) {
+        entry = aggregateLookup(&totals->byRoute, route, 1);
+        entry->revenue += amount;
+        entry->bookings += sign;
     }
+}
 
-    fclose(seatFilePtr);
-    fclose(tempFile);
+// Route a booking's takings are counted under: that of its flight when it was last seen
+static const char *bookingRoute(const Booking *booking) {
+    Aggregate *flight = aggregateLookup(&totals.byFlight, flightName(booking->flight), 0);
+    return flight ? flight->route : NULL;
+}
 
-    remove(seatFile);
-    rename("temp.csv", seatFile);
+// Give a flight the codes its records are compared by
+static void internFlight(Flight *flight) {
+    flight->code = flightCode(flight->flightID, 1);
+    flight->departure = packDate(flight->date);
+}
 
-    // Save the booking details
-    Booking *newBooking = (Booking *)malloc(sizeof(Booking));
-    strcpy(newBooking->flightID, flightID);
-    printf("Enter your name: ");
-    scanf("%s", newBooking->name);
+// Set a flight's time and airports. Flights hold only their codes, so the text of a time
+// or airport is kept once however many flights share it.
+void setFlightText(Flight *flight, const char *time, const char *source, const char *destination) {
+    flight->time = internString(&timeDictionary, time);
+    flight->from = internString(&airportDictionary, source);
+    flight->to = internString(&airportDictionary, destination);
+}
 
-    strcpy(newBooking->date, flight->date); // Auto-fill date from flight info
-    newBooking->payment = flight->price;
-    newBooking->cancelRequested = 0;
-    strcpy(newBooking->refNo, generateRefNo());
-    newBooking->next = head;
-    head = newBooking;
+const char *flightTime(const Flight *flight) {
+    return stringText(&timeDictionary, flight->time);
+}
 
-    // Payment prompt
-    char paymentConfirmation[10];
-    printf("Pay amount %.2f (type PAY to confirm payment): ", flight->price);
-    scanf("%s", paymentConfirmation);
+const char *flightSource(const Flight *flight) {
+    return stringText(&airportDictionary, flight->from);
+}
 
-    // Check if the user typed "PAY"
-    if (strcasecmp(paymentConfirmation, "PAY") == 0) {
-        saveBookingToFile(newBooking);
-        printf("Booking successful! Your reference number is: %s\n", newBooking->refNo);
-        printf("Seat %d booked successfully on flight %s.\n", seatNumber, flightID);
-    } else {
-        printf("Payment not confirmed. Booking cancelled.\n");
+const char *flightDestination(const Flight *flight) {
+    return stringText(&airportDictionary, flight->to);
+}
+
+// Count a flight's takings under its route. Bookings may be loaded before their flight,
+// so whatever the flight already took moves over to the route now. Every flight entering
+// the store passes here, so its codes are set here too.
+void setFlightRoute(Flight *flight) {
+    internFlight(flight);
+    char route[64];
+    snprintf(route, sizeof(route), "%s-%s", flightSource(flight), flightDestination(flight));
+    Aggregate *entry = aggregateLookup(&totals.byFlight, flight->flightID, 1);
+    if (strcmp(entry->route, route) == 0) {
+        return;
     }
+    if (entry->route[0]) {
+        Aggregate *old = aggregateLookup(&totals.byRoute, entry->route, 1);
+        old->revenue -= entry->revenue;
+        old->bookings -= entry->bookings;
+    }
+    Aggregate *current = aggregateLookup(&totals.byRoute, route, 1);
+    current->revenue += entry->revenue;
+    current->bookings += entry->bookings;
+    strcpy(entry->route, route);
 }
 
+static int compareAggregates(const char *what, AggregateTable *expected, AggregateTable *actual) {
+    int mismatches = 0;
+    for (size_t i = 0; i < actual->capacity; i++) {
+        Aggregate *have = &actual->slots[i];
+        if (!have->key[0]) {
+            continue;
+        }
+        Aggregate *want = aggregateLookup(expected, have->key, 0);
+        int64_t revenue = want ? want->revenue : 0;
+        long bookings = want ? want->bookings : 0;
+        if (have->revenue != revenue || have->bookings != bookings) {
+            printf("Mismatch for %s %s: %ld bookings, %.2f revenue; recomputed %ld bookings, %.2f revenue\n",
+                   what, have->key, have->bookings, have->revenue / 100.0, bookings, revenue / 100.0);
+            mismatches++;
+        }
+    }
+    // Keys the running totals never saw at all
+    for (size_t i = 0; i < expected->capacity; i++) {
+        Aggregate *want = &expected->slots[i];
+        if (want->key[0] && want->bookings != 0 && !aggregateLookup(actual, want->key, 0)) {
+            printf("Missing %s %s: recomputed %ld bookings, %.2f revenue\n",
+                   what, want->key, want->bookings, want->revenue / 100.0);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
 
+// Recompute every running total and seat count from scratch and report any difference.
+// Routes come from the flight table, not from the running totals being checked; bookings
+// of a removed flight count under no route. Returns the number of mismatches.
+int checkAggregates() {
+    Totals fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    for (Booking *b = head; b; b = b->next) {
+        Flight *flight = b->removed ? NULL : flightByCode(b->flight);
+        char route[64] = "";
+        if (flight) {
+            snprintf(route, sizeof(route), "%s-%s", flightSource(flight), flightDestination(flight));
+        }
+        countBooking(&fresh, b, route, 1);
+    }
 
-void viewTicket() {
-    char refNo[10];
-    printf("\nEnter Reference Number: ");
-    scanf("%s", refNo);
+    int mismatches = 0;
+    if (fresh.revenue != totals.revenue || fresh.bookings != totals.bookings) {
+        printf("Mismatch in totals: %ld bookings, %.2f revenue; recomputed %ld bookings, %.2f revenue\n",
+               totals.bookings, totals.revenue / 100.0, fresh.bookings, fresh.revenue / 100.0);
+        mismatches++;
+    }
+    mismatches += compareAggregates("flight", &fresh.byFlight, &totals.byFlight);
+    mismatches += compareAggregates("date", &fresh.byDate, &totals.byDate);
+    mismatches += compareAggregates("route", &fresh.byRoute, &totals.byRoute);
 
-    Booking *current = head;
-    while (current) {
-        if (strcmp(current->refNo, refNo) == 0) {
-            printf("\n=== Booking Details ===\n");
-            printf("Reference Number: %s\n", current->refNo);
-            printf("Name: %s\n", current->name);
-            printf("Flight ID: %s\n", current->flightID);
-            printf("Date: %s\n", current->date);
-            printf("Payment: %.2f Rs\n", current->payment);
-            return;
+    for (SeatMap *map = seatMapHead; map; map = map->next) {
+        int booked = 0;
+        for (int i = 0; i < map->wordCount; i++) {
+            booked += __builtin_popcountll(map->bits[i]);
         }
-        current = current->next;
+        if (booked != map->seatsBooked) {
+            printf("Mismatch in seats of flight %s: %d booked; bitmap has %d\n",
+                   map->flightID, map->seatsBooked, booked);
+            mismatches++;
+        }
+        Aggregate *flight = aggregateLookup(&fresh.byFlight, map->flightID, 0);
+        long unseated = flight ? flight->unseated : 0;
+        if (unseated != map->overbooked) {
+            printf("Mismatch in overbooked tickets of flight %s: %d counted; bookings have %ld\n",
+                   map->flightID, map->overbooked, unseated);
+            mismatches++;
+        }
+        mismatches += checkSeatIndex(map);
     }
-    printf("No booking found with the given reference number.\n");
-}
 
+    freeAggregates(&fresh.byFlight);
+    freeAggregates(&fresh.byDate);
+    freeAggregates(&fresh.byRoute);
+    return mismatches;
+}
 
-// Cancel a booking
-void trimWhitespace(char *str) {
-    char *end;
-    // Skip leading whitespace
-    while (*str == ' ' || *str == '\t') str++; 
-    if (*str == 0)  // If the string is all whitespace
-        return;
-    
-    end = str + strlen(str) - 1;
-    
-    // Skip trailing whitespace
-    while (end > str && (*end == ' ' || *end == '\t')) end--; 
-    
-    // Null-terminate the string at the last non-whitespace character
-    *(end + 1) = '\0';
+// Drop every running total, used when the store is released
+void resetAggregates() {
+    freeAggregates(&totals.byFlight);
+    freeAggregates(&totals.byDate);
+    freeAggregates(&totals.byRoute);
+    totals.revenue = 0;
+    totals.bookings = 0;
 }
 
+// Text of a code handed out by a dictionary
+const char *stringText(const StringDictionary *dict, uint32_t code) {
+    return dict->chunks[code >> DICTIONARY_CHUNK_BITS] + (size_t)(code & (DICTIONARY_CHUNK - 1)) * dict->width;
+}
 
-// Function to cancel a booking
-// Cancel a booking
+// Code of a string, UINT32_MAX if it has none. Needs no lock, even while another thread
+// adds strings: slot tables are never freed while the store is live, and a code is
+// published only once its text is written.
+uint32_t findString(StringDictionary *dict, const char *text) {
+    DictionarySlots *slots = __atomic_load_n(&dict->slots, __ATOMIC_ACQUIRE);
+    if (!slots) {
+        return UINT32_MAX;
+    }
+    size_t i = hashRefNo(text) & slots->mask;
+    uint32_t entry;
+    while ((entry = __atomic_load_n(&slots->codes[i], __ATOMIC_ACQUIRE)) != 0) {
+        if (strcmp(stringText(dict, entry - 1), text) == 0) {
+            return entry - 1;
+        }
+        i = (i + 1) & slots->mask;
+    }
+    return UINT32_MAX;
+}
 
-void cancelBooking() {
-    char refNo[10];
-    printf("\nEnter Reference Number to Request Cancellation: ");
-    scanf("%s", refNo);
+// Rehash every code into a slot table of the given capacity and publish it. The old table
+// is kept for readers still probing it; all the old ones together are smaller than the new.
+static void growDictionary(StringDictionary *dict, size_t capacity) {
+    DictionarySlots *slots = (DictionarySlots *)calloc(1, sizeof(DictionarySlots) + capacity * sizeof(uint32_t));
+    if (!slots) {
+        printf("Memory allocation failed for %s dictionary.\n", dict->name);
+        exit(1);
+    }
+    slots->mask = capacity - 1;
+    for (uint32_t code = 0; code < dict->count; code++) {
+        size_t j = hashRefNo(stringText(dict, code)) & slots->mask;
+        while (slots->codes[j]) {
+            j = (j + 1) & slots->mask;
+        }
+        slots->codes[j] = code + 1;
+    }
+    slots->previous = dict->slots;
+    __atomic_store_n(&dict->slots, slots, __ATOMIC_RELEASE);
+}
 
-    Booking *current = head;
-    while (current) {
-        if (strcmp(current->refNo, refNo) == 0) {
-            // Move the booking to cancellation requests list
-            CancelRequest *newRequest = (CancelRequest *)malloc(sizeof(CancelRequest));
-            strcpy(newRequest->refNo, current->refNo);
-            strcpy(newRequest->name, current->name);
-            strcpy(newRequest->flightID, current->flightID);
-            strcpy(newRequest->date, current->date);
-            newRequest->payment = current->payment;
-            newRequest->next = headCancelRequests;
-            headCancelRequests = newRequest;
-
-            // Mark booking for cancellation (or just leave it as is)
-            current->cancelRequested = 1;
-            updateCSV();
-
-            printf("Cancellation request sent to admin for approval.\n");
-            return;
+// Code of a string, adding it if it is new. Text longer than the dictionary's cells is
+// cut short, the way the fixed fields it replaces cut it.
+uint32_t internString(StringDictionary *dict, const char *text) {
+    char cell[DICTIONARY_MAX_WIDTH];
+    if (strlen(text) >= dict->width) {
+        snprintf(cell, dict->width, "%s", text);
+        text = cell;
+    }
+    uint32_t code = findString(dict, text);
+    if (code != UINT32_MAX) {
+        return code;
+    }
+    pthread_mutex_lock(&dict->lock);
+    code = findString(dict, text);  // Another thread may have added it meanwhile
+    if (code != UINT32_MAX) {
+        pthread_mutex_unlock(&dict->lock);
+        return code;
+    }
+    code = dict->count;
+    if (code == (uint32_t)DICTIONARY_CHUNKS << DICTIONARY_CHUNK_BITS) {
+        printf("The %s dictionary is full.\n", dict->name);
+        exit(1);
+    }
+    if (!dict->slots || (size_t)(code + 1) * 10 > (dict->slots->mask + 1) * 7) {
+        growDictionary(dict, dict->slots ? (dict->slots->mask + 1) * 2 : 1024);
+    }
+    char **chunk = &dict->chunks[code >> DICTIONARY_CHUNK_BITS];
+    if (!*chunk) {
+        *chunk = (char *)malloc(DICTIONARY_CHUNK * dict->width);
+        if (!*chunk) {
+            printf("Memory allocation failed for %s dictionary.\n", dict->name);
+            exit(1);
         }
-        current = current->next;
     }
-    printf("No booking found with the given reference number.\n");
+    strcpy(*chunk + (size_t)(code & (DICTIONARY_CHUNK - 1)) * dict->width, text);
+    DictionarySlots *slots = dict->slots;
+    size_t i = hashRefNo(text) & slots->mask;
+    while (slots->codes[i]) {
+        i = (i + 1) & slots->mask;
+    }
+    // Published with release, so a reader that finds the code sees its text
+    __atomic_store_n(&slots->codes[i], code + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&dict->count, code + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dict->lock);
+    return code;
 }
 
+static void freeDictionary(StringDictionary *dict) {
+    for (int c = 0; c < DICTIONARY_CHUNKS && dict->chunks[c]; c++) {
+        free(dict->chunks[c]);
+        dict->chunks[c] = NULL;
+    }
+    while (dict->slots) {
+        DictionarySlots *previous = dict->slots->previous;
+        free(dict->slots);
+        dict->slots = previous;
+    }
+    dict->count = 0;
+}
 
+// Code of a flight ID in the dictionary, adding it if create is set; UINT32_MAX if absent
+uint32_t flightCode(const char *flightID, int create) {
+    return create ? internString(&flightDictionary, flightID) : findString(&flightDictionary, flightID);
+}
 
+const char *flightName(uint32_t code) {
+    return stringText(&flightDictionary, code);
+}
 
-void createCancellationFileIfNotExists() {
-    FILE *file = fopen("cancellation_requests.csv", "a");
-    if (!file) {
-        printf("Error creating or accessing the cancellation request file.\n");
-        exit(1);
+// A date as records keep it: DD/MM/YYYY is packed as the number YYYYMMDD, and any other
+// text is interned in the date dictionary and its code stored with DATE_INTERNED set
+uint32_t packDate(const char *date) {
+    const char *form = "00/00/0000";
+    int i = 0;
+    while (form[i] && (form[i] == '/' ? date[i] == '/' : date[i] >= '0' && date[i] <= '9')) {
+        i++;
     }
-    fclose(file);
+    if (!form[i] && !date[i]) {
+        return (uint32_t)dateKey(date);
+    }
+    return DATE_INTERNED | internString(&dateDictionary, date);
 }
 
-// Admin menu for managing flights
-void adminMenu() {
-    int choice;
+// Text of a packed date, written to text unless it was interned
+const char *dateText(uint32_t date, char *text) {
+    if (date & DATE_INTERNED) {
+        return stringText(&dateDictionary, date & ~DATE_INTERNED);
+    }
+    const char *form = "00/00/0000";
+    uint32_t digits[8] = {date / 10 % 10, date % 10, date / 1000 % 10, date / 100 % 10,
+                          date / 10000000 % 10, date / 1000000 % 10, date / 100000 % 10, date / 10000 % 10};
+    for (int i = 0, d = 0; form[i]; i++) {
+        text[i] = form[i] == '/' ? '/' : (char)('0' + digits[d++]);
+    }
+    text[10] = '\0';
+    return text;
+}
 
-    while (1) {
-        printf("\n=== Admin Menu ===\n");
-        printf("1. View Cancellation Requests\n");
-        printf("2. Approve Cancellation Request\n");
-        printf("3. Add Flight\n");
-        printf("4. Remove Flight\n");
-        printf("5. View Total Payments\n");
-        printf("6. View Available Flights\n");
-        printf("7. Exit\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
+// Sortable YYYYMMDD of a packed date, 0 if its text is malformed
+int packedDateKey(uint32_t date) {
+    return date & DATE_INTERNED ? dateKey(stringText(&dateDictionary, date & ~DATE_INTERNED)) : (int)date;
+}
 
-        switch (choice) {
-            case 1:
-                viewCancelRequests();
-                break;
-            case 2:
-                {
-                    char refNo[10];
-                    printf("\nEnter Reference Number to Approve Cancellation: ");
-                    scanf("%s", refNo);
-                    approveCancellationFromRequest(refNo);
-                }
-                break;
-            case 3:
-                addFlight();
-                break;
-            case 4:
-                removeFlight();
-                break;
-            case 5:
-                viewTotalPayments();
-                break;
-            case 6:
-                viewAvailableFlights();
-                break;
-            case 7:
-                return;
-            default:
-                printf("Invalid choice.\n");
-                break;
+// Put a booking at the front of its flight's list in the flight index
+static void linkFlightBooking(Booking *booking, uint32_t code) {
+    FlightBookings *lists = &flightBookings;
+    if (code >= lists->capacity) {
+        uint32_t capacity = lists->capacity ? lists->capacity : 1024;
+        while (code >= capacity) {
+            capacity *= 2;
+        }
+        Booking **heads = (Booking **)realloc(lists->heads, capacity * sizeof(Booking *));
+        if (!heads) {
+            printf("Memory allocation failed for flight bookings.\n");
+            exit(1);
+        }
+        memset(heads + lists->capacity, 0, (capacity - lists->capacity) * sizeof(Booking *));
+        // Each list's first booking points back at its head, which has moved
+        for (uint32_t i = 0; i < lists->capacity; i++) {
+            if (heads[i]) {
+                heads[i]->flightPrev = &heads[i];
+            }
         }
+        lists->heads = heads;
+        lists->capacity = capacity;
     }
+    booking->flightNext = lists->heads[code];
+    booking->flightPrev = &lists->heads[code];
+    if (booking->flightNext) {
+        booking->flightNext->flightPrev = &booking->flightNext;
+    }
+    lists->heads[code] = booking;
 }
 
+static void unlinkFlightBooking(Booking *booking) {
+    if (booking->flightPrev) {
+        *booking->flightPrev = booking->flightNext;
+        if (booking->flightNext) {
+            booking->flightNext->flightPrev = booking->flightPrev;
+        }
+    }
+    booking->flightNext = NULL;
+    booking->flightPrev = NULL;
+}
 
-// View cancel requests
-void viewCancelRequests() {
-    CancelRequest *current = headCancelRequests;
-    int found = 0;
+// Append a booking's row to the columns, and the booking to its flight's list
+static void appendBookingRow(Booking *booking) {
+    BookingColumns *cols = &bookingColumns;
+    if (cols->count == cols->capacity) {
+        size_t capacity = cols->capacity ? cols->capacity * 2 : 4096;
+        uint32_t *flight = (uint32_t *)realloc(cols->flight, capacity * sizeof(uint32_t));
+        if (flight) cols->flight = flight;
+        uint32_t *date = (uint32_t *)realloc(cols->date, capacity * sizeof(uint32_t));
+        if (date) cols->date = date;
+        uint32_t *paise = (uint32_t *)realloc(cols->paise, capacity * sizeof(uint32_t));
+        if (paise) cols->paise = paise;
+        uint8_t *status = (uint8_t *)realloc(cols->status, capacity * sizeof(uint8_t));
+        if (status) cols->status = status;
+        Booking **owner = (Booking **)realloc(cols->owner, capacity * sizeof(Booking *));
+        if (owner) cols->owner = owner;
+        if (!flight || !date || !paise || !status || !owner) {
+            printf("Memory allocation failed for booking columns.\n");
+            exit(1);
+        }
+        cols->capacity = capacity;
+    }
+    size_t row = cols->count++;
+    int64_t paise = booking->paise;
+    cols->flight[row] = booking->flight;
+    linkFlightBooking(booking, cols->flight[row]);
+    cols->date[row] = (uint32_t)packedDateKey(booking->date);
+    cols->paise[row] = paise < 0 ? 0 : (paise > UINT32_MAX ? UINT32_MAX : (uint32_t)paise);
+    cols->status[row] = booking->cancelRequested ? STATUS_CANCEL_REQUESTED : 0;
+    cols->owner[row] = booking;
+    booking->row = row;
+}
 
-    printf("\n=== Cancellation Requests ===\n");
-    while (current) {
-        found = 1;
-        printf("RefNo: %s | Name: %s | FlightID: %s | Date: %s | Payment: %.2f Rs\n",
-               current->refNo, current->name, current->flightID, current->date,
-               current->payment);
-        current = current->next;
+// Remove a booking's row by moving the last row into its place, and the booking from
+// its flight's list
+static void removeBookingRow(Booking *booking) {
+    unlinkFlightBooking(booking);
+    BookingColumns *cols = &bookingColumns;
+    size_t row = booking->row, last = --cols->count;
+    if (row != last) {
+        cols->flight[row] = cols->flight[last];
+        cols->date[row] = cols->date[last];
+        cols->paise[row] = cols->paise[last];
+        cols->status[row] = cols->status[last];
+        cols->owner[row] = cols->owner[last];
+        cols->owner[row]->row = row;
     }
+}
 
-    if (!found) {
-        printf("No cancellation requests found.\n");
+// Keep a booking's cancellation flag and its status column in step
+void setCancelRequested(Booking *booking, int requested) {
+    __atomic_store_n(&booking->cancelRequested, requested, __ATOMIC_RELEASE);
+    if (requested) {
+        bookingColumns.status[booking->row] |= STATUS_CANCEL_REQUESTED;
+    } else {
+        bookingColumns.status[booking->row] &= ~STATUS_CANCEL_REQUESTED;
+    }
+}
+
+// Count and sum the rows in [begin, end) that pass the filter, one row at a time
+static void scanColumnsScalar(const ColumnFilter *filter, size_t begin, size_t end, QueryResult *result) {
+    const BookingColumns *cols = &bookingColumns;
+    long count = 0;
+    int64_t paise = 0;
+    for (size_t i = begin; i < end; i++) {
+        int match = (filter->anyFlight || cols->flight[i] == filter->flight) &
+                    (cols->date[i] >= filter->fromDate) & (cols->date[i] <= filter->toDate) &
+                    ((cols->status[i] & filter->statusMask) == filter->statusValue);
+        count += match;
+        paise += match ? cols->paise[i] : 0;
     }
+    result->count += count;
+    result->paise += paise;
 }
 
+#if defined(__x86_64__) || defined(__i386__)
+// Four rows per step. SSE2 has no unsigned compare, but dates are below 2^31.
+__attribute__((target("sse2")))
+static void scanColumnsSSE2(const ColumnFilter *filter, QueryResult *result) {
+    const BookingColumns *cols = &bookingColumns;
+    size_t n = cols->count & ~(size_t)3;
+    __m128i flight = _mm_set1_epi32((int)filter->flight);
+    __m128i anyFlight = _mm_set1_epi32(filter->anyFlight ? -1 : 0);
+    __m128i before = _mm_set1_epi32((int)filter->fromDate - 1);
+    __m128i after = _mm_set1_epi32((int)filter->toDate + 1);
+    __m128i statusMask = _mm_set1_epi32(filter->statusMask);
+    __m128i statusValue = _mm_set1_epi32(filter->statusValue);
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    long count = 0;
+    for (size_t i = 0; i < n; i += 4) {
+        __m128i date = _mm_loadu_si128((const __m128i *)&cols->date[i]);
+        __m128i match = _mm_or_si128(anyFlight, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&cols->flight[i]), flight));
+        match = _mm_and_si128(match, _mm_cmpgt_epi32(date, before));
+        match = _mm_and_si128(match, _mm_cmplt_epi32(date, after));
+        int32_t packed;
+        memcpy(&packed, &cols->status[i], sizeof(packed));
+        __m128i status = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+        match = _mm_and_si128(match, _mm_cmpeq_epi32(_mm_and_si128(status, statusMask), statusValue));
 
-void removeCancellationRequest(char *refNo) {
-    FILE *file = fopen("cancellation_requests.csv", "r");
-    if (!file) {
-        printf("Error opening cancellation request file.\n");
-        return;
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(match)));
+        __m128i paise = _mm_and_si128(_mm_loadu_si128((const __m128i *)&cols->paise[i]), match);
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(paise, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(paise, zero));
     }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    result->count += count;
+    result->paise += lanes[0] + lanes[1];
+    scanColumnsScalar(filter, n, cols->count, result);
+}
 
-    FILE *tempFile = fopen("temp_cancellations.csv", "w");
-    if (!tempFile) {
-        printf("Error opening temporary file.\n");
-        fclose(file);
-        return;
+// Eight rows per step
+__attribute__((target("avx2")))
+static void scanColumnsAVX2(const ColumnFilter *filter, QueryResult *result) {
+    const BookingColumns *cols = &bookingColumns;
+    size_t n = cols->count & ~(size_t)7;
+    __m256i flight = _mm256_set1_epi32((int)filter->flight);
+    __m256i anyFlight = _mm256_set1_epi32(filter->anyFlight ? -1 : 0);
+    __m256i before = _mm256_set1_epi32((int)filter->fromDate - 1);
+    __m256i after = _mm256_set1_epi32((int)filter->toDate + 1);
+    __m256i statusMask = _mm256_set1_epi32(filter->statusMask);
+    __m256i statusValue = _mm256_set1_epi32(filter->statusValue);
+    __m256i sum = _mm256_setzero_si256();
+    long count = 0;
+    for (size_t i = 0; i < n; i += 8) {
+        __m256i date = _mm256_loadu_si256((const __m256i *)&cols->date[i]);
+        __m256i match = _mm256_or_si256(anyFlight, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)&cols->flight[i]), flight));
+        match = _mm256_and_si256(match, _mm256_cmpgt_epi32(date, before));
+        match = _mm256_and_si256(match, _mm256_cmpgt_epi32(after, date));
+        __m256i status = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&cols->status[i]));
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi32(_mm256_and_si256(status, statusMask), statusValue));
+
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(match)));
+        __m256i paise = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&cols->paise[i]), match);
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(paise)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(paise, 1)));
     }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    result->count += count;
+    result->paise += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    scanColumnsScalar(filter, n, cols->count, result);
+}
+#endif
 
-    char line[100];
-    while (fgets(line, sizeof(line), file)) {
-        char tempRefNo[10];
-        sscanf(line, "%[^,],", tempRefNo);
+// Widest scan kernel this CPU supports
+int bestScanKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SCAN_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SCAN_SSE2;
+    }
+#endif
+    return SCAN_SCALAR;
+}
 
-        // Copy all lines except the canceled request
-        if (strcmp(tempRefNo, refNo) != 0) {
-            fputs(line, tempFile);
-        }
+// Run one filter over the booking columns with the given kernel
+QueryResult scanColumns(const ColumnFilter *filter, int kernel) {
+    QueryResult result = {0, 0};
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == SCAN_AVX2) {
+        scanColumnsAVX2(filter, &result);
+        return result;
     }
+    if (kernel == SCAN_SSE2) {
+        scanColumnsSSE2(filter, &result);
+        return result;
+    }
+#endif
+    (void)kernel;
+    scanColumnsScalar(filter, 0, bookingColumns.count, &result);
+    return result;
+}
 
-    fclose(file);
-    fclose(tempFile);
+// Count and total the bookings matching a query, scanning only the columns involved
+QueryResult queryBookings(const BookingQuery *query) {
+    static int kernel = SCAN_UNKNOWN;
+    if (kernel == SCAN_UNKNOWN) {
+        kernel = bestScanKernel();
+    }
+    ColumnFilter filter;
+    filter.anyFlight = query->flightID == NULL;
+    filter.flight = filter.anyFlight ? 0 : flightCode(query->flightID, 0);
+    if (!filter.anyFlight && filter.flight == UINT32_MAX) {
+        QueryResult none = {0, 0};
+        return none;
+    }
+    filter.fromDate = query->fromDate;
+    filter.toDate = query->toDate ? query->toDate : INT32_MAX - 1;
+    filter.statusMask = query->pendingOnly ? STATUS_CANCEL_REQUESTED : 0;
+    filter.statusValue = filter.statusMask;
+    return scanColumns(&filter, kernel);
+}
 
-    // Replace the original file with the new one without the canceled request
-    remove("cancellation_requests.csv");
-    rename("temp_cancellations.csv", "cancellation_requests.csv");
+static void freeBookingColumns() {
+    free(bookingColumns.flight);
+    free(bookingColumns.date);
+    free(bookingColumns.paise);
+    free(bookingColumns.status);
+    free(bookingColumns.owner);
+    memset(&bookingColumns, 0, sizeof(bookingColumns));
+    free(flightBookings.heads);
+    memset(&flightBookings, 0, sizeof(flightBookings));
 }
-// Function for admin authentication
-void adminAuthentication() {
-    char username[20], password[20];
-    
-    // Hardcoded admin credentials for simplicity
-    char adminUsername[] = "admin";
-    char adminPassword[] = "admin123";  // Replace with a more secure password in real apps
 
-    printf("\n=== Admin Authentication ===\n");
-    printf("Enter Admin Username: ");
-    scanf("%s", username);
-    printf("Enter Admin Password: ");
-    scanf("%s", password);
+// Add a booking to the front of the list, the refNo index, the running totals and the columns
+void linkBooking(Booking *booking) {
+    booking->cancelRequest = NULL;
+    booking->prev = NULL;
+    booking->next = head;
+    if (head) {
+        head->prev = booking;
+    }
+    head = booking;
+    bookingIndexInsert(&bookingIndex, booking);
+    countBooking(&totals, booking, bookingRoute(booking), 1);
+    appendBookingRow(booking);
+    markRecordShard(booking->date, booking->flight);
+}
 
-    // Check if the credentials match
-    if (strcmp(username, adminUsername) == 0 && strcmp(password, adminPassword) == 0) {
-        printf("Authentication successful. Welcome, Admin!\n");
-        adminMenu();  // Grant access to admin menu
+// Detach a booking from the list, the refNo index, the running totals and the columns
+// (caller frees it)
+void unlinkBooking(Booking *booking) {
+    countBooking(&totals, booking, bookingRoute(booking), -1);
+    removeBookingRow(booking);
+    if (booking->prev) {
+        booking->prev->next = booking->next;
     } else {
-        printf("Invalid credentials. Access denied.\n");
+        head = booking->next;
+    }
+    if (booking->next) {
+        booking->next->prev = booking->prev;
+    }
+    booking->next = booking->prev = NULL;
+    bookingIndexRemove(&bookingIndex, booking->refNo);
+    markRecordShard(booking->date, booking->flight);
+}
+
+// Find the seat map of a flight in the inventory
+SeatMap *findSeatMap(const char *flightID) {
+    SeatMap *current = seatMapHead;
+    while (current) {
+        if (strcmp(current->flightID, flightID) == 0) {
+            return current;
+        }
+        current = current->next;
     }
+    return NULL;
 }
 
+// Account for bytes written to the data files
+void countWrite(size_t bytes) {
+    __atomic_fetch_add(&bytesWritten, bytes, __ATOMIC_RELAXED);
+}
 
-// Approve cancel request
-void approveCancelRequest() {
-    char refNo[10];
-    printf("\nEnter booking reference number to approve cancellation: ");
-    scanf("%s", refNo);
+// Account for bytes read from the data files
+void countRead(size_t bytes) {
+    __atomic_fetch_add(&bytesRead, bytes, __ATOMIC_RELAXED);
+}
 
-    Booking *current = head;
-    while (current) {
-        if (strcmp(current->refNo, refNo) == 0) {
-            // Remove the booking from the linked list (or mark as canceled)
-            current->cancelRequested = 0; // Approve cancellation
-            updateCSV();  // Update the main booking file
-            printf("Booking %s cancellation approved.\n", refNo);
+// Histogram bucket of a duration: exact below 16 ns, then 16 buckets per power of two
+static int metricBucket(uint64_t nanos) {
+    if (nanos < METRIC_SUB_BUCKETS) {
+        return (int)nanos;
+    }
+    int shift = 63 - __builtin_clzll(nanos) - 4;
+    int bucket = (shift + 1) * METRIC_SUB_BUCKETS + (int)((nanos >> shift) & (METRIC_SUB_BUCKETS - 1));
+    return bucket < METRIC_BUCKETS ? bucket : METRIC_BUCKETS - 1;
+}
 
-            // Remove the request from the cancellation file
-            removeCancellationRequest(refNo);
+// Largest duration that falls in a bucket
+static uint64_t metricBucketLimit(int bucket) {
+    if (bucket < METRIC_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / METRIC_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(METRIC_SUB_BUCKETS + bucket % METRIC_SUB_BUCKETS) << shift;
+    return low + (1ULL << shift) - 1;
+}
 
+// Record an operation that started at start (from nowNanos) in this thread's shard
+void metricRecord(int op, double start) {
+    static __thread MetricShard *shard;
+    if (!shard) {
+        shard = (MetricShard *)calloc(1, sizeof(MetricShard));
+        if (!shard) {
             return;
         }
-        current = current->next;
+        pthread_mutex_lock(&metricLock);
+        shard->next = metricShards;
+        metricShards = shard;
+        pthread_mutex_unlock(&metricLock);
     }
+    double elapsed = nowNanos() - start;
+    uint64_t nanos = elapsed > 0 ? (uint64_t)elapsed : 0;
+    uint64_t *count = &shard->counts[op][metricBucket(nanos)];
+    // Single writer: relaxed load and store, no read-modify-write on the bus
+    __atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&shard->sumNanos[op], __atomic_load_n(&shard->sumNanos[op], __ATOMIC_RELAXED) + nanos,
+                     __ATOMIC_RELAXED);
+}
 
-    printf("Booking not found.\n");
+// fsync a data file, counting the call and its latency
+int syncFile(int fd) {
+    double start = nowNanos();
+    int result = fsync(fd);
+    __atomic_fetch_add(&fsyncCount, 1, __ATOMIC_RELAXED);
+    metricRecord(METRIC_FSYNC, start);
+    return result;
 }
 
-// Add a new flight
-void addFlight() {
-    Flight *newFlight = (Flight *)malloc(sizeof(Flight));
+// Write every metric in the Prometheus text format
+void writeMetrics(FILE *out) {
+    static const char *names[METRIC_OPS] = {"book", "lookup", "cancel", "approve", "reject", "approve_flight",
+                                            "hold", "pay", "release", "search", "load", "snapshot",
+                                            "export", "fsync", "book_group"};
+    static uint64_t merged[METRIC_BUCKETS];
+    static const double quantiles[] = {0.5, 0.99, 0.999};
 
-    // Input details for the new flight
-    printf("Enter Flight ID: ");
-    scanf("%s", newFlight->flightID);
-    printf("Enter Date (DD/MM/YYYY): ");
-    scanf("%s", newFlight->date);
-    printf("Enter Time (HH:MM): ");
-    scanf("%s", newFlight->time);
-    printf("Enter Source: ");
-    scanf("%s", newFlight->source);
-    printf("Enter Destination: ");
-    scanf("%s", newFlight->destination);
-    printf("Enter Price: ");
-    scanf("%f", &newFlight->price);
+    fprintf(out, "# HELP ars_operation_duration_seconds Latency of store operations.\n");
+    fprintf(out, "# TYPE ars_operation_duration_seconds summary\n");
+    pthread_mutex_lock(&metricLock);
+    for (int op = 0; op < METRIC_OPS; op++) {
+        uint64_t total = 0, sumNanos = 0;
+        memset(merged, 0, sizeof(merged));
+        for (MetricShard *shard = metricShards; shard; shard = shard->next) {
+            for (int b = 0; b < METRIC_BUCKETS; b++) {
+                uint64_t count = __atomic_load_n(&shard->counts[op][b], __ATOMIC_RELAXED);
+                merged[b] += count;
+                total += count;
+            }
+            sumNanos += __atomic_load_n(&shard->sumNanos[op], __ATOMIC_RELAXED);
+        }
+        for (int q = 0; q < 3; q++) {
+            uint64_t rank = (uint64_t)(quantiles[q] * total + 0.5), seen = 0;
+            int b = 0;
+            while (total > 0 && b < METRIC_BUCKETS - 1 && (seen += merged[b]) < (rank ? rank : 1)) {
+                b++;
+            }
+            fprintf(out, "ars_operation_duration_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n", names[op],
+                    quantiles[q], total ? metricBucketLimit(b) / 1e9 : 0.0);
+        }
+        fprintf(out, "ars_operation_duration_seconds_sum{op=\"%s\"} %.9f\n", names[op], sumNanos / 1e9);
+        fprintf(out, "ars_operation_duration_seconds_count{op=\"%s\"} %llu\n", names[op], (unsigned long long)total);
+    }
+    pthread_mutex_unlock(&metricLock);
+
+    fprintf(out, "# HELP ars_written_bytes_total Bytes written to data files.\n");
+    fprintf(out, "# TYPE ars_written_bytes_total counter\n");
+    fprintf(out, "ars_written_bytes_total %llu\n", (unsigned long long)__atomic_load_n(&bytesWritten, __ATOMIC_RELAXED));
+    fprintf(out, "# HELP ars_read_bytes_total Bytes read from data files.\n");
+    fprintf(out, "# TYPE ars_read_bytes_total counter\n");
+    fprintf(out, "ars_read_bytes_total %llu\n", (unsigned long long)__atomic_load_n(&bytesRead, __ATOMIC_RELAXED));
+    fprintf(out, "# HELP ars_fsyncs_total fsync calls on data files.\n");
+    fprintf(out, "# TYPE ars_fsyncs_total counter\n");
+    fprintf(out, "ars_fsyncs_total %llu\n", (unsigned long long)__atomic_load_n(&fsyncCount, __ATOMIC_RELAXED));
+    HoldCounts holdCounts = storeHoldCounts();
+    fprintf(out, "# HELP ars_seat_holds Seat holds waiting for payment.\n");
+    fprintf(out, "# TYPE ars_seat_holds gauge\n");
+    fprintf(out, "ars_seat_holds %ld\n", holdCounts.active);
+    fprintf(out, "# HELP ars_seat_holds_total Seat holds by outcome.\n");
+    fprintf(out, "# TYPE ars_seat_holds_total counter\n");
+    fprintf(out, "ars_seat_holds_total{outcome=\"created\"} %ld\n", holdCounts.created);
+    fprintf(out, "ars_seat_holds_total{outcome=\"paid\"} %ld\n", holdCounts.committed);
+    fprintf(out, "ars_seat_holds_total{outcome=\"released\"} %ld\n", holdCounts.released);
+    fprintf(out, "ars_seat_holds_total{outcome=\"expired\"} %ld\n", holdCounts.expired);
+    fprintf(out, "# HELP ars_connections Open client connections of the server.\n");
+    fprintf(out, "# TYPE ars_connections gauge\n");
+    fprintf(out, "ars_connections %ld\n", __atomic_load_n(&serverConnections, __ATOMIC_RELAXED));
+    RemovalCounts removed = storeRemovalCounts();
+    fprintf(out, "# HELP ars_removal_refunds_pending Bookings of removed flights awaiting refund.\n");
+    fprintf(out, "# TYPE ars_removal_refunds_pending gauge\n");
+    fprintf(out, "ars_removal_refunds_pending %ld\n", removed.pending);
+    fprintf(out, "# HELP ars_removal_refunds_total Bookings of removed flights refunded.\n");
+    fprintf(out, "# TYPE ars_removal_refunds_total counter\n");
+    fprintf(out, "ars_removal_refunds_total %ld\n", removed.refunded);
+    pthread_rwlock_rdlock(&storeLock);
+    fprintf(out, "# HELP ars_bookings Bookings in the store.\n");
+    fprintf(out, "# TYPE ars_bookings gauge\n");
+    fprintf(out, "ars_bookings %ld\n", totals.bookings);
+    fprintf(out, "# HELP ars_revenue_rupees Revenue of the bookings in the store.\n");
+    fprintf(out, "# TYPE ars_revenue_rupees gauge\n");
+    fprintf(out, "ars_revenue_rupees %.2f\n", totals.revenue / 100.0);
+    pthread_rwlock_unlock(&storeLock);
+}
 
-    // Create a unique seat file for the flight
-    char seatFileName[50];
-    sprintf(seatFileName, "%s_seats.csv", newFlight->flightID);
+// Write the metrics to METRICS_FILE (or ARS_METRICS_FILE) through a temp file, so a
+// scraper never reads half a dump. Returns the path, or NULL on failure.
+const char *dumpMetrics() {
+    static char path[4096], tempPath[4200];
+    const char *env = getenv("ARS_METRICS_FILE");
+    snprintf(path, sizeof(path), "%s", env && env[0] ? env : METRICS_FILE);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    pthread_mutex_lock(&metricDumpLock);
+    FILE *file = fopen(tempPath, "w");
+    int ok = file != NULL;
+    if (file) {
+        writeMetrics(file);
+        ok = fclose(file) == 0 && rename(tempPath, path) == 0;
+    }
+    pthread_mutex_unlock(&metricDumpLock);
+    return ok ? path : NULL;
+}
 
-    FILE *seatFile = fopen(seatFileName, "w");
-    if (!seatFile) {
-        printf("Error creating seat file for flight.\n");
-        free(newFlight);
+// Seat map whose words a claim on this thread is changing, and the words changed so far;
+// they are written together once the journal has the booking
+static __thread SeatMap *pendingSeatMap = NULL;
+static __thread int pendingFrom, pendingTo;
+static __thread SeatClaim *unwrittenClaim = NULL;  // Journaled by this thread, not written yet
+
+// Persist bitmap words [from, to) in place with one write
+static void writeSeatWords(SeatMap *map, int from, int to) {
+    if (!seatInventory || from >= to) {
+        return;
+    }
+    if (seatWritesDeferred) {
+        map->dirty = 1;
+        return;
+    }
+    if (map == pendingSeatMap) {
+        pendingFrom = from < pendingFrom ? from : pendingFrom;
+        pendingTo = to > pendingTo ? to : pendingTo;
         return;
     }
+    uint64_t local[64];
+    uint64_t *values = to - from <= 64 ? local : (uint64_t *)malloc((size_t)(to - from) * sizeof(uint64_t));
+    if (!values) {
+        printf("Error allocating seat map.\n");
+        exit(1);
+    }
+    // Write the latest values under the flight's lock so racing writers cannot leave a stale word
+    pthread_mutex_lock(&map->writeLock);
+    for (int word = from; word < to; word++) {
+        values[word - from] = __atomic_load_n(&map->bits[word], __ATOMIC_ACQUIRE) & ~map->held[word];
+    }
+    size_t bytes = (size_t)(to - from) * sizeof(uint64_t);
+    countWrite(bytes);
+    if (pwrite(fileno(seatInventory), values, bytes, map->fileOffset + (long)from * sizeof(uint64_t)) !=
+        (ssize_t)bytes) {
+        printf("Error writing seat inventory.\n");
+    }
+    pthread_mutex_unlock(&map->writeLock);
+    if (values != local) {
+        free(values);
+    }
+}
+
+// Persist one bitmap word in place, so a claim or release costs a single 8-byte write
+static void writeSeatWord(SeatMap *map, int word) {
+    writeSeatWords(map, word, word + 1);
+}
 
-    // Initialize the seat file with 200 seats marked as "Available"
-    fprintf(seatFile, "SeatNumber,Status\n"); // Header row
-    for (int i = 1; i <= 200; i++) {
-        fprintf(seatFile, "%d,Available\n", i);
+// Write a flight's whole bitmap back to the inventory file in one call
+void flushSeatMap(SeatMap *map) {
+    map->dirty = 0;
+    if (!seatInventory) {
+        return;
     }
-    fclose(seatFile);
+    pthread_mutex_lock(&map->writeLock);
+    uint64_t *words = map->bits;
+    if (map->seatsHeld > 0) {
+        words = (uint64_t *)malloc(map->wordCount * sizeof(uint64_t));
+        if (!words) {
+            printf("Error allocating seat map.\n");
+            exit(1);
+        }
+        for (int i = 0; i < map->wordCount; i++) {
+            words[i] = map->bits[i] & ~map->held[i];
+        }
+    }
+    countWrite(map->wordCount * sizeof(uint64_t));
+    if (pwrite(fileno(seatInventory), words, map->wordCount * sizeof(uint64_t),
+               map->fileOffset) != (ssize_t)(map->wordCount * sizeof(uint64_t))) {
+        printf("Error writing seat inventory.\n");
+    }
+    if (words != map->bits) {
+        free(words);
+    }
+    pthread_mutex_unlock(&map->writeLock);
+}
 
-    // Add the flight to the linked list
-    newFlight->next = flightHead;
-    flightHead = newFlight;
+// Write every seat map whose writes were deferred
+void flushDirtySeatMaps() {
+    for (SeatMap *map = seatMapHead; map; map = map->next) {
+        if (map->dirty) {
+            flushSeatMap(map);
+        }
+    }
+}
 
-    // Save the flight to the flights file
-    saveFlightsToFile();
+// Layout of an aircraft known only by its seat count: one economy cabin, six abreast
+void defaultSeatLayout(SeatLayout *layout, int seatCount) {
+    memset(layout, 0, sizeof(*layout));
+    layout->cabinCount = 1;
+    layout->cabins[0].code = 'E';
+    layout->cabins[0].rowSeats = DEFAULT_ROW_SEATS;
+    layout->cabins[0].seats = seatCount > 0 ? (uint32_t)seatCount : 0;
+    layout->cabins[0].priceFactor = 1.0f;
+}
 
-    printf("Flight '%s' added successfully with 200 seats initialized as available.\n", newFlight->flightID);
+// Fare factor of a cabin class when the layout does not give one
+static float defaultPriceFactor(char code) {
+    return code == 'F' ? 3.0f : code == 'B' ? 1.8f : 1.0f;
 }
 
+static const char *cabinName(char code) {
+    return code == 'F' ? "First" : code == 'B' ? "Business" : "Economy";
+}
 
-// Function to remove a flight
-void removeFlight() {
-    char flightID[10];
-    printf("Enter the flight ID to remove: ");
-    scanf("%s", flightID);
+// Parse a seat layout: a plain seat count ("180") or cabins front to back as
+// <class><seats>x<abreast>[@<fare factor>] joined by '+', e.g. "F8x4@3+B24x4+E144x6".
+// Classes are F, B and E, each at most once. Returns 0 if the text is not a layout.
+int parseSeatLayout(const char *text, SeatLayout *layout) {
+    char *end;
+    long seats = strtol(text, &end, 10);
+    if (end != text && *end == '\0') {
+        defaultSeatLayout(layout, (int)seats);
+        return seats > 0 && seats <= MAX_LAYOUT_SEATS;
+    }
 
-    Flight *current = flightHead, *prev = NULL;
-    while (current) {
-        if (strcmp(current->flightID, flightID) == 0) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                flightHead = current->next;
+    memset(layout, 0, sizeof(*layout));
+    long total = 0;
+    const char *p = text;
+    while (*p) {
+        char code = (char)toupper((unsigned char)*p);
+        if ((code != 'F' && code != 'B' && code != 'E') || layout->cabinCount == CABIN_MAX_CLASSES) {
+            return 0;
+        }
+        for (uint32_t c = 0; c < layout->cabinCount; c++) {
+            if (layout->cabins[c].code == code) {
+                return 0;
             }
-            free(current);
-            saveFlightsToFile();
-            printf("Flight removed successfully.\n");
-            return;
         }
-        prev = current;
-        current = current->next;
+        seats = strtol(p + 1, &end, 10);
+        if (seats <= 0 || *end != 'x') {
+            return 0;
+        }
+        long abreast = strtol(end + 1, &end, 10);
+        if (abreast <= 0 || abreast > CABIN_MAX_ROW_SEATS) {
+            return 0;
+        }
+        CabinSpec *cabin = &layout->cabins[layout->cabinCount++];
+        cabin->code = code;
+        cabin->seats = (uint32_t)seats;
+        cabin->rowSeats = (uint8_t)abreast;
+        cabin->priceFactor = defaultPriceFactor(code);
+        if (*end == '@') {
+            double factor = strtod(end + 1, &end);
+            if (!(factor > 0)) {
+                return 0;
+            }
+            cabin->priceFactor = (float)factor;
+        }
+        if (*end == '+' && end[1]) {
+            end++;
+        } else if (*end) {
+            return 0;
+        }
+        total += seats;
+        p = end;
     }
+    return layout->cabinCount > 0 && total <= MAX_LAYOUT_SEATS;
+}
 
-    printf("Flight not found.\n");
+// Text form of a layout, as parseSeatLayout reads it back
+void formatSeatLayout(const SeatLayout *layout, char *text, size_t size) {
+    size_t used = 0;
+    text[0] = '\0';
+    for (uint32_t c = 0; c < layout->cabinCount && used < size; c++) {
+        const CabinSpec *cabin = &layout->cabins[c];
+        used += snprintf(text + used, size - used, "%s%c%ux%u@%g", c ? "+" : "", cabin->code,
+                         cabin->seats, cabin->rowSeats, cabin->priceFactor);
+    }
 }
 
-// Function to view total payments
-void viewTotalPayments() {
-    float totalPayments = 0;
-    Booking *current = head;
-    while (current) {
-        totalPayments += current->payment;
-        current = current->next;
+// Whether a layout read from the inventory describes exactly seatCount seats
+static int validSeatLayout(const SeatLayout *layout, uint32_t seatCount) {
+    if (layout->cabinCount == 0 || layout->cabinCount > CABIN_MAX_CLASSES) {
+        return 0;
     }
+    uint32_t total = 0;
+    for (uint32_t c = 0; c < layout->cabinCount; c++) {
+        if (layout->cabins[c].rowSeats == 0 || layout->cabins[c].rowSeats > CABIN_MAX_ROW_SEATS) {
+            return 0;
+        }
+        total += layout->cabins[c].seats;
+    }
+    return total == seatCount;
+}
 
-    printf("Total payments: %.2f\n", totalPayments);
+// Index of the cabin of a class, -1 if the aircraft has none
+int findCabin(const SeatMap *map, char code) {
+    code = (char)toupper((unsigned char)code);
+    for (uint32_t c = 0; c < map->layout.cabinCount; c++) {
+        if (map->layout.cabins[c].code == code) {
+            return (int)c;
+        }
+    }
+    return -1;
 }
 
-// Main function to show menu
-int main() {
-    loadDataFromCSV();
-    createCSVIfNotExists();  // Initialize the booking CSV file if not exist
-    loadFlightsFromFile();  // Load available flights from file
+// Cabin holding a seat, -1 if the seat is not on the aircraft
+static int seatCabin(const SeatMap *map, int seatNumber) {
+    for (uint32_t c = 0; c < map->layout.cabinCount; c++) {
+        int first = map->cabins[c].firstSeat;
+        if (seatNumber >= first && seatNumber < first + (int)map->layout.cabins[c].seats) {
+            return (int)c;
+        }
+    }
+    return -1;
+}
+
+// Fare of a seat: the flight's price times the factor of the seat's cabin
+float seatFare(const SeatMap *map, float price, int seatNumber) {
+    int cabin = map ? seatCabin(map, seatNumber) : -1;
+    return cabin >= 0 ? price * map->layout.cabins[cabin].priceFactor : price;
+}
+
+// Free seats of one row as a mask, bit i for the row's seat i from the left.
+// Held seats are set in the bitmap, so they count as taken.
+static uint32_t rowFreeMask(const SeatMap *map, int cabin, int row) {
+    const CabinSpec *spec = &map->layout.cabins[cabin];
+    int first = map->cabins[cabin].firstSeat - 1 + row * spec->rowSeats;
+    int end = map->cabins[cabin].firstSeat - 1 + (int)spec->seats;
+    int width = end - first < spec->rowSeats ? end - first : spec->rowSeats;
+    int shift = first % 64;
+    uint64_t taken = __atomic_load_n(&map->bits[first / 64], __ATOMIC_ACQUIRE) >> shift;
+    if (shift + width > 64) {
+        taken |= __atomic_load_n(&map->bits[first / 64 + 1], __ATOMIC_ACQUIRE) << (64 - shift);
+    }
+    return (uint32_t)(~taken & ((1ULL << width) - 1));
+}
+
+// Length of the longest run of set bits: each step shortens every run by one
+static int longestRun(uint32_t mask) {
+    int length = 0;
+    while (mask) {
+        mask &= mask >> 1;
+        length++;
+    }
+    return length;
+}
+
+// Recompute one row's entries in its cabin's index. Caller holds allocLock.
+static void refreshRow(SeatMap *map, int cabin, int row) {
+    Cabin *index = &map->cabins[cabin];
+    uint32_t mask = rowFreeMask(map, cabin, row);
+    int freeSeats = __builtin_popcount(mask);
+    index->freeSeats += freeSeats - index->rowFree[row];
+    index->rowFree[row] = (uint8_t)freeSeats;
+    __atomic_fetch_add(&map->version, 1, __ATOMIC_RELEASE);
+    int longest = longestRun(mask);
+    uint64_t bit = 1ULL << (row % 64);
+    for (int k = 1; k <= map->layout.cabins[cabin].rowSeats; k++) {
+        uint64_t *word = &index->runs[(size_t)(k - 1) * index->runWords + row / 64];
+        *word = k <= longest ? *word | bit : *word & ~bit;
+    }
+}
+
+// Bring the index up to date after a seat's bit was set or cleared
+static void seatChanged(SeatMap *map, int seatNumber) {
+    int cabin = seatCabin(map, seatNumber);
+    if (cabin >= 0) {
+        pthread_mutex_lock(&map->allocLock);
+        refreshRow(map, cabin, (seatNumber - map->cabins[cabin].firstSeat) / map->layout.cabins[cabin].rowSeats);
+        pthread_mutex_unlock(&map->allocLock);
+    }
+}
+
+// (Re)build every cabin's index from the bitmap
+static void buildCabins(SeatMap *map) {
+    pthread_mutex_lock(&map->allocLock);
+    int seat = 1;
+    for (uint32_t c = 0; c < map->layout.cabinCount; c++) {
+        const CabinSpec *spec = &map->layout.cabins[c];
+        Cabin *index = &map->cabins[c];
+        free(index->rowFree);
+        free(index->runs);
+        index->firstSeat = seat;
+        index->rows = (int)((spec->seats + spec->rowSeats - 1) / spec->rowSeats);
+        index->runWords = (index->rows + 63) / 64;
+        index->freeSeats = 0;
+        index->rowFree = (uint8_t *)calloc(index->rows + 1, 1);
+        index->runs = (uint64_t *)calloc((size_t)spec->rowSeats * index->runWords + 1, sizeof(uint64_t));
+        if (!index->rowFree || !index->runs) {
+            printf("Error allocating seat map.\n");
+            exit(1);
+        }
+        for (int row = 0; row < index->rows; row++) {
+            refreshRow(map, (int)c, row);
+        }
+        seat += (int)spec->seats;
+    }
+    pthread_mutex_unlock(&map->allocLock);
+}
+
+static SeatMap *newSeatMap(const char *flightID, const SeatLayout *layout) {
+    SeatMap *map = (SeatMap *)calloc(1, sizeof(SeatMap));
+    if (!map) {
+        printf("Error allocating seat map.\n");
+        exit(1);
+    }
+    strncpy(map->flightID, flightID, sizeof(map->flightID) - 1);
+    map->layout = *layout;
+    for (uint32_t c = 0; c < layout->cabinCount; c++) {
+        map->seatCount += (int)layout->cabins[c].seats;
+    }
+    map->wordCount = (map->seatCount + 63) / 64;
+    map->bits = (uint64_t *)calloc(map->wordCount ? map->wordCount : 1, sizeof(uint64_t));
+    map->held = (uint64_t *)calloc(map->wordCount ? map->wordCount : 1, sizeof(uint64_t));
+    if (!map->bits || !map->held) {
+        printf("Error allocating seat map.\n");
+        exit(1);
+    }
+    pthread_mutex_init(&map->writeLock, NULL);
+    pthread_mutex_init(&map->allocLock, NULL);
+    buildCabins(map);
+    map->serial = __atomic_add_fetch(&seatMapSerial, 1, __ATOMIC_RELAXED);
+    map->next = seatMapHead;
+    seatMapHead = map;
+    return map;
+}
+
+static void appendSeatMap(SeatMap *map);
+
+// Write every live seat map to a fresh inventory file and switch over to it
+static void rewriteSeatInventory() {
+    FILE *file = fopen(SEAT_INVENTORY_FILE ".tmp", "w+b");
+    if (!file) {
+        printf("Error writing %s.\n", SEAT_INVENTORY_FILE);
+        exit(1);
+    }
+    char header[16] = SEAT_INVENTORY_MAGIC;
+    fwrite(header, sizeof(header), 1, file);
+    fclose(seatInventory);
+    seatInventory = file;
+    for (SeatMap *map = seatMapHead; map; map = map->next) {
+        appendSeatMap(map);
+        if (map->seatsHeld > 0) {
+            flushSeatMap(map);  // Held seats went out with the rest; they must never be written
+        }
+    }
+    seatInventory = NULL;
+    seatInventoryDead = 0;
+    if (!commitFile(file, SEAT_INVENTORY_FILE ".tmp", SEAT_INVENTORY_FILE)) {
+        exit(1);
+    }
+    seatInventory = fopen(SEAT_INVENTORY_FILE, "r+b");
+    if (!seatInventory) {
+        printf("Error opening seat inventory file.\n");
+        exit(1);
+    }
+}
+
+// Open the binary inventory file and load every live seat map from it. A version 1
+// file gives each flight one economy cabin and is rewritten in the current format.
+void loadSeatInventory() {
+    seatInventory = fopen(SEAT_INVENTORY_FILE, "r+b");
+    if (!seatInventory) {
+        seatInventory = fopen(SEAT_INVENTORY_FILE, "w+b");
+        if (!seatInventory) {
+            printf("Error creating seat inventory file.\n");
+            exit(1);
+        }
+        char header[16] = SEAT_INVENTORY_MAGIC;
+        fwrite(header, sizeof(header), 1, seatInventory);
+        fflush(seatInventory);
+        return;
+    }
+
+    char header[16];
+    if (fread(header, sizeof(header), 1, seatInventory) != 1 ||
+        (memcmp(header, SEAT_INVENTORY_MAGIC, sizeof(SEAT_INVENTORY_MAGIC)) != 0 &&
+         memcmp(header, SEAT_INVENTORY_MAGIC_V1, sizeof(SEAT_INVENTORY_MAGIC_V1)) != 0)) {
+        printf("Seat inventory file is not recognised.\n");
+        exit(1);
+    }
+    int upgrade = memcmp(header, SEAT_INVENTORY_MAGIC_V1, sizeof(SEAT_INVENTORY_MAGIC_V1)) == 0;
+
+    // A version 1 entry is the start of the current one
+    SeatInventoryEntry entry;
+    size_t entrySize = upgrade ? sizeof(SeatInventoryEntryV1) : sizeof(SeatInventoryEntry);
+    int flights = 0;
+    memset(&entry, 0, sizeof(entry));
+    while (fread(&entry, entrySize, 1, seatInventory) == 1) {
+        long offset = ftell(seatInventory);
+        if (entry.flightID[0] == '\0') {
+            // Entry of a removed flight, skip its words
+            fseek(seatInventory, (long)entry.wordCount * sizeof(uint64_t), SEEK_CUR);
+            seatInventoryDead += entrySize + entry.wordCount * sizeof(uint64_t);
+            continue;
+        }
+        entry.flightID[sizeof(entry.flightID) - 1] = '\0';
+        if (upgrade || !validSeatLayout(&entry.layout, entry.seatCount)) {
+            defaultSeatLayout(&entry.layout, (int)entry.seatCount);
+        }
+        SeatMap *map = newSeatMap(entry.flightID, &entry.layout);
+        if (fread(map->bits, sizeof(uint64_t), map->wordCount, seatInventory) != (size_t)map->wordCount) {
+            printf("Seat inventory for flight %s is truncated.\n", entry.flightID);
+            break;
+        }
+        for (int i = 0; i < map->wordCount; i++) {
+            map->seatsBooked += __builtin_popcountll(map->bits[i]);
+        }
+        buildCabins(map);
+        map->fileOffset = offset;
+        flights++;
+    }
+
+    if (upgrade) {
+        rewriteSeatInventory();
+        printf("Upgraded the seat inventory of %d flights to cabin layouts.\n", flights);
+    }
+}
+
+// Append a seat map to the end of the inventory file
+static void appendSeatMap(SeatMap *map) {
+    if (!seatInventory) {
+        return;
+    }
+    SeatInventoryEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.flightID, map->flightID);
+    entry.seatCount = map->seatCount;
+    entry.wordCount = map->wordCount;
+    entry.layout = map->layout;
+
+    fseek(seatInventory, 0, SEEK_END);
+    fwrite(&entry, sizeof(entry), 1, seatInventory);
+    map->fileOffset = ftell(seatInventory);
+    fwrite(map->bits, sizeof(uint64_t), map->wordCount, seatInventory);
+    fflush(seatInventory);
+    countWrite(sizeof(entry) + map->wordCount * sizeof(uint64_t));
+}
+
+// Add a seat map with every seat available
+SeatMap *createSeatMap(const char *flightID, const SeatLayout *layout) {
+    SeatMap *map = newSeatMap(flightID, layout);
+    appendSeatMap(map);
+    return map;
+}
+
+// Free a seat map once no reader can still hold it
+static void freeSeatMap(void *item) {
+    SeatMap *map = (SeatMap *)item;
+    for (uint32_t c = 0; c < map->layout.cabinCount; c++) {
+        free(map->cabins[c].rowFree);
+        free(map->cabins[c].runs);
+    }
+    pthread_mutex_destroy(&map->writeLock);
+    pthread_mutex_destroy(&map->allocLock);
+    free(map->availability.text);
+    free(map->bits);
+    free(map->held);
+    free(map);
+}
+
+// Mark a flight's inventory entry as removed and free its seat map
+void dropSeatMap(const char *flightID) {
+    SeatMap *current = seatMapHead, *prev = NULL;
+    while (current && strcmp(current->flightID, flightID) != 0) {
+        prev = current;
+        current = current->next;
+    }
+    if (!current) {
+        return;
+    }
+    if (seatInventory) {
+        char cleared[16] = {0};
+        fseek(seatInventory, current->fileOffset - (long)sizeof(SeatInventoryEntry), SEEK_SET);
+        fwrite(cleared, sizeof(cleared), 1, seatInventory);
+        fflush(seatInventory);
+        seatInventoryDead += sizeof(SeatInventoryEntry) + current->wordCount * sizeof(uint64_t);
+    }
+    if (prev) {
+        prev->next = current->next;
+    } else {
+        seatMapHead = current->next;
+    }
+    epochRetire(current, freeSeatMap);  // The flight snapshot may still point at it
+}
+
+int isSeatBooked(SeatMap *map, int seatNumber) {
+    int bit = seatNumber - 1;
+    return (__atomic_load_n(&map->bits[bit / 64], __ATOMIC_ACQUIRE) >> (bit % 64)) & 1;
+}
+
+// Set a seat's bit with compare-and-swap, so two threads can never claim the same seat.
+// Returns 0 if the seat is invalid or already booked. Leaves the index to the caller.
+static int setSeatBit(SeatMap *map, int seatNumber) {
+    if (seatNumber <= 0 || seatNumber > map->seatCount) {
+        return 0;
+    }
+    int bit = seatNumber - 1;
+    uint64_t mask = 1ULL << (bit % 64);
+    uint64_t *word = &map->bits[bit / 64];
+    uint64_t old = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    do {
+        if (old & mask) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(word, &old, old | mask, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_fetch_add(&map->seatsBooked, 1, __ATOMIC_RELAXED);
+    writeSeatWord(map, bit / 64);
+    return 1;
+}
+
+static void clearSeatBit(SeatMap *map, int seatNumber) {
+    int bit = seatNumber - 1;
+    uint64_t mask = 1ULL << (bit % 64);
+    if (__atomic_fetch_and(&map->bits[bit / 64], ~mask, __ATOMIC_ACQ_REL) & mask) {
+        __atomic_fetch_sub(&map->seatsBooked, 1, __ATOMIC_RELAXED);
+    }
+    writeSeatWord(map, bit / 64);
+}
+
+// Claim a seat, returns 1 on success and 0 if it is invalid or already booked
+int claimSeat(SeatMap *map, int seatNumber) {
+    if (!setSeatBit(map, seatNumber)) {
+        return 0;
+    }
+    seatChanged(map, seatNumber);
+    return 1;
+}
+
+// Make a booked seat available again; SEAT_OVERBOOKED gives back an overbooked ticket
+void releaseSeat(SeatMap *map, int seatNumber) {
+    if (seatNumber == SEAT_OVERBOOKED && __atomic_load_n(&map->overbooked, __ATOMIC_RELAXED) > 0) {
+        __atomic_fetch_sub(&map->overbooked, 1, __ATOMIC_RELAXED);
+    }
+    if (seatNumber <= 0 || seatNumber > map->seatCount) {
+        return;
+    }
+    clearSeatBit(map, seatNumber);
+    seatChanged(map, seatNumber);
+}
+
+int seatsRemaining(SeatMap *map) {
+    return map->seatCount - __atomic_load_n(&map->seatsBooked, __ATOMIC_RELAXED);
+}
+
+// First row of a cabin with k adjacent free seats, -1 if none. Caller holds allocLock.
+static int firstRowWithRun(const SeatMap *map, int cabin, int k) {
+    const Cabin *index = &map->cabins[cabin];
+    const uint64_t *runs = &index->runs[(size_t)(k - 1) * index->runWords];
+    for (int w = 0; w < index->runWords; w++) {
+        if (runs[w]) {
+            return w * 64 + __builtin_ctzll(runs[w]);
+        }
+    }
+    return -1;
+}
+
+// Claim the leftmost k adjacent free seats of a row. Returns the first seat, or 0 if a
+// direct claim took the row's last such run meanwhile. Caller holds allocLock.
+static int claimRun(SeatMap *map, int cabin, int row, int k) {
+    int rowStart = map->cabins[cabin].firstSeat + row * map->layout.cabins[cabin].rowSeats;
+    for (;;) {
+        uint32_t mask = rowFreeMask(map, cabin, row);
+        uint32_t starts = mask;
+        for (int i = 1; i < k; i++) {
+            starts &= mask >> i;
+        }
+        if (!starts) {
+            refreshRow(map, cabin, row);
+            return 0;
+        }
+        int first = rowStart + __builtin_ctz(starts);
+        int claimed = 0;
+        while (claimed < k && setSeatBit(map, first + claimed)) {
+            claimed++;
+        }
+        if (claimed == k) {
+            refreshRow(map, cabin, row);
+            return first;
+        }
+        while (claimed > 0) {
+            clearSeatBit(map, first + --claimed);
+        }
+    }
+}
+
+static int rowHasRun(const uint64_t *runs, int row) {
+    return (runs[row / 64] >> (row % 64)) & 1;
+}
+
+// First of rows consecutive whole free rows of a cabin, -1 if none. With rest set, the row
+// just in front of or behind them must also have rest adjacent free seats; it goes in
+// *restRow. Caller holds allocLock.
+static int findRowBlock(const SeatMap *map, int cabin, int rows, int rest, int *restRow) {
+    const Cabin *index = &map->cabins[cabin];
+    int rowSeats = map->layout.cabins[cabin].rowSeats;
+    const uint64_t *whole = &index->runs[(size_t)(rowSeats - 1) * index->runWords];
+    const uint64_t *part = &index->runs[(size_t)(rest > 0 ? rest - 1 : 0) * index->runWords];
+    int streak = 0;
+    for (int row = 0; row < index->rows; row++) {
+        if (row % 64 == 0 && !whole[row / 64]) {
+            streak = 0;
+            row += 63;
+            continue;
+        }
+        if (!rowHasRun(whole, row)) {
+            streak = 0;
+            continue;
+        }
+        if (++streak < rows) {
+            continue;
+        }
+        int start = row - rows + 1;
+        if (rest == 0) {
+            return start;
+        }
+        if (start > 0 && rowHasRun(part, start - 1)) {
+            *restRow = start - 1;
+            return start;
+        }
+        if (row + 1 < index->rows && rowHasRun(part, row + 1)) {
+            *restRow = row + 1;
+            return start;
+        }
+    }
+    return -1;
+}
+
+// Give back seats claimed by this allocation. Caller holds allocLock.
+static void returnSeats(SeatMap *map, int cabin, const int *seats, int count) {
+    int rowSeats = map->layout.cabins[cabin].rowSeats;
+    while (count > 0) {
+        int seat = seats[--count];
+        clearSeatBit(map, seat);
+        refreshRow(map, cabin, (seat - map->cabins[cabin].firstSeat) / rowSeats);
+    }
+}
+
+// Claim a party too big for one row as consecutive whole free rows plus the leftmost run
+// of the rest in the row next to them. Returns count, or 0 with nothing claimed. Caller
+// holds allocLock.
+static int claimRowBlock(SeatMap *map, int cabin, int count, int *seats) {
+    int rowSeats = map->layout.cabins[cabin].rowSeats;
+    int rows = count / rowSeats, rest = count % rowSeats;
+    int start, restRow = -1;
+    while ((start = findRowBlock(map, cabin, rows, rest, &restRow)) >= 0) {
+        // Row by row in seat order; a direct claim may take a seat meanwhile, and then
+        // the rows are given back and the refreshed index searched again
+        int claimed = 0, first = 1;
+        for (int row = rest && restRow < start ? restRow : start; first && claimed < count; row++) {
+            int k = row == restRow ? rest : rowSeats;
+            if ((first = claimRun(map, cabin, row, k))) {
+                for (int i = 0; i < k; i++) {
+                    seats[claimed++] = first + i;
+                }
+            }
+        }
+        if (claimed == count) {
+            return count;
+        }
+        returnSeats(map, cabin, seats, claimed);
+    }
+    return 0;
+}
+
+// Claim count seats in a cabin, all or nothing. A party that fits a row gets the
+// leftmost run of the front-most row with room; otherwise it takes the largest runs
+// left, front first. With adjacent set it never splits further: a larger party takes
+// consecutive whole free rows and a run for the rest in the row in front of or behind
+// them, or nothing. Each step reads a few words of the index, however full the cabin.
+// Returns 1 with the seats in seats[], 0 with nothing claimed.
+int allocateSeats(SeatMap *map, int cabin, int count, int adjacent, int *seats) {
+    if (cabin < 0 || cabin >= (int)map->layout.cabinCount || count <= 0) {
+        return 0;
+    }
+    int rowSeats = map->layout.cabins[cabin].rowSeats;
+    int claimed = 0;
+    pthread_mutex_lock(&map->allocLock);
+    int room = count <= map->cabins[cabin].freeSeats;
+    if (room && adjacent && count > rowSeats) {
+        claimed = claimRowBlock(map, cabin, count, seats);
+    } else if (room) {
+        while (claimed < count) {
+            int k = count - claimed < rowSeats ? count - claimed : rowSeats;
+            int first = 0;
+            while (k > 0) {
+                int row = firstRowWithRun(map, cabin, k);
+                if (row < 0) {
+                    k = adjacent ? 0 : k - 1;
+                } else if ((first = claimRun(map, cabin, row, k))) {
+                    break;
+                }
+            }
+            if (!first) {
+                break;
+            }
+            for (int i = 0; i < k; i++) {
+                seats[claimed++] = first + i;
+            }
+        }
+    }
+    if (claimed < count) {
+        // Too few seats after all: give back what was taken
+        returnSeats(map, cabin, seats, claimed);
+        claimed = 0;
+    }
+    pthread_mutex_unlock(&map->allocLock);
+    return claimed == count;
+}
+
+// Best free seat of a cabin without claiming it, 0 if the cabin is full
+int bestSeat(SeatMap *map, int cabin) {
+    if (cabin < 0 || cabin >= (int)map->layout.cabinCount) {
+        return 0;
+    }
+    pthread_mutex_lock(&map->allocLock);
+    int seat = 0;
+    int row = firstRowWithRun(map, cabin, 1);
+    uint32_t mask = row >= 0 ? rowFreeMask(map, cabin, row) : 0;
+    if (mask) {
+        seat = map->cabins[cabin].firstSeat + row * map->layout.cabins[cabin].rowSeats + __builtin_ctz(mask);
+    }
+    pthread_mutex_unlock(&map->allocLock);
+    return seat;
+}
+
+// Sell a ticket without a seat while the flight's overbooking allowance lasts
+int claimOverbooked(SeatMap *map) {
+    int count = __atomic_load_n(&map->overbooked, __ATOMIC_RELAXED);
+    do {
+        if (count >= (int)map->layout.overbookLimit) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&map->overbooked, &count, count + 1, 1, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+    return 1;
+}
+
+// Recount each cabin's free seats and runs from the bitmap; returns the cabins that differ
+int checkSeatIndex(SeatMap *map) {
+    int mismatches = 0;
+    pthread_mutex_lock(&map->allocLock);
+    for (uint32_t c = 0; c < map->layout.cabinCount; c++) {
+        const Cabin *index = &map->cabins[c];
+        int rowSeats = map->layout.cabins[c].rowSeats;
+        int freeSeats = 0, stale = 0;
+        for (int row = 0; row < index->rows; row++) {
+            uint32_t mask = rowFreeMask(map, (int)c, row);
+            int longest = longestRun(mask);
+            freeSeats += __builtin_popcount(mask);
+            for (int k = 1; k <= rowSeats; k++) {
+                int indexed = (index->runs[(size_t)(k - 1) * index->runWords + row / 64] >> (row % 64)) & 1;
+                stale += indexed != (k <= longest);
+            }
+        }
+        if (freeSeats != index->freeSeats || stale) {
+            printf("Mismatch in cabin %c of flight %s: %d free, %d stale runs; bitmap has %d free\n",
+                   map->layout.cabins[c].code, map->flightID, index->freeSeats, stale, freeSeats);
+            mismatches++;
+        }
+    }
+    pthread_mutex_unlock(&map->allocLock);
+    return mismatches;
+}
+
+// One-shot import of a legacy <flightID>_seats.csv file into the inventory
+SeatMap *importSeatCSV(const char *flightID) {
+    char seatFile[50];
+    sprintf(seatFile, "%s_seats.csv", flightID);
+    CsvReader reader;
+    if (!csvOpen(&reader, seatFile)) {
+        return NULL;
+    }
+
+    // Seat numbers first, to size the bitmap; the header row fails to parse and is skipped
+    CsvField fields[CSV_MAX_FIELDS];
+    int count, seatNum, totalSeats = 0;
+    while ((count = csvNextRow(&reader, fields)) >= 0) {
+        if (count == 2 && csvInt(fields[0], &seatNum) && seatNum > totalSeats) {
+            totalSeats = seatNum;
+        }
+    }
+
+    SeatLayout layout;
+    defaultSeatLayout(&layout, totalSeats);
+    SeatMap *map = newSeatMap(flightID, &layout);
+    reader.pos = 0;
+    reader.line = 0;
+    while ((count = csvNextRow(&reader, fields)) >= 0) {
+        if (count != 2 || !csvInt(fields[0], &seatNum) || seatNum <= 0) {
+            if (reader.line > 1) {
+                csvMalformed(&reader, "expected <seat>,<status>");
+            }
+            continue;
+        }
+        int available = fields[1].length == 9 && memcmp(fields[1].start, "Available", 9) == 0;
+        uint64_t mask = 1ULL << ((seatNum - 1) % 64);
+        if (!available && !(map->bits[(seatNum - 1) / 64] & mask)) {
+            map->bits[(seatNum - 1) / 64] |= mask;
+            map->seatsBooked++;
+        }
+    }
+    csvClose(&reader);
+    buildCabins(map);
+
+    appendSeatMap(map);
+    printf("Imported %d seats for flight %s from %s\n", totalSeats, flightID, seatFile);
+    return map;
+}
+
+// Link every flight to its seat map, importing legacy seat CSVs on first run, and count
+// the tickets each has sold beyond its seats
+void attachSeatMaps() {
+    Flight *current = flightHead;
+    while (current) {
+        current->seats = findSeatMap(current->flightID);
+        if (!current->seats) {
+            current->seats = importSeatCSV(current->flightID);
+        }
+        if (current->seats) {
+            Aggregate *entry = aggregateLookup(&totals.byFlight, current->flightID, 0);
+            current->seats->overbooked = entry ? (int)entry->unseated : 0;
+        }
+        current = current->next;
+    }
+}
+
+// Detach a removed flight's bookings from the flight index in one step and queue them
+// for refund. The caller holds the store lock exclusively.
+static void queueFlightRemoval(const char *flightID) {
+    FlightRemoval *job = (FlightRemoval *)calloc(1, sizeof(FlightRemoval));
+    if (!job) {
+        printf("Memory allocation failed for flight removal.\n");
+        exit(1);
+    }
+    strcpy(job->flightID, flightID);
+    uint32_t code = flightCode(flightID, 0);
+    if (code < flightBookings.capacity && flightBookings.heads[code]) {
+        job->bookings = flightBookings.heads[code];
+        job->bookings->flightPrev = &job->bookings;
+        flightBookings.heads[code] = NULL;
+    }
+    // Until refunded the bookings stay in the index, but no one may view or change them
+    for (Booking *booking = job->bookings; booking; booking = booking->flightNext) {
+        __atomic_store_n(&booking->removed, 1, __ATOMIC_RELEASE);
+    }
+    // The flight's takings leave its route now, so refunds and a re-added flight of the
+    // same ID never touch the route the removed flight flew
+    Aggregate *entry = aggregateLookup(&totals.byFlight, flightID, 0);
+    job->pending = entry ? entry->bookings : 0;
+    if (entry && entry->route[0]) {
+        Aggregate *route = aggregateLookup(&totals.byRoute, entry->route, 1);
+        route->revenue -= entry->revenue;
+        route->bookings -= entry->bookings;
+        entry->route[0] = '\0';
+    }
+
+    pthread_mutex_lock(&removalLock);
+    if (removals.tail) {
+        removals.tail->next = job;
+    } else {
+        removals.head = job;
+    }
+    removals.tail = job;
+    removals.pending += job->pending;
+    pthread_cond_signal(&removalReady);
+    pthread_mutex_unlock(&removalLock);
+}
+
+// Rewrite the seat inventory once removed flights' entries are most of it
+static void reclaimSeatInventory() {
+    struct stat info;
+    if (seatInventory && seatInventoryDead >= SEAT_INVENTORY_SLACK &&
+        fstat(fileno(seatInventory), &info) == 0 && seatInventoryDead * 2 > (long)info.st_size) {
+        rewriteSeatInventory();
+    }
+}
+
+static int compareRefNos(const void *a, const void *b);
+
+// Read the reference numbers already refunded, before a journal's removals are replayed
+static void loadRefundLog() {
+    refundLog.loaded = 1;
+    FILE *file = fopen(REFUND_FILE, "r");
+    if (!file) {
+        return;
+    }
+    char line[256];
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), file)) {
+        countRead(strlen(line));
+        if (refundLog.count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            char (*refNos)[REFNO_SIZE] = realloc(refundLog.refNos, capacity * REFNO_SIZE);
+            if (!refNos) {
+                printf("Memory allocation failed for refund log.\n");
+                exit(1);
+            }
+            refundLog.refNos = refNos;
+        }
+        char *refNo = refundLog.refNos[refundLog.count++];
+        size_t length = strcspn(line, ",\r\n");
+        memset(refNo, 0, REFNO_SIZE);
+        memcpy(refNo, line, length < REFNO_SIZE - 1 ? length : REFNO_SIZE - 1);
+    }
+    fclose(file);
+    qsort(refundLog.refNos, refundLog.count, REFNO_SIZE, compareRefNos);
+}
+
+static void releaseRefundLog() {
+    free(refundLog.refNos);
+    memset(&refundLog, 0, sizeof(refundLog));
+}
+
+// Whether REFUND_FILE already lists a refund of refNo; only known during replay
+static int alreadyRefunded(const char *refNo) {
+    return refundLog.count > 0 && bsearch(refNo, refundLog.refNos, refundLog.count, REFNO_SIZE, compareRefNos);
+}
+
+// Refund up to limit bookings of removed flights, oldest removal first, appending the
+// refunds to REFUND_FILE in one write. A removal ends once its bookings are gone: its
+// legacy seat file is deleted and the seat inventory compacted if mostly dead space.
+// Callers hold removalLock, and the store lock unless no other thread uses the store.
+// A removal replayed after a crash skips the refunds the file already lists.
+static long refundRemovedBookings(long limit) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *refunds = NULL;
+    long done = 0;
+    int64_t paise = 0;
+    FlightRemoval *job;
+    while ((job = removals.head) && done < limit) {
+        Booking *booking = job->bookings;
+        if (booking) {
+            if (!refunds) {
+                refunds = open_memstream(&text, &length);
+            }
+            if (refunds && !alreadyRefunded(booking->refNo)) {
+                char date[DATE_TEXT_SIZE];
+                fprintf(refunds, "%s,%s,%s,%s,%.2f\n", booking->refNo, booking->name, flightName(booking->flight),
+                        dateText(booking->date, date), booking->paise / 100.0);
+            }
+            paise += booking->paise;
+            dequeueCancelRequest(booking);
+            unlinkBooking(booking);  // Also takes it off the removal's list
+            freeBooking(booking);
+            if (job->pending > 0) {
+                job->pending--;
+                removals.pending--;
+            }
+            done++;
+            continue;
+        }
+
+        char seatFile[50];
+        sprintf(seatFile, "%s_seats.csv", job->flightID);
+        remove(seatFile);
+        removals.head = job->next;
+        if (!removals.head) {
+            removals.tail = NULL;
+        }
+        removals.pending -= job->pending;
+        free(job);
+        reclaimSeatInventory();
+    }
+    removals.refunded += done;
+    removals.refundedPaise += paise;
+
+    if (refunds) {
+        fclose(refunds);
+        int fd = open(REFUND_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0 || write(fd, text, length) != (ssize_t)length) {
+            printf("Error writing %s.\n", REFUND_FILE);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        countWrite(length);
+        free(text);
+    }
+    return done;
+}
+
+// Finish every queued removal now; snapshots and journal replay call this so no booking
+// of a removed flight outlives the journal record that removed it
+void finishFlightRemovals() {
+    pthread_mutex_lock(&removalLock);
+    refundRemovedBookings(LONG_MAX);
+    pthread_mutex_unlock(&removalLock);
+}
+
+// Whether a removal of flightID is still waiting for its refunds
+static int removalQueued(const char *flightID) {
+    pthread_mutex_lock(&removalLock);
+    FlightRemoval *job = removals.head;
+    while (job && strcmp(job->flightID, flightID) != 0) {
+        job = job->next;
+    }
+    pthread_mutex_unlock(&removalLock);
+    return job != NULL;
+}
+
+// Refund removed flights' bookings a batch per store lock hold, so bookings and lookups
+// keep flowing while a large flight is cleaned up
+static void *removalWorker(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&removalLock);
+        while (!removals.head) {
+            pthread_cond_wait(&removalReady, &removalLock);
+        }
+        pthread_mutex_unlock(&removalLock);
+
+        pthread_rwlock_wrlock(&storeLock);
+        pthread_mutex_lock(&removalLock);
+        refundRemovedBookings(REMOVAL_BATCH);
+        pthread_mutex_unlock(&removalLock);
+        pthread_rwlock_unlock(&storeLock);
+    }
+    return NULL;
+}
+
+// Start the removal worker; without it removals are refunded by the caller
+static void startRemovalWorker() {
+    pthread_mutex_lock(&removalLock);
+    if (!removals.workerStarted) {
+        pthread_t thread;
+        removals.workerStarted = pthread_create(&thread, NULL, removalWorker, NULL) == 0;
+        if (removals.workerStarted) {
+            pthread_detach(thread);
+        }
+    }
+    pthread_mutex_unlock(&removalLock);
+}
+
+// Copy of the removal counters
+RemovalCounts storeRemovalCounts() {
+    pthread_mutex_lock(&removalLock);
+    RemovalCounts counts = {removals.pending, removals.refunded, removals.refundedPaise};
+    pthread_mutex_unlock(&removalLock);
+    return counts;
+}
+
+// Drop queued removals without refunding them, used when the store is released
+static void discardFlightRemovals() {
+    pthread_mutex_lock(&removalLock);
+    while (removals.head) {
+        FlightRemoval *job = removals.head;
+        removals.head = job->next;
+        free(job);
+    }
+    removals.tail = NULL;
+    removals.pending = 0;
+    pthread_mutex_unlock(&removalLock);
+}
+
+// Reference numbers are 'R' followed by 12 Crockford base32 digits encoding 60 bits:
+// 32 bits of seconds since REFNO_EPOCH, a 20-bit sequence and an 8-bit node number.
+// Time and sequence share one atomic counter that is only ever incremented or raised
+// to the current second, so numbers are unique and sortable without any lock.
+static const char refNoDigits[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+
+// Decode a generated reference number, 0 if refNo is not in this format
+uint64_t decodeRefNo(const char *refNo) {
+    if (refNo[0] != 'R' || strlen(refNo) != 1 + REFNO_DIGITS) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 1; i <= REFNO_DIGITS; i++) {
+        const char *digit = strchr(refNoDigits, refNo[i]);
+        if (!digit || !*digit) {
+            return 0;
+        }
+        value = (value << 5) | (uint64_t)(digit - refNoDigits);
+    }
+    return value;
+}
+
+// Take count consecutive numbers from the generator; returns the value of the first.
+// The values of the others follow it 1 << REFNO_NODE_BITS apart.
+static uint64_t reserveRefNos(int count) {
+    uint64_t now = (uint64_t)(time(NULL) - REFNO_EPOCH) << REFNO_SEQUENCE_BITS;
+    uint64_t current = __atomic_load_n(&refNoCounter, __ATOMIC_RELAXED);
+    if (current < now) {
+        // Move up to the current second; losing this race only means someone else did
+        __atomic_compare_exchange_n(&refNoCounter, &current, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    return (__atomic_fetch_add(&refNoCounter, count, __ATOMIC_RELAXED) << REFNO_NODE_BITS) | refNoNode;
+}
+
+static void formatRefNo(uint64_t value, char *refNo) {
+    refNo[0] = 'R';
+    for (int i = REFNO_DIGITS; i >= 1; i--) {
+        refNo[i] = refNoDigits[value & 31];
+        value >>= 5;
+    }
+    refNo[REFNO_DIGITS + 1] = '\0';
+}
+
+// Generate a unique reference number into refNo (REFNO_SIZE bytes); safe from any thread
+void generateRefNo(char *refNo) {
+    formatRefNo(reserveRefNos(1), refNo);
+}
+
+// A group reference is 'G', the digits of its first member's reference number and two
+// digits for the count less one. Members have consecutive numbers, so the reference
+// alone finds them all and no file has to record the group.
+static void formatGroupRef(uint64_t first, int count, char *groupRef) {
+    formatRefNo(first, groupRef);
+    groupRef[0] = 'G';
+    groupRef[REFNO_DIGITS + 1] = refNoDigits[((count - 1) >> 5) & 31];
+    groupRef[REFNO_DIGITS + 2] = refNoDigits[(count - 1) & 31];
+    groupRef[REFNO_DIGITS + 3] = '\0';
+}
+
+// Reference number of a group's member, counted from 0. Returns the group's size, or 0
+// if groupRef is not a group reference or the group has no such member.
+int groupMemberRef(const char *groupRef, int member, char *refNo) {
+    if (groupRef[0] != 'G' || strlen(groupRef) != 3 + REFNO_DIGITS) {
+        return 0;
+    }
+    memcpy(refNo, groupRef, REFNO_DIGITS + 1);
+    refNo[0] = 'R';
+    refNo[REFNO_DIGITS + 1] = '\0';
+    uint64_t first = decodeRefNo(refNo);
+    const char *high = strchr(refNoDigits, groupRef[REFNO_DIGITS + 1]);
+    const char *low = strchr(refNoDigits, groupRef[REFNO_DIGITS + 2]);
+    if (!first || !high || !*high || !low || !*low) {
+        return 0;
+    }
+    int count = (int)((high - refNoDigits) * 32 + (low - refNoDigits)) + 1;
+    if (member < 0 || member >= count) {
+        return 0;
+    }
+    formatRefNo(first + ((uint64_t)member << REFNO_NODE_BITS), refNo);
+    return count;
+}
+
+// Start the generator past every reference number already in the store, so a restart
+// within the same second or a clock step backwards cannot reissue a number
+void seedRefNoGenerator() {
+    const char *node = getenv("ARS_NODE");
+    refNoNode = node ? (uint64_t)atoi(node) & ((1 << REFNO_NODE_BITS) - 1) : 0;
+    for (Booking *b = head; b; b = b->next) {
+        uint64_t counter = decodeRefNo(b->refNo) >> REFNO_NODE_BITS;
+        if (counter >= refNoCounter) {
+            refNoCounter = counter + 1;
+        }
+    }
+}
+
+// Create the CSV file if it doesn't exist
+void createCSVIfNotExists() {
+    FILE *file = fopen(DESKTOP_PATH, "a");
+    if (!file) {
+        printf("Error creating or accessing the file.\n");
+        exit(1);
+    }
+    fclose(file);
+}
+
+// Loader threads for startup: ARS_THREADS if set, else one per online CPU
+int startupThreads() {
+    int threads = loaderThreads;
+    if (threads <= 0) {
+        const char *env = getenv("ARS_THREADS");
+        threads = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_LOADER_THREADS) threads = MAX_LOADER_THREADS;
+    return threads;
+}
+
+static void addStartupPhase(const char *name, double ms, int parallel) {
+    if (startupReport.count < STARTUP_MAX_PHASES) {
+        StartupPhase *phase = &startupReport.phases[startupReport.count++];
+        phase->name = name;
+        phase->ms = ms;
+        phase->parallel = parallel;
+    }
+}
+
+// Record a startup phase that began at since; returns the current time for the next one
+double startupPhase(const char *name, double since, int parallel) {
+    double now = nowNanos();
+    addStartupPhase(name, (now - since) / 1e6, parallel);
+    return now;
+}
+
+void printStartupReport() {
+    double total = 0;
+    printf("Loaded %zu bookings and %zu flights with %d loader threads (%d chunks)\n",
+           bookingIndex.count, flightIndex.count, startupReport.threads, startupReport.chunks);
+    printf("%-26s | %9s\n", "phase", "ms");
+    for (int i = 0; i < startupReport.count; i++) {
+        StartupPhase *phase = &startupReport.phases[i];
+        printf("%s%-*s | %9.1f\n", phase->parallel ? "  " : "", phase->parallel ? 24 : 26, phase->name, phase->ms);
+        if (!phase->parallel) {
+            total += phase->ms;
+        }
+    }
+    printf("%-26s | %9.1f\n", "total", total);
+}
+
+typedef struct LoadRunner {
+    LoadTask *tasks;
+    int count;
+    int next;
+} LoadRunner;
+
+static void *loadWorker(void *arg) {
+    LoadRunner *runner = (LoadRunner *)arg;
+    int i;
+    while ((i = __atomic_fetch_add(&runner->next, 1, __ATOMIC_RELAXED)) < runner->count) {
+        double start = nowNanos();
+        runner->tasks[i].run(&runner->tasks[i]);
+        runner->tasks[i].ms = (nowNanos() - start) / 1e6;
+    }
+    return NULL;
+}
+
+// Run tasks on up to startupThreads() threads, the calling thread included
+void runLoadTasks(LoadTask *tasks, int count) {
+    LoadRunner runner = {tasks, count, 0};
+    pthread_t threads[MAX_LOADER_THREADS];
+    int spawned = 0, wanted = startupThreads();
+    if (wanted > count) {
+        wanted = count;
+    }
+    while (spawned < wanted - 1 && pthread_create(&threads[spawned], NULL, loadWorker, &runner) == 0) {
+        spawned++;
+    }
+    loadWorker(&runner);
+    for (int i = 0; i < spawned; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Push a parsed booking onto its task's private list
+static void pushLoaded(LoadTask *task, Booking *booking) {
+    booking->archived = 0;
+    booking->removed = 0;
+    booking->cancelRequest = NULL;
+    booking->prev = NULL;
+    booking->next = task->head;
+    if (task->head) {
+        task->head->prev = booking;
+    } else {
+        task->tail = booking;
+    }
+    task->head = booking;
+    task->count++;
+}
+
+// Parse one chunk of details.csv into the task's own pool
+static void parseBookingChunk(LoadTask *task) {
+    CsvField fields[CSV_MAX_FIELDS];
+    long capacity = 0;
+    int count;
+    while ((count = csvNextRow(&task->reader, fields)) >= 0) {
+        Booking *booking = (Booking *)poolAlloc(&task->pool);
+        const char *error = parseBookingRow(fields, count, booking);
+        if (error) {
+            csvMalformed(&task->reader, error);
+            poolFree(&task->pool, booking);
+            continue;
+        }
+        if (task->count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            long *lines = (long *)realloc(task->lines, capacity * sizeof(long));
+            if (!lines) {
+                printf("Memory allocation failed for booking lines.\n");
+                exit(1);
+            }
+            task->lines = lines;
+        }
+        task->lines[task->count] = task->reader.line;
+        pushLoaded(task, booking);
+    }
+}
+
+// Split a mapped CSV file at line boundaries into at most count chunk readers.
+// Returns the number of chunks.
+static int splitCsvChunks(const CsvReader *reader, LoadTask *tasks, int count) {
+    if ((size_t)count > reader->size / LOAD_MIN_CHUNK_BYTES) {
+        count = reader->size / LOAD_MIN_CHUNK_BYTES > 0 ? (int)(reader->size / LOAD_MIN_CHUNK_BYTES) : 1;
+    }
+    Pool pool = POOL_INIT(Booking, 4096);
+    size_t start = 0;
+    for (int c = 0; c < count; c++) {
+        size_t end = reader->size;
+        if (c < count - 1) {
+            end = reader->size / count * (c + 1);
+            end = end < start ? start : end;
+            const char *newline = (const char *)memchr(reader->data + end, '\n', reader->size - end);
+            end = newline ? (size_t)(newline - reader->data) + 1 : reader->size;
+        }
+        tasks[c].reader = *reader;
+        tasks[c].reader.data = reader->data + start;
+        tasks[c].reader.size = end - start;
+        tasks[c].reader.pos = 0;
+        tasks[c].reader.line = 0;
+        tasks[c].reader.malformed = 0;
+        tasks[c].reader.deferReports = 1;
+        tasks[c].run = parseBookingChunk;
+        tasks[c].pool = pool;
+        start = end;
+    }
+    return count;
+}
+
+// Move every task's bookings into the main list and pool, in task order, as if each
+// booking had been linked one at a time. Prepares loadBatch for the index build.
+static void spliceLoaded(LoadTask *tasks, int count) {
+    memset(&loadBatch, 0, sizeof(loadBatch));
+    loadBatch.chunks = tasks;
+    loadBatch.chunkCount = count;
+    for (int c = 0; c < count; c++) {
+        LoadTask *task = &tasks[c];
+        poolAdopt(&bookingPool, &task->pool);
+        if (task->count == 0) {
+            continue;
+        }
+        task->tail->next = head;
+        if (head) {
+            head->prev = task->tail;
+        }
+        head = task->head;
+        if (!loadBatch.first) {
+            loadBatch.first = task->tail;
+        }
+        loadBatch.count += task->count;
+    }
+}
+
+static void noteDuplicate(Booking *booking, long line) {
+    if (loadBatch.duplicateCount == loadBatch.duplicateCapacity) {
+        long capacity = loadBatch.duplicateCapacity ? loadBatch.duplicateCapacity * 2 : 64;
+        Booking **duplicates = (Booking **)realloc(loadBatch.duplicates, capacity * sizeof(Booking *));
+        long *lines = (long *)realloc(loadBatch.duplicateLines, capacity * sizeof(long));
+        if (!duplicates || !lines) {
+            printf("Memory allocation failed for duplicate bookings.\n");
+            exit(1);
+        }
+        loadBatch.duplicates = duplicates;
+        loadBatch.duplicateLines = lines;
+        loadBatch.duplicateCapacity = capacity;
+    }
+    loadBatch.duplicates[loadBatch.duplicateCount] = booking;
+    loadBatch.duplicateLines[loadBatch.duplicateCount++] = line;
+}
+
+// Index the batch by refNo in the order it was linked, so the first of several
+// bookings with one refNo wins as it does when linking one at a time
+static void buildRefNoIndex(LoadTask *task) {
+    (void)task;
+    size_t needed = bookingIndex.count + loadBatch.count;
+    if ((needed + 1) * 10 >= bookingIndex.capacity * 5) {
+        size_t capacity = bookingIndex.capacity ? bookingIndex.capacity : 64;
+        while ((needed + 1) * 10 >= capacity * 5) {
+            capacity *= 2;
+        }
+        bookingIndexResize(&bookingIndex, capacity);
+    }
+    int c = 0;
+    long k = 0;
+    Booking *booking = loadBatch.first;
+    for (long i = 0; i < loadBatch.count; i++, k++, booking = booking->prev) {
+        while (k == loadBatch.chunks[c].count) {
+            c++;
+            k = 0;
+        }
+        if (bookingIndexFind(&bookingIndex, booking->refNo)) {
+            LoadTask *chunk = &loadBatch.chunks[c];
+            noteDuplicate(booking, chunk->lines ? chunk->lineBase + chunk->lines[k] : 0);
+        } else {
+            bookingIndexInsert(&bookingIndex, booking);
+        }
+    }
+}
+
+static void buildTotals(LoadTask *task) {
+    (void)task;
+    Booking *booking = head;
+    for (long i = 0; i < loadBatch.count; i++, booking = booking->next) {
+        countBooking(&totals, booking, bookingRoute(booking), 1);
+    }
+}
+
+static void buildColumns(LoadTask *task) {
+    (void)task;
+    Booking *booking = head;
+    for (long i = 0; i < loadBatch.count; i++, booking = booking->next) {
+        appendBookingRow(booking);
+    }
+}
+
+static void buildRoutes(LoadTask *task) {
+    (void)task;
+    rebuildRouteIndex();
+}
+
+// Build the refNo index, running totals and booking columns of the spliced batch
+// (and the route index when withRoutes is set) side by side, then re-key duplicates
+static void buildLoaded(int withRoutes, double since) {
+    LoadTask builders[4];
+    static const char *names[4] = {"refNo index", "running totals", "booking columns", "route index"};
+    void (*runs[4])(LoadTask *) = {buildRefNoIndex, buildTotals, buildColumns, buildRoutes};
+    int count = withRoutes ? 4 : 3;
+    memset(builders, 0, sizeof(builders));
+    for (int i = 0; i < count; i++) {
+        builders[i].run = runs[i];
+    }
+    runLoadTasks(builders, count);
+    startupPhase("build indexes", since, 0);
+    for (int i = 0; i < count; i++) {
+        addStartupPhase(names[i], builders[i].ms, 1);
+    }
+
+    // A booking whose refNo an earlier row already holds (legacy R%04d numbers collide)
+    // is still a paid booking with its seat taken, so it gets a fresh reference number
+    for (long i = 0; i < loadBatch.duplicateCount; i++) {
+        Booking *booking = loadBatch.duplicates[i];
+        do {
+            generateRefNo(booking->refNo);
+        } while (bookingIndexFind(&bookingIndex, booking->refNo));
+        bookingIndexInsert(&bookingIndex, booking);
+    }
+}
+
+static void releaseLoaded() {
+    for (int c = 0; c < loadBatch.chunkCount; c++) {
+        free(loadBatch.chunks[c].lines);
+    }
+    free(loadBatch.duplicates);
+    free(loadBatch.duplicateLines);
+    memset(&loadBatch, 0, sizeof(loadBatch));
+}
+
+static int compareCsvReports(const void *a, const void *b) {
+    const CsvReport *x = (const CsvReport *)a, *y = (const CsvReport *)b;
+    return (x->line > y->line) - (x->line < y->line);
+}
+
+// Print the rows the chunk readers skipped in file order, then the re-keyed duplicates
+static void reportLoaded(CsvReader *reader) {
+    CsvReport reports[(MAX_LOADER_THREADS + 1) * CSV_REPORT_LIMIT];
+    int count = 0;
+    for (int c = 0; c < loadBatch.chunkCount; c++) {
+        CsvReader *chunk = &loadBatch.chunks[c].reader;
+        for (long i = 0; i < chunk->malformed && i < CSV_REPORT_LIMIT; i++) {
+            reports[count] = chunk->reports[i];
+            reports[count++].line += loadBatch.chunks[c].lineBase;
+        }
+        reader->malformed += chunk->malformed;
+    }
+    qsort(reports, count, sizeof(CsvReport), compareCsvReports);
+    for (int i = 0; i < count && i < CSV_REPORT_LIMIT; i++) {
+        printf("%s:%ld: skipped row, %s\n", reader->path, reports[i].line, reports[i].reason);
+    }
+    for (long i = 0; i < loadBatch.duplicateCount && i < CSV_REPORT_LIMIT; i++) {
+        printf("%s:%ld: duplicate reference number, booking re-keyed as %s\n", reader->path,
+               loadBatch.duplicateLines[i], loadBatch.duplicates[i]->refNo);
+    }
+    if (loadBatch.duplicateCount > CSV_REPORT_LIMIT) {
+        printf("%s: %ld bookings re-keyed in total\n", reader->path, loadBatch.duplicateCount);
+    }
+}
+
+// Load the booking data from the CSV file into the linked list. Chunks of the file
+// are parsed on the loader threads, then the lookup structures are built side by side.
+void loadDataFromCSV() {
+    double start = nowNanos();
+    CsvReader reader;
+    if (!csvOpen(&reader, DESKTOP_PATH)) {
+        printf("No existing data found. Starting fresh.\n");
+        return;  // No data to load
+    }
+
+    LoadTask tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+    int chunks = splitCsvChunks(&reader, tasks, startupThreads());
+    runLoadTasks(tasks, chunks);
+    long lines = 0;
+    for (int c = 0; c < chunks; c++) {
+        tasks[c].lineBase = lines;
+        lines += tasks[c].reader.line;
+    }
+    startupReport.chunks = chunks;
+    double mark = startupPhase("parse bookings", start, 0);
+
+    spliceLoaded(tasks, chunks);
+    buildLoaded(0, mark);
+    reportLoaded(&reader);
+    long rekeyed = loadBatch.duplicateCount;
+    releaseLoaded();
+    csvClose(&reader);
+    // Save the new numbers at once, so a restart does not hand out different ones
+    if (rekeyed > 0 && !saveDataToCSV()) {
+        printf("Error saving re-keyed bookings to details.csv.\n");
+    }
+    printf("Data loaded from details.csv\n");
+}
+
+
+// Load flights from the file into the linked list
+void loadFlightsFromFile() {
+    CsvReader reader;
+    if (!csvOpen(&reader, FLIGHT_FILE)) {
+        printf("Error opening flight data file.\n");
+        return;
+    }
+
+    Flight *tail = flightHead;
+    while (tail && tail->next) {
+        tail = tail->next;
+    }
+
+    CsvField fields[CSV_MAX_FIELDS];
+    int count;
+    while ((count = csvNextRow(&reader, fields)) >= 0) {
+        Flight *newFlight = allocFlight();
+        char time[10], source[30], destination[30];
+        double price;
+        const char *error = NULL;
+        if (count != 6) error = "expected 6 fields";
+        else if (!csvCopy(newFlight->flightID, sizeof(newFlight->flightID), fields[0])) error = "bad flight ID";
+        else if (!csvCopy(newFlight->date, sizeof(newFlight->date), fields[1])) error = "bad date";
+        else if (!csvCopy(time, sizeof(time), fields[2])) error = "bad time";
+        else if (!csvCopy(source, sizeof(source), fields[3])) error = "bad source";
+        else if (!csvCopy(destination, sizeof(destination), fields[4])) error = "bad destination";
+        else if (!csvNumber(fields[5], &price)) error = "bad price";
+        if (error) {
+            csvMalformed(&reader, error);
+            freeFlight(newFlight);
+            continue;
+        }
+        setFlightText(newFlight, time, source, destination);
+        newFlight->price = (float)price;
+
+        newFlight->seats = NULL;
+        newFlight->next = NULL;
+        setFlightRoute(newFlight);
+        if (!flightIndexFind(&flightIndex, newFlight->flightID)) {
+            flightIndexInsert(&flightIndex, newFlight);
+        }
+
+        if (tail) {
+            tail->next = newFlight;
+            tail = newFlight;
+        } else {
+            flightHead = newFlight;
+            tail = newFlight;
+        }
+    }
+
+    csvClose(&reader);
+}
+
+// Save flight data to file
+int saveFlightsToFile() {
+    FILE *file = fopen(FLIGHT_FILE ".tmp", "w");
+    if (!file) {
+        printf("Error saving flight data.\n");
+        return 0;
+    }
+
+    Flight *current = flightHead;
+    while (current) {
+        fprintf(file, "%s,%s,%s,%s,%s,%.2f\n", current->flightID, current->date,
+                flightTime(current), flightSource(current), flightDestination(current), current->price);
+        current = current->next;
+    }
+
+    return commitFile(file, FLIGHT_FILE ".tmp", FLIGHT_FILE);
+}
+
+// Flush, fsync and atomically move a finished temp file over its target
+int commitFile(FILE *file, const char *tempPath, const char *path) {
+    long size = ftell(file);
+    countWrite(size > 0 ? size : 0);
+    int failed = fflush(file) != 0 || syncFile(fileno(file)) != 0;
+    failed |= fclose(file) != 0;
+    if (failed || rename(tempPath, path) != 0) {
+        printf("Error writing %s.\n", path);
+        remove(tempPath);
+        return 0;
+    }
+    return 1;
+}
+
+// Save the pending cancellation requests to their CSV file
+int saveCancelRequestsToFile() {
+    FILE *file = fopen("cancellation_requests.csv.tmp", "w");
+    if (!file) {
+        printf("Error opening cancellation requests file.\n");
+        return 0;
+    }
+    char date[DATE_TEXT_SIZE];
+    for (size_t i = cancelQueue.head; i < cancelQueue.tail; i++) {
+        CancelRequest *current = cancelQueue.slots[i];
+        if (current) {
+            fprintf(file, "%s,%s,%s,%s,%.2f\n", current->refNo, current->name,
+                    flightName(current->flight), dateText(current->date, date), current->paise / 100.0);
+        }
+    }
+    return commitFile(file, "cancellation_requests.csv.tmp", "cancellation_requests.csv");
+}
+
+// Open the operations journal for appending
+void openJournal() {
+    journal = fopen(JOURNAL_FILE, "a");
+    if (!journal) {
+        printf("Error opening journal file.\n");
+        exit(1);
+    }
+}
+
+static void syncJournalLocked() {
+    if (journal && journalUnsynced > 0) {
+        fflush(journal);
+        syncFile(fileno(journal));
+        journalUnsynced = 0;
+    }
+}
+
+// Force every appended journal record to disk
+void journalSync() {
+    pthread_mutex_lock(&journalLock);
+    syncJournalLocked();
+    pthread_mutex_unlock(&journalLock);
+}
+
+// Count records just written to the journal and flush them unless a group is open.
+// Returns whether the journal is due for compaction. Caller holds journalLock.
+static int journalWrittenLocked(size_t bytes, int records) {
+    countWrite(bytes);
+    journalRecords += records;
+    journalUnsynced += records;
+    if (journalGroupDepth == 0) {
+        fflush(journal);  // Survives a process crash, the batched fsync covers power loss
+        if (journalUnsynced >= JOURNAL_SYNC_BATCH) {
+            syncJournalLocked();
+        }
+    }
+    return journalRecords >= JOURNAL_COMPACT_THRESHOLD;
+}
+
+// Append one operation record to the journal, fsync happens in batches
+void journalAppend(const char *format, ...) {
+    if (!journal) {
+        return;
+    }
+    pthread_mutex_lock(&journalLock);
+    va_list args;
+    va_start(args, format);
+    int length = vfprintf(journal, format, args);
+    va_end(args);
+    fputc('\n', journal);
+    int compact = journalWrittenLocked(length + 1, 1);
+    pthread_mutex_unlock(&journalLock);
+
+    if (compact) {
+        compactJournal();
+    }
+}
+
+// Append records already formatted, each ending in a newline, with one flush
+void journalAppendLines(const char *lines, size_t length, int records) {
+    if (!journal) {
+        return;
+    }
+    pthread_mutex_lock(&journalLock);
+    fwrite(lines, 1, length, journal);
+    int compact = journalWrittenLocked(length, records);
+    pthread_mutex_unlock(&journalLock);
+
+    if (compact) {
+        compactJournal();
+    }
+}
+
+// Fold the journal into a fresh binary snapshot, then start an empty journal.
+// Server callers hold the store lock so the snapshot matches the journal. Seat maps
+// a group has not written yet, and the seats of a claim whose record set off the
+// compaction, are written first: once the journal is emptied, nothing else would bring
+// those seats back after a crash.
+void compactJournal() {
+    if (unwrittenClaim) {
+        writeSeatWords(unwrittenClaim->map, unwrittenClaim->from, unwrittenClaim->to);
+    }
+    flushDirtySeatMaps();
+    journalSync();
+    if (!saveSnapshot()) {
+        printf("Snapshot failed, keeping the journal.\n");
+        return;
+    }
+    pthread_mutex_lock(&journalLock);
+    if (journal) {
+        fclose(journal);
+    }
+    journal = fopen(JOURNAL_FILE, "w");
+    if (journal) {
+        syncFile(fileno(journal));
+    }
+    journalRecords = 0;
+    journalUnsynced = 0;
+    pthread_mutex_unlock(&journalLock);
+}
+
+// Whether the count booking records after a group header all reached the journal whole
+static int journalGroupComplete(FILE *file, int count) {
+    char line[512];
+    for (int i = 0; i < count; i++) {
+        if (!fgets(line, sizeof(line), file) || strncmp(line, "B,", 2) != 0 || !strchr(line, '\n')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Re-apply the operations recorded since the last snapshot. A group booking cut short
+// by a crash is dropped whole and cut off the journal, so it is never half booked.
+void replayJournal() {
+    FILE *file = fopen(JOURNAL_FILE, "r");
+    if (!file) {
+        return;
+    }
+
+    char line[512];
+    char refNo[REFNO_SIZE], flightID[10], date[DATE_TEXT_SIZE];
+    long lineStart = 0, partialGroup = -1;
+    while (fgets(line, sizeof(line), file)) {
+        countRead(strlen(line));
+        line[strcspn(line, "\r\n")] = '\0';
+        switch (line[0]) {
+            case 'G': {
+                // Header of a group booking: its members follow, all or none of them
+                long members = ftell(file);
+                int count = atoi(line + 2);
+                if (count <= 0 || !journalGroupComplete(file, count)) {
+                    // Give back seats a concurrent write may have stored for the lost group
+                    fseek(file, members, SEEK_SET);
+                    int seatNumber;
+                    while (fgets(line, sizeof(line), file) && strchr(line, '\n')) {
+                        SeatMap *map;
+                        if (sscanf(line, "B,%*[^,],%*[^,],%9[^,],%*[^,],%d", flightID, &seatNumber) == 2 &&
+                            (map = findSeatMap(flightID))) {
+                            releaseSeat(map, seatNumber);
+                        }
+                    }
+                    partialGroup = lineStart;
+                    break;
+                }
+                fseek(file, members, SEEK_SET);
+                lineStart = members;
+                continue;
+            }
+            case 'B': {
+                Booking *booking = allocBooking();
+                double payment;
+                if (sscanf(line, "B,%15[^,],%29[^,],%9[^,],%14[^,],%d,%lf", booking->refNo,
+                           booking->name, flightID, date, &booking->seatNumber, &payment) == 6 &&
+                    !bookingIndexFind(&bookingIndex, booking->refNo)) {
+                    booking->paise = toPaise(payment);
+                    booking->flight = flightCode(flightID, 1);
+                    booking->date = packDate(date);
+                    Flight *flight = flightByCode(booking->flight);
+                    if (flight && flight->seats && booking->seatNumber == SEAT_OVERBOOKED) {
+                        flight->seats->overbooked++;
+                    } else if (flight && flight->seats) {
+                        claimSeat(flight->seats, booking->seatNumber);
+                    }
+                    booking->cancelRequested = 0;
+                    linkBooking(booking);
+                } else {
+                    freeBooking(booking);
+                }
+                break;
+            }
+            case 'C':
+                if (sscanf(line, "C,%15s", refNo) == 1) {
+                    Booking *booking = bookingIndexFind(&bookingIndex, refNo);
+                    if (booking) {
+                        requestCancellation(booking);
+                    }
+                }
+                break;
+            case 'A':
+                if (sscanf(line, "A,%15s", refNo) == 1) {
+                    removeBooking(refNo);
+                }
+                break;
+            case 'R':
+                if (sscanf(line, "R,%15s", refNo) == 1) {
+                    resolveCancelRequest(refNo);
+                }
+                break;
+            case 'F': {
+                // The seat field is a layout, or a plain seat count in older journals
+                Flight *flight = allocFlight();
+                char time[10], source[30], destination[30];
+                char layoutText[SEAT_LAYOUT_SIZE];
+                unsigned overbookLimit = 0;
+                SeatLayout layout;
+                if (sscanf(line, "F,%9[^,],%14[^,],%9[^,],%29[^,],%29[^,],%f,%95[^,],%u", flight->flightID,
+                           flight->date, time, source, destination,
+                           &flight->price, layoutText, &overbookLimit) >= 7 &&
+                    parseSeatLayout(layoutText, &layout) && !findFlight(flight->flightID)) {
+                    setFlightText(flight, time, source, destination);
+                    layout.overbookLimit = overbookLimit;
+                    registerFlightLayout(flight, &layout);
+                } else {
+                    freeFlight(flight);
+                }
+                break;
+            }
+            case 'X':
+                if (!refundLog.loaded) {
+                    loadRefundLog();
+                }
+                deleteFlight(line + 2);
+                break;
+            case 'M':
+                approveFlightCancellations(line + 2);
+                break;
+            default:
+                lineStart = ftell(file);
+                continue;
+        }
+        if (partialGroup >= 0) {
+            break;
+        }
+        lineStart = ftell(file);
+        journalRecords++;
+    }
+    fclose(file);
+    finishFlightRemovals();
+    releaseRefundLog();
+    if (partialGroup >= 0) {
+        if (truncate(JOURNAL_FILE, partialGroup) != 0) {
+            printf("Error truncating journal file.\n");
+            exit(1);
+        }
+        printf("Dropped an incomplete group booking from the end of the journal.\n");
+    }
+
+    if (journalRecords > 0) {
+        printf("Replayed %ld journal records.\n", journalRecords);
+    }
+}
+
+// Widen version 1 records to the current layout
+static void upgradeBookingV1(const SnapshotBookingV1 *old, SnapshotBooking *record) {
+    memset(record, 0, sizeof(*record));
+    memcpy(record->refNo, old->refNo, sizeof(old->refNo));
+    memcpy(record->name, old->name, sizeof(record->name));
+    memcpy(record->flightID, old->flightID, sizeof(record->flightID));
+    memcpy(record->date, old->date, sizeof(record->date));
+    record->seatNumber = old->seatNumber;
+    record->paise = toPaise(old->payment);
+    record->cancelRequested = old->cancelRequested;
+}
+
+// Version 2 and 3 bookings held a float payment
+static void upgradeBookingV3(const SnapshotBookingV3 *old, SnapshotBooking *record) {
+    memset(record, 0, sizeof(*record));
+    memcpy(record->refNo, old->refNo, sizeof(record->refNo));
+    memcpy(record->name, old->name, sizeof(record->name));
+    memcpy(record->flightID, old->flightID, sizeof(record->flightID));
+    memcpy(record->date, old->date, sizeof(record->date));
+    record->seatNumber = old->seatNumber;
+    record->paise = toPaise(old->payment);
+    record->cancelRequested = old->cancelRequested;
+}
+
+static void upgradeCancelV3(const SnapshotCancelV3 *old, SnapshotCancel *record) {
+    memset(record, 0, sizeof(*record));
+    memcpy(record->refNo, old->refNo, sizeof(record->refNo));
+    memcpy(record->name, old->name, sizeof(record->name));
+    memcpy(record->flightID, old->flightID, sizeof(record->flightID));
+    memcpy(record->date, old->date, sizeof(record->date));
+    record->paise = toPaise(old->payment);
+    record->sequence = old->sequence;
+}
+
+static void upgradeCancelV1(const SnapshotCancelV1 *old, SnapshotCancelV2 *record) {
+    memset(record, 0, sizeof(*record));
+    memcpy(record->refNo, old->refNo, sizeof(old->refNo));
+    memcpy(record->name, old->name, sizeof(record->name));
+    memcpy(record->flightID, old->flightID, sizeof(record->flightID));
+    memcpy(record->date, old->date, sizeof(record->date));
+    record->payment = old->payment;
+}
+
+// Booking record i of a snapshot of the given version, in the current layout
+static const SnapshotBooking *snapshotBooking(const char *records, uint32_t i, uint32_t version,
+                                              SnapshotBooking *upgraded) {
+    if (version == 1) {
+        upgradeBookingV1(&((const SnapshotBookingV1 *)records)[i], upgraded);
+        return upgraded;
+    }
+    if (version < 4) {
+        upgradeBookingV3(&((const SnapshotBookingV3 *)records)[i], upgraded);
+        return upgraded;
+    }
+    return &((const SnapshotBooking *)records)[i];
+}
+
+static size_t snapshotBookingSize(uint32_t version) {
+    return version == 1 ? sizeof(SnapshotBookingV1) : version < 4 ? sizeof(SnapshotBookingV3) : sizeof(SnapshotBooking);
+}
+
+// Copy booking record i of a snapshot into a booking
+static void copySnapshotBooking(const char *records, uint32_t i, uint32_t version, Booking *booking) {
+    SnapshotBooking upgraded;
+    const SnapshotBooking *record = snapshotBooking(records, i, version, &upgraded);
+    memcpy(booking->refNo, record->refNo, sizeof(booking->refNo));
+    memcpy(booking->name, record->name, sizeof(booking->name));
+    booking->flight = flightCode(record->flightID, 1);
+    booking->date = packDate(record->date);
+    booking->seatNumber = record->seatNumber;
+    booking->paise = record->paise;
+    booking->cancelRequested = record->cancelRequested;
+}
+
+static void parseSnapshotChunk(LoadTask *task) {
+    for (uint32_t i = task->last; i-- > task->first;) {
+        Booking *booking = (Booking *)poolAlloc(&task->pool);
+        copySnapshotBooking(task->records, i, task->version, booking);
+        pushLoaded(task, booking);
+    }
+}
+
+// Set a flight's time and airports from a snapshot record, whose fields may fill their width
+static void setFlightRecordText(Flight *flight, const SnapshotFlight *record) {
+    char time[sizeof(record->time) + 1], source[sizeof(record->source) + 1];
+    char destination[sizeof(record->destination) + 1];
+    snprintf(time, sizeof(time), "%.*s", (int)sizeof(record->time), record->time);
+    snprintf(source, sizeof(source), "%.*s", (int)sizeof(record->source), record->source);
+    snprintf(destination, sizeof(destination), "%.*s", (int)sizeof(record->destination), record->destination);
+    setFlightText(flight, time, source, destination);
+}
+
+// Append the snapshot's flights to the flight list; only this task touches flights
+static void loadSnapshotFlights(LoadTask *task) {
+    const SnapshotFlight *flights = (const SnapshotFlight *)task->records;
+    Flight *flightTail = NULL;
+    for (uint32_t i = 0; i < task->last; i++) {
+        Flight *flight = allocFlight();
+        memcpy(flight->flightID, flights[i].flightID, sizeof(flight->flightID));
+        memcpy(flight->date, flights[i].date, sizeof(flight->date));
+        setFlightRecordText(flight, &flights[i]);
+        flight->price = flights[i].price;
+        flight->seats = NULL;
+        flight->next = NULL;
+        setFlightRoute(flight);
+        if (!flightIndexFind(&flightIndex, flight->flightID)) {
+            flightIndexInsert(&flightIndex, flight);
+        }
+        if (flightTail) {
+            flightTail->next = flight;
+        } else {
+            flightHead = flight;
+        }
+        flightTail = flight;
+    }
+}
+
+// Map a single-file snapshot, as written before shards, and copy its fixed-width
+// records straight into the lists. Returns 0 if there is none.
+static int loadSingleSnapshot() {
+    double start = nowNanos();
+    int fd = open(SNAPSHOT_FILE, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        printf("Snapshot file %s is truncated.\n", SNAPSHOT_FILE);
+        exit(1);
+    }
+    const char *data = (const char *)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Error mapping snapshot file.\n");
+        exit(1);
+    }
+    madvise((void *)data, info.st_size, MADV_SEQUENTIAL);
+    countRead(info.st_size);
+
+    const SnapshotHeader *header = (const SnapshotHeader *)data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version < 1 || header->version > 2) {
+        printf("Snapshot file %s has an unsupported format.\n", SNAPSHOT_FILE);
+        exit(1);
+    }
+    int v1 = header->version == 1;
+    uint64_t bookingSize = snapshotBookingSize(header->version);
+    uint64_t cancelSize = v1 ? sizeof(SnapshotCancelV1) : sizeof(SnapshotCancelV2);
+    if (header->cancelOffset + header->cancelCount * cancelSize > (uint64_t)info.st_size ||
+        header->flightOffset + (uint64_t)header->flightCount * sizeof(SnapshotFlight) > header->cancelOffset ||
+        header->bookingOffset + header->bookingCount * bookingSize > header->flightOffset) {
+        printf("Snapshot file %s is truncated.\n", SNAPSHOT_FILE);
+        exit(1);
+    }
+
+    // Record ranges are parsed on the loader threads while the flights load. Bookings
+    // are pushed to the front, so each range is walked backwards and the task holding
+    // the last records is linked first, keeping the saved order.
+    uint32_t total = header->bookingCount;
+    int chunks = startupThreads();
+    if ((uint32_t)chunks > total / LOAD_MIN_CHUNK_RECORDS) {
+        chunks = total / LOAD_MIN_CHUNK_RECORDS > 0 ? (int)(total / LOAD_MIN_CHUNK_RECORDS) : 1;
+    }
+    LoadTask tasks[MAX_LOADER_THREADS + 1];
+    memset(tasks, 0, sizeof(tasks));
+    Pool pool = POOL_INIT(Booking, 4096);
+    for (int c = 0; c < chunks; c++) {
+        tasks[c].run = parseSnapshotChunk;
+        tasks[c].records = data + header->bookingOffset;
+        tasks[c].version = header->version;
+        tasks[c].first = (uint32_t)((uint64_t)total * (chunks - 1 - c) / chunks);
+        tasks[c].last = (uint32_t)((uint64_t)total * (chunks - c) / chunks);
+        tasks[c].pool = pool;
+    }
+    tasks[chunks].run = loadSnapshotFlights;
+    tasks[chunks].records = data + header->flightOffset;
+    tasks[chunks].last = header->flightCount;
+    runLoadTasks(tasks, chunks + 1);
+    startupReport.chunks = chunks;
+    double mark = startupPhase("parse bookings", start, 0);
+    addStartupPhase("flights", tasks[chunks].ms, 1);
+
+    spliceLoaded(tasks, chunks);
+    buildLoaded(1, mark);
+    releaseLoaded();
+    mark = nowNanos();
+
+    const SnapshotCancelV2 *requests = (const SnapshotCancelV2 *)(data + header->cancelOffset);
+    const SnapshotCancelV1 *requestsV1 = (const SnapshotCancelV1 *)(data + header->cancelOffset);
+    for (uint32_t i = 0; i < header->cancelCount; i++) {
+        SnapshotCancelV2 upgraded;
+        const SnapshotCancelV2 *record = &requests[i];
+        if (v1) {
+            upgradeCancelV1(&requestsV1[i], &upgraded);
+            record = &upgraded;
+        }
+        CancelRequest *request = allocCancelRequest();
+        memcpy(request->refNo, record->refNo, sizeof(request->refNo));
+        memcpy(request->name, record->name, sizeof(request->name));
+        request->flight = flightCode(record->flightID, 1);
+        request->date = packDate(record->date);
+        request->paise = toPaise(record->payment);
+        if (!enqueueCancelRequest(request)) {
+            freeCancelRequest(request);
+        }
+    }
+
+    munmap((void *)data, info.st_size);
+    startupPhase("cancel requests", mark, 0);
+    return 1;
+}
+
+// Shards. Bookings, flights and cancellation requests are kept in one snapshot file per
+// flight and departure date, shards/<YYYYMMDD>/<flightID>.snap. A change marks its shard
+// in shardTable, and a compaction rewrites only the marked shards.
+
+static size_t hashShard(int dateKey, const char *flightID) {
+    size_t hash = 2166136261u ^ (size_t)dateKey;
+    while (*flightID) {
+        hash ^= (unsigned char)*flightID++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Find the table entry of a shard, adding it when create is set
+static Shard *shardFind(int dateKey, const char *flightID, int create) {
+    if (create && (shardTable.count + 1) * 2 > shardTable.capacity) {
+        size_t capacity = shardTable.capacity ? shardTable.capacity * 2 : 256;
+        Shard *slots = (Shard *)calloc(capacity, sizeof(Shard));
+        if (!slots) {
+            printf("Memory allocation failed for shard table.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < shardTable.capacity; i++) {
+            Shard *old = &shardTable.slots[i];
+            if (old->used) {
+                size_t j = hashShard(old->dateKey, old->flightID) & (capacity - 1);
+                while (slots[j].used) {
+                    j = (j + 1) & (capacity - 1);
+                }
+                slots[j] = *old;
+            }
+        }
+        free(shardTable.slots);
+        shardTable.slots = slots;
+        shardTable.capacity = capacity;
+    }
+    if (shardTable.capacity == 0) {
+        return NULL;
+    }
+    size_t mask = shardTable.capacity - 1;
+    size_t i = hashShard(dateKey, flightID) & mask;
+    while (shardTable.slots[i].used) {
+        Shard *shard = &shardTable.slots[i];
+        if (shard->dateKey == dateKey && strcmp(shard->flightID, flightID) == 0) {
+            return shard;
+        }
+        i = (i + 1) & mask;
+    }
+    if (!create) {
+        return NULL;
+    }
+    Shard *shard = &shardTable.slots[i];
+    shard->used = 1;
+    shard->dateKey = dateKey;
+    snprintf(shard->flightID, sizeof(shard->flightID), "%s", flightID);
+    shardTable.count++;
+    return shard;
+}
+
+// Note a change to the shard holding a record, so the next compaction rewrites it
+void markShard(const char *date, const char *flightID) {
+    if (!shardTable.all) {
+        shardFind(dateKey(date), flightID, 1);
+    }
+}
+
+// The same for a booking or request, from its packed date and flight code
+void markRecordShard(uint32_t date, uint32_t flight) {
+    if (!shardTable.all) {
+        shardFind(packedDateKey(date), flightName(flight), 1);
+    }
+}
+
+static void clearShardTable() {
+    free(shardTable.slots);
+    memset(&shardTable, 0, sizeof(shardTable));
+}
+
+// Path of a shard file. Flight ID characters other than letters, digits, '-' and '_'
+// are written as %XX so any ID makes a valid file name.
+static void shardPath(char *path, int dateKey, const char *flightID) {
+    int length = snprintf(path, SHARD_PATH_SIZE, SHARD_DIR "/%08d/", dateKey);
+    for (const char *c = flightID; *c; c++) {
+        int plain = (*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9') ||
+                    *c == '-' || *c == '_';
+        length += snprintf(path + length, SHARD_PATH_SIZE - length, plain ? "%c" : "%%%02X", (unsigned char)*c);
+    }
+    snprintf(path + length, SHARD_PATH_SIZE - length, ".snap");
+}
+
+static void writeShardBooking(FILE *file, const Booking *b) {
+    SnapshotBooking record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.refNo, b->refNo, sizeof(record.refNo));
+    memcpy(record.name, b->name, sizeof(record.name));
+    char date[DATE_TEXT_SIZE];
+    strcpy(record.flightID, flightName(b->flight));
+    strcpy(record.date, dateText(b->date, date));
+    record.seatNumber = b->seatNumber;
+    record.paise = b->paise;
+    record.cancelRequested = b->cancelRequested;
+    fwrite(&record, sizeof(record), 1, file);
+}
+
+static void writeShardFlight(FILE *file, const Flight *f) {
+    SnapshotFlight record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.flightID, f->flightID, sizeof(record.flightID));
+    memcpy(record.date, f->date, sizeof(record.date));
+    strcpy(record.time, flightTime(f));
+    strcpy(record.destination, flightDestination(f));
+    strcpy(record.source, flightSource(f));
+    record.price = f->price;
+    fwrite(&record, sizeof(record), 1, file);
+}
+
+static void writeShardCancel(FILE *file, const CancelRequest *c) {
+    SnapshotCancel record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.refNo, c->refNo, sizeof(record.refNo));
+    memcpy(record.name, c->name, sizeof(record.name));
+    char date[DATE_TEXT_SIZE];
+    strcpy(record.flightID, flightName(c->flight));
+    strcpy(record.date, dateText(c->date, date));
+    record.paise = c->paise;
+    record.sequence = c->sequence;
+    fwrite(&record, sizeof(record), 1, file);
+}
+
+// Write one shard to path.tmp; returns 0 if the file could not be written
+static int writeShardFile(const char *path, const Shard *shard, Booking **bookings, CancelRequest **cancels) {
+    char tempPath[SHARD_PATH_SIZE + 4];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    FILE *file = fopen(tempPath, "wb");
+    if (!file) {
+        char dir[SHARD_PATH_SIZE];
+        snprintf(dir, sizeof(dir), SHARD_DIR "/%08d", shard->dateKey);
+        mkdir(dir, 0755);
+        file = fopen(tempPath, "wb");
+    }
+    if (!file) {
+        printf("Error opening shard %s.\n", tempPath);
+        return 0;
+    }
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.bookingCount = shard->bookings;
+    header.flightCount = shard->flight ? 1 : 0;
+    header.cancelCount = shard->cancels;
+    header.bookingOffset = sizeof(SnapshotHeader);
+    header.flightOffset = header.bookingOffset + (uint64_t)header.bookingCount * sizeof(SnapshotBooking);
+    header.cancelOffset = header.flightOffset + (uint64_t)header.flightCount * sizeof(SnapshotFlight);
+    fwrite(&header, sizeof(header), 1, file);
+    for (uint32_t i = 0; i < shard->bookings; i++) {
+        writeShardBooking(file, bookings[shard->bookingsAt - shard->bookings + i]);
+    }
+    if (shard->flight) {
+        writeShardFlight(file, shard->flight);
+    }
+    for (uint32_t i = 0; i < shard->cancels; i++) {
+        writeShardCancel(file, cancels[shard->cancelsAt - shard->cancels + i]);
+    }
+    long size = ftell(file);
+    countWrite(size > 0 ? size : 0);
+    int failed = fflush(file) != 0 || ferror(file);
+    failed |= fclose(file) != 0;
+    if (failed) {
+        printf("Error writing shard %s.\n", tempPath);
+        remove(tempPath);
+    }
+    return !failed;
+}
+
+// syncfs the file system holding the shards: one call covers every file written so far
+static int syncShards() {
+    int dir = open(SHARD_DIR, O_RDONLY);
+    if (dir < 0) {
+        return 0;
+    }
+    double start = nowNanos();
+    int ok = syncfs(dir) == 0;
+    __atomic_fetch_add(&fsyncCount, 1, __ATOMIC_RELAXED);
+    metricRecord(METRIC_FSYNC, start);
+    close(dir);
+    return ok;
+}
+
+static int compareShardSources(const void *a, const void *b) {
+    return strcmp(((const ShardSource *)a)->path, ((const ShardSource *)b)->path);
+}
+
+// List the shard files sorted by date and flight; -1 when there is no shards directory
+static long listShardFiles(ShardSource **sources) {
+    DIR *root = opendir(SHARD_DIR);
+    if (!root) {
+        *sources = NULL;
+        return -1;
+    }
+    ShardSource *list = NULL;
+    long count = 0, capacity = 0;
+    struct dirent *day;
+    while ((day = readdir(root))) {
+        if (strlen(day->d_name) != 8 || strspn(day->d_name, "0123456789") != 8) {
+            continue;
+        }
+        char dirPath[SHARD_PATH_SIZE];
+        snprintf(dirPath, sizeof(dirPath), SHARD_DIR "/%.8s", day->d_name);
+        DIR *files = opendir(dirPath);
+        if (!files) {
+            continue;
+        }
+        size_t dirLength = strlen(dirPath);
+        struct dirent *entry;
+        while ((entry = readdir(files))) {
+            size_t length = strlen(entry->d_name);
+            if (length < 6 || strcmp(entry->d_name + length - 5, ".snap") != 0 ||
+                dirLength + 1 + length >= SHARD_PATH_SIZE) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                ShardSource *grown = (ShardSource *)realloc(list, capacity * sizeof(ShardSource));
+                if (!grown) {
+                    printf("Memory allocation failed for shard list.\n");
+                    exit(1);
+                }
+                list = grown;
+            }
+            ShardSource *source = &list[count++];
+            memcpy(source->path, dirPath, dirLength);
+            source->path[dirLength] = '/';
+            memcpy(source->path + dirLength + 1, entry->d_name, length + 1);
+            source->data = NULL;
+            source->size = 0;
+        }
+        closedir(files);
+    }
+    closedir(root);
+    qsort(list, count, sizeof(ShardSource), compareShardSources);
+    *sources = list;
+    return count;
+}
+
+// Remove a shard file and its date directory once that is empty
+static void removeShardFile(const char *path) {
+    if (remove(path) == 0) {
+        char dir[SHARD_PATH_SIZE];
+        snprintf(dir, sizeof(dir), "%s", path);
+        *strrchr(dir, '/') = '\0';
+        rmdir(dir);
+    }
+}
+
+// Rewrite the shards marked in shardTable, or every shard when shardTable.all is set.
+// New files are written beside the old ones, synced together with one syncfs, then
+// renamed into place. Shards left without records are removed.
+static int saveShards() {
+    int all = shardTable.all;
+    if (!all && shardTable.count == 0) {
+        return 1;
+    }
+    mkdir(SHARD_DIR, 0755);
+    if (all) {
+        for (Booking *b = head; b; b = b->next) {
+            if (!b->archived) shardFind(packedDateKey(b->date), flightName(b->flight), 1);
+        }
+        for (Flight *f = flightHead; f; f = f->next) {
+            if (!f->archived) shardFind(dateKey(f->date), f->flightID, 1);
+        }
+    }
+
+    // Count the records of each marked shard, remembering where every booking goes
+    size_t bookingCount = 0;
+    for (Booking *b = head; b; b = b->next) bookingCount++;
+    Shard **bookingShard = (Shard **)malloc((bookingCount + 1) * sizeof(Shard *));
+    Shard **cancelShard = (Shard **)malloc((cancelQueue.tail - cancelQueue.head + 1) * sizeof(Shard *));
+    if (!bookingShard || !cancelShard) {
+        printf("Memory allocation failed for shard save.\n");
+        exit(1);
+    }
+    size_t i = 0;
+    for (Booking *b = head; b; b = b->next, i++) {
+        bookingShard[i] = b->archived ? NULL : shardFind(packedDateKey(b->date), flightName(b->flight), 0);
+        if (bookingShard[i]) bookingShard[i]->bookings++;
+    }
+    for (Flight *f = flightHead; f; f = f->next) {
+        Shard *shard = f->archived ? NULL : shardFind(dateKey(f->date), f->flightID, 0);
+        if (shard && !shard->flight) shard->flight = f;
+    }
+    for (size_t q = cancelQueue.head; q < cancelQueue.tail; q++) {
+        CancelRequest *c = cancelQueue.slots[q];
+        Booking *booking = c ? bookingIndexFind(&bookingIndex, c->refNo) : NULL;
+        Shard *shard = c && !(booking && booking->archived) ? shardFind(packedDateKey(c->date), flightName(c->flight), 0) : NULL;
+        cancelShard[q - cancelQueue.head] = shard;
+        if (shard) shard->cancels++;
+    }
+
+    // Lay the records out shard by shard, keeping list and queue order within each
+    size_t bookingTotal = 0, cancelTotal = 0;
+    for (size_t s = 0; s < shardTable.capacity; s++) {
+        Shard *shard = &shardTable.slots[s];
+        if (shard->used) {
+            shard->bookingsAt = bookingTotal;
+            shard->cancelsAt = cancelTotal;
+            bookingTotal += shard->bookings;
+            cancelTotal += shard->cancels;
+        }
+    }
+    Booking **bookings = (Booking **)malloc((bookingTotal + 1) * sizeof(Booking *));
+    CancelRequest **cancels = (CancelRequest **)malloc((cancelTotal + 1) * sizeof(CancelRequest *));
+    if (!bookings || !cancels) {
+        printf("Memory allocation failed for shard save.\n");
+        exit(1);
+    }
+    i = 0;
+    for (Booking *b = head; b; b = b->next, i++) {
+        if (bookingShard[i]) bookings[bookingShard[i]->bookingsAt++] = b;
+    }
+    for (size_t q = cancelQueue.head; q < cancelQueue.tail; q++) {
+        Shard *shard = cancelShard[q - cancelQueue.head];
+        if (shard) cancels[shard->cancelsAt++] = cancelQueue.slots[q];
+    }
+    free(bookingShard);
+    free(cancelShard);
+
+    // Write the new files, then sync them once and rename them over the old ones
+    char (*written)[SHARD_PATH_SIZE] = (char (*)[SHARD_PATH_SIZE])malloc((shardTable.count + 1) * SHARD_PATH_SIZE);
+    if (!written) {
+        printf("Memory allocation failed for shard save.\n");
+        exit(1);
+    }
+    size_t writtenCount = 0;
+    int ok = 1;
+    for (size_t s = 0; s < shardTable.capacity && ok; s++) {
+        Shard *shard = &shardTable.slots[s];
+        if (!shard->used) {
+            continue;
+        }
+        char path[SHARD_PATH_SIZE];
+        shardPath(path, shard->dateKey, shard->flightID);
+        if (!shard->bookings && !shard->cancels && !shard->flight) {
+            removeShardFile(path);
+        } else if (writeShardFile(path, shard, bookings, cancels)) {
+            memcpy(written[writtenCount++], path, SHARD_PATH_SIZE);
+        } else {
+            ok = 0;
+        }
+    }
+    free(bookings);
+    free(cancels);
+    ok = ok && syncShards();
+    for (size_t w = 0; w < writtenCount; w++) {
+        char tempPath[SHARD_PATH_SIZE + 4];
+        snprintf(tempPath, sizeof(tempPath), "%s.tmp", written[w]);
+        if (!ok || rename(tempPath, written[w]) != 0) {
+            remove(tempPath);
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        printf("Error writing shards, keeping the journal.\n");
+        free(written);
+        for (size_t s = 0; s < shardTable.capacity; s++) {
+            shardTable.slots[s].bookings = shardTable.slots[s].cancels = 0;
+            shardTable.slots[s].flight = NULL;
+        }
+        return 0;
+    }
+
+    // A full rewrite also drops shard files that no longer match any record
+    if (all) {
+        qsort(written, writtenCount, SHARD_PATH_SIZE, (int (*)(const void *, const void *))strcmp);
+        ShardSource *existing = NULL;
+        long existingCount = listShardFiles(&existing);
+        for (long e = 0; e < existingCount; e++) {
+            if (!bsearch(existing[e].path, written, writtenCount, SHARD_PATH_SIZE,
+                         (int (*)(const void *, const void *))strcmp)) {
+                removeShardFile(existing[e].path);
+            }
+        }
+        free(existing);
+    }
+    free(written);
+    syncShards();
+    clearShardTable();
+    return 1;
+}
+
+// Read a whole shard file into *buffer, growing it as needed; returns the size
+static size_t readShardFile(const char *path, char **buffer, size_t *capacity) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        printf("Error reading shard %s.\n", path);
+        exit(1);
+    }
+    size_t size = info.st_size;
+    if (size > *capacity) {
+        char *grown = (char *)realloc(*buffer, size);
+        if (!grown) {
+            printf("Memory allocation failed for shard %s.\n", path);
+            exit(1);
+        }
+        *buffer = grown;
+        *capacity = size;
+    }
+    for (size_t done = 0; done < size;) {
+        ssize_t count = read(fd, *buffer + done, size - done);
+        if (count <= 0) {
+            printf("Error reading shard %s.\n", path);
+            exit(1);
+        }
+        done += count;
+    }
+    close(fd);
+    countRead(size);
+    return size;
+}
+
+// Check a shard image and return its header; a damaged shard stops the load like a
+// damaged snapshot does
+static SnapshotHeader checkShard(const char *data, size_t size, const char *path) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    if (size >= sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+    }
+    if (size < sizeof(header) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version < 3 || header.version > SNAPSHOT_VERSION ||
+        header.cancelOffset + (uint64_t)header.cancelCount * sizeof(SnapshotCancel) > size ||
+        header.flightOffset + (uint64_t)header.flightCount * sizeof(SnapshotFlight) > header.cancelOffset ||
+        header.bookingOffset + (uint64_t)header.bookingCount * snapshotBookingSize(header.version) >
+            header.flightOffset) {
+        printf("Shard %s is damaged.\n", path);
+        exit(1);
+    }
+    return header;
+}
+
+// Append a fixed-width record to a growing array; returns the array
+static void *appendRecord(void *array, uint32_t *count, uint32_t *capacity, const void *record, size_t size) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        array = realloc(array, (size_t)*capacity * size);
+        if (!array) {
+            printf("Memory allocation failed for shard records.\n");
+            exit(1);
+        }
+    }
+    memcpy((char *)array + (size_t)(*count)++ * size, record, size);
+    return array;
+}
+
+// Parse a range of shard images, last to first, into the task's pool and record arrays
+static void parseShardChunk(LoadTask *task) {
+    char *buffer = NULL;
+    size_t capacity = 0;
+    for (uint32_t i = task->last; i-- > task->first;) {
+        ShardSource *source = &task->shards[i];
+        const char *data = source->data;
+        size_t size = source->size;
+        if (!data) {
+            size = readShardFile(source->path, &buffer, &capacity);
+            data = buffer;
+        }
+        SnapshotHeader header = checkShard(data, size, source->path);
+        for (uint32_t r = header.bookingCount; r-- > 0;) {
+            Booking *booking = (Booking *)poolAlloc(&task->pool);
+            copySnapshotBooking(data + header.bookingOffset, r, header.version, booking);
+            pushLoaded(task, booking);
+            booking->archived = (char)task->archived;
+        }
+        for (uint32_t r = header.flightCount; r-- > 0;) {
+            task->flights = (SnapshotFlight *)appendRecord(task->flights, &task->flightCount, &task->flightCapacity,
+                                                           data + header.flightOffset + r * sizeof(SnapshotFlight),
+                                                           sizeof(SnapshotFlight));
+        }
+        for (uint32_t r = header.cancelCount; r-- > 0;) {
+            SnapshotCancel upgraded;
+            const void *record = data + header.cancelOffset + r * sizeof(SnapshotCancel);
+            if (header.version < 4) {
+                upgradeCancelV3((const SnapshotCancelV3 *)record, &upgraded);
+                record = &upgraded;
+            }
+            task->cancels = (SnapshotCancel *)appendRecord(task->cancels, &task->cancelCount, &task->cancelCapacity,
+                                                           record, sizeof(SnapshotCancel));
+        }
+    }
+    free(buffer);
+}
+
+static int compareCancelSequence(const void *a, const void *b) {
+    const SnapshotCancel *x = (const SnapshotCancel *)a, *y = (const SnapshotCancel *)b;
+    return (x->sequence > y->sequence) - (x->sequence < y->sequence);
+}
+
+// Parse shard images on the loader threads and link their records into the store the
+// way the single-file loader does. Archived records are flagged read-only.
+static void loadShardSources(ShardSource *sources, uint32_t count, int archived, double since) {
+    int chunks = startupThreads();
+    if ((uint32_t)chunks > count) {
+        chunks = count > 0 ? (int)count : 1;
+    }
+    LoadTask tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+    Pool pool = POOL_INIT(Booking, 4096);
+    for (int c = 0; c < chunks; c++) {
+        tasks[c].run = parseShardChunk;
+        tasks[c].shards = sources;
+        tasks[c].archived = archived;
+        tasks[c].first = (uint32_t)((uint64_t)count * (chunks - 1 - c) / chunks);
+        tasks[c].last = (uint32_t)((uint64_t)count * (chunks - c) / chunks);
+        tasks[c].pool = pool;
+    }
+    runLoadTasks(tasks, chunks);
+    startupReport.chunks = chunks;
+    double mark = startupPhase("parse shards", since, 0);
+
+    // Flights in file order, after any already in the list
+    Flight *flightTail = flightHead;
+    while (flightTail && flightTail->next) {
+        flightTail = flightTail->next;
+    }
+    uint32_t cancelCount = 0;
+    for (int c = chunks - 1; c >= 0; c--) {
+        for (uint32_t k = tasks[c].flightCount; k-- > 0;) {
+            const SnapshotFlight *record = &tasks[c].flights[k];
+            Flight *flight = allocFlight();
+            memcpy(flight->flightID, record->flightID, sizeof(flight->flightID));
+            memcpy(flight->date, record->date, sizeof(flight->date));
+            setFlightRecordText(flight, record);
+            flight->price = record->price;
+            flight->archived = (char)archived;
+            flight->seats = NULL;
+            flight->next = NULL;
+            setFlightRoute(flight);
+            if (!flightIndexFind(&flightIndex, flight->flightID)) {
+                flightIndexInsert(&flightIndex, flight);
+            }
+            if (flightTail) {
+                flightTail->next = flight;
+            } else {
+                flightHead = flight;
+            }
+            flightTail = flight;
+        }
+        cancelCount += tasks[c].cancelCount;
+    }
+    mark = startupPhase("flights", mark, 0);
+
+    spliceLoaded(tasks, chunks);
+    buildLoaded(1, mark);
+    releaseLoaded();
+    mark = nowNanos();
+
+    // Requests from every shard, back in the order they arrived
+    SnapshotCancel *requests = (SnapshotCancel *)malloc((cancelCount + 1) * sizeof(SnapshotCancel));
+    if (!requests) {
+        printf("Memory allocation failed for cancellation requests.\n");
+        exit(1);
+    }
+    uint32_t n = 0;
+    for (int c = 0; c < chunks; c++) {
+        memcpy(requests + n, tasks[c].cancels, tasks[c].cancelCount * sizeof(SnapshotCancel));
+        n += tasks[c].cancelCount;
+        free(tasks[c].flights);
+        free(tasks[c].cancels);
+    }
+    qsort(requests, n, sizeof(SnapshotCancel), compareCancelSequence);
+    for (uint32_t r = 0; r < n; r++) {
+        CancelRequest *request = allocCancelRequest();
+        memcpy(request->refNo, requests[r].refNo, sizeof(request->refNo));
+        memcpy(request->name, requests[r].name, sizeof(request->name));
+        request->flight = flightCode(requests[r].flightID, 1);
+        request->date = packDate(requests[r].date);
+        request->paise = requests[r].paise;
+        request->sequence = requests[r].sequence;
+        if (!enqueueCancelRequest(request)) {
+            freeCancelRequest(request);
+        }
+    }
+    free(requests);
+    startupPhase("cancel requests", mark, 0);
+}
+
+// Load the store from its shards, or from a single-file snapshot written before shards
+// existed (rewritten as shards by the next compaction). Returns 0 if there is neither.
+int loadSnapshot() {
+    double start = nowNanos();
+    ShardSource *sources = NULL;
+    long count = listShardFiles(&sources);
+    if (count < 0) {
+        int loaded = loadSingleSnapshot();
+        shardTable.all |= loaded;
+        return loaded;
+    }
+    double mark = startupPhase("list shards", start, 0);
+    loadShardSources(sources, (uint32_t)count, 0, mark);
+    free(sources);
+    return 1;
+}
+
+// Archives. packBytes is a small LZ77 in the LZ4 sequence format: a token holding the
+// literal count and match length, extra length bytes of 255 when either reaches 15, the
+// literals, then a 16-bit little-endian match offset. The last sequence has no match.
+
+static size_t packLength(unsigned char *out, size_t o, size_t rest) {
+    while (rest >= 255) {
+        out[o++] = 255;
+        rest -= 255;
+    }
+    out[o++] = (unsigned char)rest;
+    return o;
+}
+
+static size_t packSequence(unsigned char *out, size_t o, const char *literals, size_t literalCount,
+                           size_t offset, size_t matchLength) {
+    size_t extra = matchLength ? matchLength - 4 : 0;
+    out[o++] = (unsigned char)((literalCount < 15 ? literalCount : 15) << 4 | (extra < 15 ? extra : 15));
+    if (literalCount >= 15) {
+        o = packLength(out, o, literalCount - 15);
+    }
+    memcpy(out + o, literals, literalCount);
+    o += literalCount;
+    if (matchLength) {
+        out[o++] = (unsigned char)(offset & 0xFF);
+        out[o++] = (unsigned char)(offset >> 8);
+        if (extra >= 15) {
+            o = packLength(out, o, extra - 15);
+        }
+    }
+    return o;
+}
+
+// Compress size bytes; returns a malloc'd buffer and its length in *packedSize
+static char *packBytes(const char *in, size_t size, size_t *packedSize) {
+    unsigned char *out = (unsigned char *)malloc(size + size / 255 + 16);
+    uint32_t *table = (uint32_t *)calloc((size_t)1 << PACK_HASH_BITS, sizeof(uint32_t));
+    if (!out || !table) {
+        printf("Memory allocation failed for archive.\n");
+        exit(1);
+    }
+    size_t pos = 0, anchor = 0, o = 0;
+    while (pos + 8 <= size) {
+        uint32_t word;
+        memcpy(&word, in + pos, sizeof(word));
+        uint32_t slot = (word * 2654435761u) >> (32 - PACK_HASH_BITS);
+        size_t candidate = table[slot];  // Position + 1 of the last run of these four bytes
+        table[slot] = (uint32_t)(pos + 1);
+        if (candidate == 0 || pos + 1 - candidate > 65535 || memcmp(in + candidate - 1, in + pos, 4) != 0) {
+            pos++;
+            continue;
+        }
+        candidate--;
+        size_t length = 4;
+        while (pos + length < size && in[candidate + length] == in[pos + length]) {
+            length++;
+        }
+        o = packSequence(out, o, in + anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+    o = packSequence(out, o, in + anchor, size - anchor, 0, 0);
+    free(table);
+    *packedSize = o;
+    return (char *)out;
+}
+
+static int unpackLength(const unsigned char **in, const unsigned char *end, size_t *length) {
+    unsigned char byte;
+    do {
+        if (*in == end) {
+            return 0;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+// Expand packBytes output into exactly rawSize bytes; returns 0 if the input is damaged
+static int unpackBytes(const char *packed, size_t packedSize, char *out, size_t rawSize) {
+    const unsigned char *in = (const unsigned char *)packed, *end = in + packedSize;
+    size_t o = 0;
+    while (in < end) {
+        unsigned token = *in++;
+        size_t literals = token >> 4, length = (token & 15) + 4;
+        if ((literals == 15 && !unpackLength(&in, end, &literals)) || literals > (size_t)(end - in) ||
+            literals > rawSize - o) {
+            return 0;
+        }
+        memcpy(out + o, in, literals);
+        in += literals;
+        o += literals;
+        if (in == end) {
+            break;
+        }
+        if (end - in < 2) {
+            return 0;
+        }
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+        if ((length == 19 && !unpackLength(&in, end, &length)) || offset == 0 || offset > o ||
+            length > rawSize - o) {
+            return 0;
+        }
+        for (size_t i = 0; i < length; i++, o++) {
+            out[o] = out[o - offset];  // Byte by byte, the match may overlap its own output
+        }
+    }
+    return o == rawSize;
+}
+
+static int compareArchives(const void *a, const void *b) {
+    return ((const Archive *)a)->header.dateKey - ((const Archive *)b)->header.dateKey;
+}
+
+// Map every archive so refNo lookups can search its table; the records stay packed
+// until something needs them
+static void scanArchives() {
+    DIR *dir = opendir(ARCHIVE_DIR);
+    if (!dir) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strlen(entry->d_name) != 12 || strcmp(entry->d_name + 8, ".arc") != 0) {
+            continue;
+        }
+        Archive archive;
+        memset(&archive, 0, sizeof(archive));
+        snprintf(archive.path, sizeof(archive.path), ARCHIVE_DIR "/%.12s", entry->d_name);
+        int fd = open(archive.path, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ArchiveHeader)) {
+            printf("Archive %s is damaged.\n", archive.path);
+            exit(1);
+        }
+        archive.size = info.st_size;
+        void *data = mmap(NULL, archive.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            printf("Error mapping archive %s.\n", archive.path);
+            exit(1);
+        }
+        madvise(data, archive.size, MADV_RANDOM);
+        archive.data = (const char *)data;
+        memcpy(&archive.header, data, sizeof(ArchiveHeader));
+        ArchiveHeader *header = &archive.header;
+        if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) != 0 || header->version != ARCHIVE_VERSION ||
+            header->refNoOffset + (uint64_t)header->bookingCount * REFNO_SIZE > header->packedOffset ||
+            header->packedOffset + header->packedSize > archive.size) {
+            printf("Archive %s is damaged.\n", archive.path);
+            exit(1);
+        }
+        Archive *grown = (Archive *)realloc(archives, (archiveCount + 1) * sizeof(Archive));
+        if (!grown) {
+            printf("Memory allocation failed for archives.\n");
+            exit(1);
+        }
+        archives = grown;
+        archives[archiveCount++] = archive;
+    }
+    closedir(dir);
+    qsort(archives, archiveCount, sizeof(Archive), compareArchives);
+}
+
+static void releaseArchives() {
+    for (int i = 0; i < archiveCount; i++) {
+        munmap((void *)archives[i].data, archives[i].size);
+    }
+    free(archives);
+    archives = NULL;
+    archiveCount = 0;
+}
+
+static int compareRefNos(const void *a, const void *b) {
+    return strncmp((const char *)a, (const char *)b, REFNO_SIZE);
+}
+
+// The archive, not loaded yet, whose bookings include refNo
+static Archive *archiveHolding(const char *refNo) {
+    for (int i = 0; i < archiveCount; i++) {
+        Archive *archive = &archives[i];
+        if (!archive->loaded && bsearch(refNo, archive->data + archive->header.refNoOffset,
+                                        archive->header.bookingCount, REFNO_SIZE, compareRefNos)) {
+            return archive;
+        }
+    }
+    return NULL;
+}
+
+// Split an unpacked archive into its shard images; returns the count, or -1 if damaged
+static long archiveImages(char *raw, size_t rawSize, ShardSource *sources, uint32_t capacity, const char *path) {
+    long count = 0;
+    size_t at = 0;
+    while (at < rawSize) {
+        uint64_t size;
+        if (rawSize - at < sizeof(size) || (uint32_t)count == capacity) {
+            return -1;
+        }
+        memcpy(&size, raw + at, sizeof(size));
+        at += sizeof(size);
+        if (size > rawSize - at) {
+            return -1;
+        }
+        snprintf(sources[count].path, SHARD_PATH_SIZE, "%s", path);
+        sources[count].data = raw + at;
+        sources[count++].size = size;
+        at += (size + 7) & ~(uint64_t)7;
+    }
+    return count;
+}
+
+// Unpack an archive and link its records into the store, read-only. Caller holds the
+// store lock exclusively.
+static int loadArchive(Archive *archive) {
+    double start = nowNanos();
+    const ArchiveHeader *header = &archive->header;
+    char *raw = (char *)malloc(header->rawSize + 1);
+    ShardSource *sources = (ShardSource *)malloc((header->shardCount + 1) * sizeof(ShardSource));
+    long count = -1;
+    if (raw && sources && unpackBytes(archive->data + header->packedOffset, header->packedSize, raw, header->rawSize)) {
+        count = archiveImages(raw, header->rawSize, sources, header->shardCount, archive->path);
+    }
+    if (count != (long)header->shardCount) {
+        printf("Archive %s is damaged.\n", archive->path);
+        free(raw);
+        free(sources);
+        return 0;
+    }
+    countRead(header->packedSize);
+    loadShardSources(sources, (uint32_t)count, 1, start);
+    for (Flight *flight = flightHead; flight; flight = flight->next) {
+        if (flight->archived && !flight->seats) {
+            flight->seats = findSeatMap(flight->flightID);
+        }
+    }
+    free(raw);
+    free(sources);
+    archive->loaded = 1;
+    return 1;
+}
+
+// Load the archives of departure dates from fromKey to toKey (0 leaves that end open).
+// Returns how many were loaded.
+int loadArchives(int fromKey, int toKey) {
+    int loaded = 0;
+    for (int i = 0; i < archiveCount; i++) {
+        Archive *archive = &archives[i];
+        if (!archive->loaded && (!fromKey || archive->header.dateKey >= fromKey) &&
+            (!toKey || archive->header.dateKey <= toKey)) {
+            loaded += loadArchive(archive);
+        }
+    }
+    return loaded;
+}
+
+// Find a booking by refNo, loading the archive that holds it when it is not in memory.
+// Caller holds the store lock exclusively.
+Booking *findStoredBooking(const char *refNo) {
+    Booking *booking = bookingIndexFind(&bookingIndex, refNo);
+    if (!booking) {
+        Archive *archive = archiveHolding(refNo);
+        if (archive && loadArchive(archive)) {
+            booking = bookingIndexFind(&bookingIndex, refNo);
+        }
+    }
+    return booking && !booking->removed ? booking : NULL;
+}
+
+// Bookings and revenue of archived days that are not loaded, from the archive headers
+void printArchivedTotals() {
+    long days = 0, bookings = 0;
+    int64_t revenue = 0;
+    for (int i = 0; i < archiveCount; i++) {
+        if (!archives[i].loaded) {
+            days++;
+            bookings += archives[i].header.bookingCount;
+            revenue += archives[i].header.revenue;
+        }
+    }
+    if (days > 0) {
+        printf("Archived (not loaded): %ld bookings, %.2f Rs over %ld days\n", bookings, revenue / 100.0, days);
+    }
+}
+
+// Print every archive with the totals from its header
+void listArchives() {
+    printf("Date       | Flights | Bookings | Revenue (Rs) | Size KB | Packed KB\n");
+    for (int i = 0; i < archiveCount; i++) {
+        const ArchiveHeader *header = &archives[i].header;
+        printf("%02d/%02d/%04d | %7u | %8u | %12.2f | %7.1f | %9.1f\n", header->dateKey % 100,
+               header->dateKey / 100 % 100, header->dateKey / 10000, header->flightCount, header->bookingCount,
+               header->revenue / 100.0, header->rawSize / 1024.0, header->packedSize / 1024.0);
+    }
+}
+
+// Append a shard image to an archive's raw buffer as its size, the bytes and padding
+static void appendImage(char **raw, size_t *rawSize, size_t *capacity, const char *data, size_t size) {
+    size_t needed = *rawSize + sizeof(uint64_t) + ((size + 7) & ~(size_t)7);
+    if (needed > *capacity) {
+        *capacity = needed * 2;
+        char *grown = (char *)realloc(*raw, *capacity);
+        if (!grown) {
+            printf("Memory allocation failed for archive.\n");
+            exit(1);
+        }
+        *raw = grown;
+    }
+    uint64_t length = size;
+    memcpy(*raw + *rawSize, &length, sizeof(length));
+    memcpy(*raw + *rawSize + sizeof(length), data, size);
+    memset(*raw + *rawSize + sizeof(length) + size, 0, needed - *rawSize - sizeof(length) - size);
+    *rawSize = needed;
+}
+
+// Pack one day's shard files, plus the day's earlier archive if there is one, into a
+// new archive, then remove the shard files
+static int archiveDay(int day, ShardSource *files, long fileCount) {
+    ArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = ARCHIVE_VERSION;
+    header.dateKey = day;
+
+    char *raw = NULL;
+    size_t rawSize = 0, capacity = 0;
+    for (int i = 0; i < archiveCount; i++) {
+        const ArchiveHeader *old = &archives[i].header;
+        if (old->dateKey == day) {
+            capacity = old->rawSize + 1;
+            raw = (char *)malloc(capacity);
+            if (!raw || !unpackBytes(archives[i].data + old->packedOffset, old->packedSize, raw, old->rawSize)) {
+                printf("Archive %s is damaged.\n", archives[i].path);
+                free(raw);
+                return 0;
+            }
+            rawSize = old->rawSize;
+        }
+    }
+    char *buffer = NULL;
+    size_t bufferCapacity = 0;
+    for (long f = 0; f < fileCount; f++) {
+        size_t size = readShardFile(files[f].path, &buffer, &bufferCapacity);
+        checkShard(buffer, size, files[f].path);
+        appendImage(&raw, &rawSize, &capacity, buffer, size);
+    }
+    free(buffer);
+
+    // Totals and the sorted refNo table come from the combined images
+    uint32_t imageCapacity = (uint32_t)(rawSize / (sizeof(uint64_t) + sizeof(SnapshotHeader)) + 1);
+    ShardSource *images = (ShardSource *)malloc(imageCapacity * sizeof(ShardSource));
+    if (!images) {
+        printf("Memory allocation failed for archive.\n");
+        exit(1);
+    }
+    long imageCount = archiveImages(raw, rawSize, images, imageCapacity, "archive");
+    header.shardCount = (uint32_t)imageCount;
+    for (long k = 0; k < imageCount; k++) {
+        SnapshotHeader shard = checkShard(images[k].data, images[k].size, files[0].path);
+        header.bookingCount += shard.bookingCount;
+        header.flightCount += shard.flightCount;
+        header.cancelCount += shard.cancelCount;
+    }
+    char (*refNos)[REFNO_SIZE] = (char (*)[REFNO_SIZE])calloc(header.bookingCount + 1, REFNO_SIZE);
+    if (!refNos) {
+        printf("Memory allocation failed for archive.\n");
+        exit(1);
+    }
+    uint32_t n = 0;
+    for (long k = 0; k < imageCount; k++) {
+        SnapshotHeader shard = checkShard(images[k].data, images[k].size, files[0].path);
+        for (uint32_t r = 0; r < shard.bookingCount; r++) {
+            SnapshotBooking upgraded;
+            const SnapshotBooking *record =
+                snapshotBooking(images[k].data + shard.bookingOffset, r, shard.version, &upgraded);
+            memcpy(refNos[n], record->refNo, strnlen(record->refNo, REFNO_SIZE - 1));
+            header.revenue += record->paise;
+            n++;
+        }
+    }
+    free(images);
+    qsort(refNos, n, REFNO_SIZE, compareRefNos);
+
+    size_t packedSize;
+    char *packed = packBytes(raw, rawSize, &packedSize);
+    header.rawSize = rawSize;
+    header.packedSize = packedSize;
+    header.refNoOffset = sizeof(ArchiveHeader);
+    header.packedOffset = header.refNoOffset + (uint64_t)n * REFNO_SIZE;
+
+    char path[SHARD_PATH_SIZE], tempPath[SHARD_PATH_SIZE + 4];
+    snprintf(path, sizeof(path), ARCHIVE_DIR "/%08d.arc", day);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    FILE *file = fopen(tempPath, "wb");
+    int ok = file != NULL;
+    if (file) {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(refNos, REFNO_SIZE, n, file);
+        fwrite(packed, 1, packedSize, file);
+        ok = commitFile(file, tempPath, path);
+    } else {
+        printf("Error opening archive %s.\n", tempPath);
+    }
+    free(packed);
+    free(refNos);
+    free(raw);
+    if (!ok) {
+        return 0;
+    }
+    for (long f = 0; f < fileCount; f++) {
+        removeShardFile(files[f].path);
+    }
+    printf("%02d/%02d/%04d: %u flights, %u bookings, %.1f KB packed into %.1f KB\n", day % 100, day / 100 % 100,
+           day / 10000, header.flightCount, header.bookingCount, rawSize / 1024.0, packedSize / 1024.0);
+    return 1;
+}
+
+// Pack every live shard departing before beforeKey into its day's archive. The shards
+// must hold every change, so callers compact the journal first. Returns the number of
+// days archived, or -1 on error.
+int archiveShards(int beforeKey) {
+    ShardSource *files = NULL;
+    long count = listShardFiles(&files);
+    mkdir(ARCHIVE_DIR, 0755);
+    int days = 0;
+    long first = 0;
+    while (first < count) {
+        // Paths sort by date, so each day's files are adjacent
+        long last = first + 1;
+        while (last < count && strncmp(files[last].path, files[first].path, sizeof(SHARD_DIR) + 8) == 0) {
+            last++;
+        }
+        int day = atoi(files[first].path + sizeof(SHARD_DIR));
+        if (day > 0 && day < beforeKey) {
+            if (!archiveDay(day, files + first, last - first)) {
+                free(files);
+                return -1;
+            }
+            days++;
+        }
+        first = last;
+    }
+    free(files);
+    syncShards();
+    return days;
+}
+
+// Today's date as a YYYYMMDD key
+int todayKey() {
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    return (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday;
+}
+
+// Write the changed shards. A single-file snapshot left by an older version is removed
+// once its records live in shards.
+int saveSnapshot() {
+    double start = nowNanos();
+    finishFlightRemovals();
+    int ok = saveShards();
+    if (ok) {
+        remove(SNAPSHOT_FILE);
+    }
+    metricRecord(METRIC_SNAPSHOT, start);
+    return ok;
+}
+
+// Export the store as CSV files for other tools
+int exportCSV() {
+    double start = nowNanos();
+    int ok = saveDataToCSV() && saveFlightsToFile() && saveCancelRequestsToFile();
+    metricRecord(METRIC_EXPORT, start);
+    return ok;
+}
+
+// Load bookings, flights and cancellation requests, then replay the journal.
+// The CSV files are only read when there is no snapshot or an import is requested.
+// Each phase is timed into startupReport.
+void loadStore(int fromCSV) {
+    double start = nowNanos();
+    memset(&startupReport, 0, sizeof(startupReport));
+    startupReport.threads = startupThreads();
+    scanArchives();
+    if (fromCSV || !loadSnapshot()) {
+        shardTable.all = 1;  // The next compaction writes every shard
+        loadDataFromCSV();
+        createCSVIfNotExists();  // Initialize the booking CSV file if not exist
+        double mark = nowNanos();
+        loadFlightsFromFile();  // Load available flights from file
+        mark = startupPhase("flights", mark, 0);
+        rebuildRouteIndex();
+        mark = startupPhase("route index", mark, 0);
+        createCancellationFileIfNotExists();
+        loadCancelRequestsFromFile();
+        startupPhase("cancel requests", mark, 0);
+    }
+    double mark = nowNanos();
+    loadSeatInventory();
+    mark = startupPhase("seat inventory", mark, 0);
+    attachSeatMaps();
+    mark = startupPhase("attach seat maps", mark, 0);
+    replayJournal();  // Apply operations made since the last snapshot
+    mark = startupPhase("journal replay", mark, 0);
+    openJournal();
+    seedRefNoGenerator();
+    startupPhase("refNo generator", mark, 0);
+    metricRecord(METRIC_LOAD, start);
+}
+
+// Release every booking, flight and cancellation request held in memory
+void freeStore() {
+    discardFlightRemovals();
+    drainRetired();  // Nothing reads the store any more
+    free(flightSnapshot);
+    flightSnapshot = NULL;
+    poolRelease(&bookingPool);
+    poolRelease(&flightPool);
+    poolRelease(&cancelPool);
+    head = NULL;
+    flightHead = NULL;
+    routeIndex.dirty = 1;
+    resetAggregates();
+    freeBookingColumns();
+
+    free(cancelQueue.slots);
+    memset(&cancelQueue, 0, sizeof(cancelQueue));
+
+    if (bookingIndex.slots) {
+        releaseIndexSlots(bookingIndex.slots);
+    }
+    bookingIndex.slots = NULL;
+    bookingIndex.capacity = bookingIndex.count = bookingIndex.tombstones = 0;
+    free(flightIndex.byCode);
+    memset(&flightIndex, 0, sizeof(flightIndex));
+    freeDictionary(&flightDictionary);
+    freeDictionary(&airportDictionary);
+    freeDictionary(&dateDictionary);
+    freeDictionary(&timeDictionary);
+    __atomic_fetch_add(&flightListVersion, 1, __ATOMIC_RELEASE);
+    clearShardTable();
+    releaseArchives();
+    cancelSequence = 0;
+}
+
+// Journal text of a confirmed booking into line (JOURNAL_LINE_SIZE bytes), newline
+// included; returns its length
+static int bookingRecord(const Booking *booking, char *line) {
+    char date[DATE_TEXT_SIZE];
+    int length = snprintf(line, JOURNAL_LINE_SIZE, "B,%s,%s,%s,%s,%d,%.2f\n", booking->refNo, booking->name,
+                          flightName(booking->flight), dateText(booking->date, date), booking->seatNumber,
+                          booking->paise / 100.0);
+    return length < JOURNAL_LINE_SIZE ? length : JOURNAL_LINE_SIZE - 1;
+}
+
+// Note the flight and seat map seats are about to be claimed from, and hold back the
+// seat words this thread changes until endSeatClaim. Caller holds storeLock.
+static void beginSeatClaim(SeatClaim *claim, const Flight *flight) {
+    memset(claim, 0, sizeof(*claim));
+    if (!flight || !flight->seats) {
+        return;
+    }
+    strcpy(claim->flightID, flight->flightID);
+    claim->serial = flight->seats->serial;
+    claim->map = flight->seats;
+    pendingSeatMap = claim->map;
+    pendingFrom = claim->map->wordCount;
+    pendingTo = 0;
+}
+
+static void endSeatClaim(SeatClaim *claim) {
+    if (claim->map) {
+        claim->from = pendingFrom;
+        claim->to = pendingTo;
+    }
+    pendingSeatMap = NULL;
+}
+
+// Journal the records of a claim or release, then write the seat words it held back.
+// Journal first: a seat taken for a booking the journal lost would stay taken, and one
+// freed for an approval it lost could be sold twice.
+void journalSeatChange(SeatClaim *claim, const char *lines, size_t length, int records) {
+    unwrittenClaim = claim;  // A compaction set off by the append writes them first
+    journalAppendLines(lines, length, records);
+    unwrittenClaim = NULL;
+    writeSeatWords(claim->map, claim->from, claim->to);
+}
+
+// Whether a claim's flight still has the seat map it was claimed from. A flight removed
+// since, and maybe added again, dropped that map with the claimed seats in it, so there
+// is nothing left to give back. Caller holds storeLock.
+static int seatClaimCurrent(const SeatClaim *claim) {
+    Flight *flight = findFlight((char *)claim->flightID);
+    return flight && flight->seats && flight->seats->serial == claim->serial;
+}
+
+// Add and journal the booking of a seat that has already been claimed. Returns 0, booking
+// nothing, if the flight was removed after the claim.
+static int recordBooking(SeatClaim *claim, uint32_t flight, uint32_t date, float price, int seatNumber,
+                         const char *name, char *refNo) {
+    pthread_rwlock_wrlock(&storeLock);
+    if (!seatClaimCurrent(claim)) {
+        pthread_rwlock_unlock(&storeLock);
+        return 0;
+    }
+    Booking *booking = allocBooking();
+    memset(booking->name, 0, sizeof(booking->name));
+    strncpy(booking->name, name, sizeof(booking->name) - 1);
+    booking->flight = flight;
+    booking->date = date;
+    booking->seatNumber = seatNumber;
+    booking->paise = toPaise(price);
+    booking->cancelRequested = 0;
+
+    // Generated numbers never repeat; the check only guards against imported data
+    do {
+        generateRefNo(booking->refNo);
+    } while (bookingIndexFind(&bookingIndex, booking->refNo));
+
+    linkBooking(booking);
+    char line[JOURNAL_LINE_SIZE];
+    journalSeatChange(claim, line, bookingRecord(booking, line), 1);
+    strcpy(refNo, booking->refNo);
+    pthread_rwlock_unlock(&storeLock);
+    return 1;
+}
+
+// Add the bookings of a group whose seats have already been claimed: one per seat, the
+// passengers named in order and the rest after the first. Members take consecutive
+// reference numbers, and their journal records go out in one write. Returns 0, booking
+// nothing, if the flight was removed after the claim.
+static int recordGroup(SeatClaim *claim, uint32_t flight, uint32_t date, float price, const int *seats,
+                       int count, const char *const *names, int nameCount, char *groupRef) {
+    char *lines = (char *)malloc((size_t)(count + 1) * JOURNAL_LINE_SIZE);
+    if (!lines) {
+        printf("Error allocating journal records.\n");
+        exit(1);
+    }
+    pthread_rwlock_wrlock(&storeLock);
+    if (!seatClaimCurrent(claim)) {
+        pthread_rwlock_unlock(&storeLock);
+        free(lines);
+        return 0;
+    }
+    // Generated numbers never repeat; the check only guards against imported data
+    uint64_t first;
+    int unused;
+    do {
+        first = reserveRefNos(count);
+        unused = 1;
+        for (int i = 0; i < count && unused; i++) {
+            char refNo[REFNO_SIZE];
+            formatRefNo(first + ((uint64_t)i << REFNO_NODE_BITS), refNo);
+            unused = !bookingIndexFind(&bookingIndex, refNo);
+        }
+    } while (!unused);
+
+    // The header lets replay drop a group whose records did not all reach the journal
+    size_t length = (size_t)sprintf(lines, "G,%d\n", count);
+    for (int i = 0; i < count; i++) {
+        Booking *booking = allocBooking();
+        memset(booking->name, 0, sizeof(booking->name));
+        strncpy(booking->name, names[i < nameCount ? i : 0], sizeof(booking->name) - 1);
+        formatRefNo(first + ((uint64_t)i << REFNO_NODE_BITS), booking->refNo);
+        booking->flight = flight;
+        booking->date = date;
+        booking->seatNumber = seats[i];
+        booking->paise = toPaise(price);
+        booking->cancelRequested = 0;
+        linkBooking(booking);
+        length += bookingRecord(booking, lines + length);
+    }
+    journalSeatChange(claim, lines, length, count + 1);
+    formatGroupRef(first, count, groupRef);
+    pthread_rwlock_unlock(&storeLock);
+    free(lines);
+    return 1;
+}
+
+// Book a seat from any thread. The seat is claimed with a compare-and-swap under the
+// shared store lock, so bookings on different seats never wait for each other; the
+// store lock is only taken exclusively to link the new booking.
+int storeBook(const char *flightID, int seatNumber, const char *name, char *refNo, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_rdlock(&storeLock);
+    Flight *flight = findFlight((char *)flightID);
+    if (!flight || !flight->seats || flight->archived) {
+        pthread_rwlock_unlock(&storeLock);
+        *error = flight && flight->archived ? "flight is archived" : "flight not found";
+        metricRecord(METRIC_BOOK, start);
+        return 0;
+    }
+    SeatMap *seats = flight->seats;
+    SeatClaim claim;
+    beginSeatClaim(&claim, flight);
+    int claimed = claimSeat(seats, seatNumber);
+    endSeatClaim(&claim);
+    if (!claimed) {
+        pthread_rwlock_unlock(&storeLock);
+        *error = "seat unavailable";
+        metricRecord(METRIC_BOOK, start);
+        return 0;
+    }
+    uint32_t code = flight->code, date = flight->departure;
+    float price = seatFare(seats, flight->price, seatNumber);
+    pthread_rwlock_unlock(&storeLock);
+
+    int booked = recordBooking(&claim, code, date, price, seatNumber, name, refNo);
+    if (!booked) {
+        *error = "flight not found";
+    }
+    metricRecord(METRIC_BOOK, start);
+    return booked;
+}
+
+// Book the best free seat of a cabin from any thread: the front row with room, leftmost
+// seat first. Once the cabin is full the ticket is sold without a seat (SEAT_OVERBOOKED)
+// while the flight's overbooking allowance lasts. The seat is returned in seatNumber.
+int storeBookCabin(const char *flightID, char cabinCode, const char *name, char *refNo, int *seatNumber,
+                   const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_rdlock(&storeLock);
+    Flight *flight = findFlight((char *)flightID);
+    int cabin = flight && flight->seats ? findCabin(flight->seats, cabinCode) : -1;
+    int seat = 0, claimed = 0;
+    SeatClaim claim;
+    if (flight && flight->seats && !flight->archived && cabin >= 0) {
+        beginSeatClaim(&claim, flight);
+        claimed = allocateSeats(flight->seats, cabin, 1, 0, &seat) || claimOverbooked(flight->seats);
+        endSeatClaim(&claim);
+    }
+    if (!flight || !flight->seats || flight->archived) {
+        *error = flight && flight->archived ? "flight is archived" : "flight not found";
+    } else if (cabin < 0) {
+        *error = "no such cabin";
+    } else if (!claimed) {
+        *error = "cabin full";
+    } else {
+        uint32_t code = flight->code, date = flight->departure;
+        float price = flight->price * flight->seats->layout.cabins[cabin].priceFactor;
+        pthread_rwlock_unlock(&storeLock);
+
+        if (seat == 0) {
+            seat = SEAT_OVERBOOKED;
+        }
+        int booked = recordBooking(&claim, code, date, price, seat, name, refNo);
+        if (booked) {
+            *seatNumber = seat;
+        } else {
+            *error = "flight not found";
+        }
+        metricRecord(METRIC_BOOK, start);
+        return booked;
+    }
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_BOOK, start);
+    return 0;
+}
+
+static int compareSeats(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// Book count seats of a cabin for a group from any thread, all or nothing: either every
+// passenger gets a seat or nothing is booked. The seats are claimed like a party's in
+// allocateSeats, adjacent if asked, and the bitmap words they changed are written
+// together. Never overbooks. The seats are returned in seats[] and the group reference
+// in groupRef (REFNO_SIZE bytes).
+int storeBookGroup(const char *flightID, char cabinCode, int count, int adjacent, const char *const *names,
+                   int nameCount, char *groupRef, int *seats, const char **error) {
+    double start = nowNanos();
+    if (count <= 0 || count > GROUP_MAX_SIZE || nameCount <= 0) {
+        *error = "group size out of range";
+        metricRecord(METRIC_BOOK_GROUP, start);
+        return 0;
+    }
+    pthread_rwlock_rdlock(&storeLock);
+    Flight *flight = findFlight((char *)flightID);
+    int cabin = flight && flight->seats ? findCabin(flight->seats, cabinCode) : -1;
+    if (!flight || !flight->seats || flight->archived) {
+        *error = flight && flight->archived ? "flight is archived" : "flight not found";
+    } else if (cabin < 0) {
+        *error = "no such cabin";
+    } else {
+        SeatMap *map = flight->seats;
+        SeatClaim claim;
+        beginSeatClaim(&claim, flight);
+        int claimed = allocateSeats(map, cabin, count, adjacent, seats);
+        endSeatClaim(&claim);
+        if (claimed) {
+            uint32_t code = flight->code, date = flight->departure;
+            float price = flight->price * map->layout.cabins[cabin].priceFactor;
+            pthread_rwlock_unlock(&storeLock);
+
+            qsort(seats, count, sizeof(int), compareSeats);  // Members numbered front to back
+            int booked = recordGroup(&claim, code, date, price, seats, count, names, nameCount, groupRef);
+            if (!booked) {
+                *error = "flight not found";
+            }
+            metricRecord(METRIC_BOOK_GROUP, start);
+            return booked;
+        }
+        writeSeatWords(map, claim.from, claim.to);  // A failed claim may have written its rollback
+        *error = adjacent ? "no adjacent seats for the group" : "not enough seats in cabin";
+    }
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_BOOK_GROUP, start);
+    return 0;
+}
+
+// List a group's members still booked from any thread, looked up by the reference
+// numbers its reference stands for: "OK <booked> <count> <refNo>:<seat> ...", up to
+// limit members from member offset on. Returns 0 if no member is booked.
+int storeGroup(const char *groupRef, int offset, int limit, char *reply, size_t replySize) {
+    char refNo[REFNO_SIZE];
+    char entries[REPLY_SIZE];
+    size_t used = 0;
+    int count = groupMemberRef(groupRef, 0, refNo), booked = 0, listed = 0;
+    Booking booking;
+    for (int i = 0; i < count; i++) {
+        groupMemberRef(groupRef, i, refNo);
+        if (!storeView(refNo, &booking)) {
+            continue;
+        }
+        booked++;
+        if (i >= offset && listed < limit && used + REFNO_SIZE + 16 < sizeof(entries)) {
+            used += (size_t)snprintf(entries + used, sizeof(entries) - used, " %s:%d", refNo, booking.seatNumber);
+            listed++;
+        }
+    }
+    if (booked == 0) {
+        return 0;
+    }
+    entries[used] = '\0';
+    snprintf(reply, replySize, "OK %d %d%s\n", booked, count, entries);
+    return 1;
+}
+
+// Current tick of the hold wheel
+static uint64_t holdTick() {
+    return (uint64_t)(nowNanos() / 1e6) / HOLD_TICK_MS;
+}
+
+// Seconds a seat stays held: ARS_HOLD_TTL if set, else HOLD_TTL_SECONDS
+double holdTtlSeconds() {
+    static double ttl = 0;
+    if (ttl <= 0) {
+        const char *env = getenv("ARS_HOLD_TTL");
+        ttl = env && atof(env) > 0 ? atof(env) : HOLD_TTL_SECONDS;
+    }
+    return ttl;
+}
+
+// Set a seat's bit and mark it held, so the inventory file never sees it.
+// Returns 0 if the seat is invalid or taken.
+static int holdSeatBit(SeatMap *map, int seatNumber) {
+    if (seatNumber <= 0 || seatNumber > map->seatCount) {
+        return 0;
+    }
+    int bit = seatNumber - 1;
+    uint64_t mask = 1ULL << (bit % 64);
+    // Under the write lock no writer can see the bit before it is marked held
+    pthread_mutex_lock(&map->writeLock);
+    uint64_t old = __atomic_fetch_or(&map->bits[bit / 64], mask, __ATOMIC_ACQ_REL);
+    if (!(old & mask)) {
+        map->held[bit / 64] |= mask;
+        __atomic_fetch_add(&map->seatsBooked, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&map->seatsHeld, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&map->writeLock);
+    if (!(old & mask)) {
+        seatChanged(map, seatNumber);
+    }
+    return !(old & mask);
+}
+
+// Turn a held seat into a booked one and write it to the inventory
+static void commitSeatBit(SeatMap *map, int seatNumber) {
+    int bit = seatNumber - 1;
+    pthread_mutex_lock(&map->writeLock);
+    map->held[bit / 64] &= ~(1ULL << (bit % 64));
+    __atomic_fetch_sub(&map->seatsHeld, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&map->writeLock);
+    writeSeatWord(map, bit / 64);
+}
+
+// Make a held seat available again; it was never written, so nothing is written now
+static void releaseSeatBit(SeatMap *map, int seatNumber) {
+    int bit = seatNumber - 1;
+    uint64_t mask = 1ULL << (bit % 64);
+    pthread_mutex_lock(&map->writeLock);
+    map->held[bit / 64] &= ~mask;
+    __atomic_fetch_and(&map->bits[bit / 64], ~mask, __ATOMIC_ACQ_REL);
+    __atomic_fetch_sub(&map->seatsBooked, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&map->seatsHeld, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&map->writeLock);
+    seatChanged(map, seatNumber);
+}
+
+// Take an entry out of its wheel bucket and put it on the free list
+static void freeHoldEntry(uint32_t index) {
+    SeatHold *hold = &holds.entries[index];
+    if (hold->prev) {
+        holds.entries[hold->prev - 1].next = hold->next;
+    } else {
+        holds.wheel[hold->expiresAt % HOLD_WHEEL_SLOTS] = hold->next;
+    }
+    if (hold->next) {
+        holds.entries[hold->next - 1].prev = hold->prev;
+    }
+    hold->map = NULL;
+    hold->generation++;
+    hold->next = holds.freeHead;
+    holds.freeHead = index + 1;
+    holds.active--;
+}
+
+// Release every hold whose tick has come, visiting only the buckets passed since the
+// last call. Holds more than one turn away stay in their bucket until their turn.
+static void expireHoldsLocked(uint64_t now) {
+    if (holds.active == 0 || now <= holds.tick) {
+        holds.tick = now > holds.tick ? now : holds.tick;
+        return;
+    }
+    uint64_t from = holds.tick + 1;
+    if (now - holds.tick > HOLD_WHEEL_SLOTS) {
+        from = now - HOLD_WHEEL_SLOTS + 1;  // Every bucket once
+    }
+    for (uint64_t tick = from; tick <= now && holds.active > 0; tick++) {
+        uint32_t i = holds.wheel[tick % HOLD_WHEEL_SLOTS];
+        while (i) {
+            SeatHold *hold = &holds.entries[i - 1];
+            uint32_t next = hold->next;
+            if (hold->expiresAt <= now) {
+                releaseSeatBit(hold->map, hold->seatNumber);
+                freeHoldEntry(i - 1);
+                holds.expired++;
+            }
+            i = next;
+        }
+    }
+    holds.tick = now;
+}
+
+// Live hold with this ID, NULL if it was committed, released or has expired
+static SeatHold *findHoldLocked(uint64_t holdID) {
+    uint32_t index = (uint32_t)holdID;
+    if (index >= holds.capacity) {
+        return NULL;
+    }
+    SeatHold *hold = &holds.entries[index];
+    return hold->map && hold->generation == (uint32_t)(holdID >> 32) ? hold : NULL;
+}
+
+// Hold a seat for holdTtlSeconds(). The hold ID is what PAY and RELEASE take.
+int storeHold(const char *flightID, int seatNumber, uint64_t *holdID, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_rdlock(&storeLock);
+    Flight *flight = findFlight((char *)flightID);
+    if (!flight || !flight->seats || flight->archived) {
+        pthread_rwlock_unlock(&storeLock);
+        *error = flight && flight->archived ? "flight is archived" : "flight not found";
+        metricRecord(METRIC_HOLD, start);
+        return 0;
+    }
+    pthread_mutex_lock(&holdLock);
+    uint64_t now = holdTick();
+    expireHoldsLocked(now);
+    if (!holdSeatBit(flight->seats, seatNumber)) {
+        pthread_mutex_unlock(&holdLock);
+        pthread_rwlock_unlock(&storeLock);
+        *error = "seat unavailable";
+        metricRecord(METRIC_HOLD, start);
+        return 0;
+    }
+    if (!holds.freeHead) {
+        uint32_t capacity = holds.capacity ? holds.capacity * 2 : 1024;
+        SeatHold *entries = (SeatHold *)realloc(holds.entries, capacity * sizeof(SeatHold));
+        if (!entries) {
+            printf("Memory allocation failed for seat holds.\n");
+            exit(1);
+        }
+        memset(entries + holds.capacity, 0, (capacity - holds.capacity) * sizeof(SeatHold));
+        for (uint32_t i = capacity; i-- > holds.capacity;) {
+            entries[i].next = holds.freeHead;
+            holds.freeHead = i + 1;
+        }
+        holds.entries = entries;
+        holds.capacity = capacity;
+    }
+    uint32_t index = holds.freeHead - 1;
+    SeatHold *hold = &holds.entries[index];
+    holds.freeHead = hold->next;
+
+    uint64_t ttl = (uint64_t)(holdTtlSeconds() * 1000 / HOLD_TICK_MS);
+    hold->map = flight->seats;
+    hold->seatNumber = seatNumber;
+    hold->expiresAt = now + (ttl > 0 ? ttl : 1);
+    uint32_t *bucket = &holds.wheel[hold->expiresAt % HOLD_WHEEL_SLOTS];
+    hold->prev = 0;
+    hold->next = *bucket;
+    if (*bucket) {
+        holds.entries[*bucket - 1].prev = index + 1;
+    }
+    *bucket = index + 1;
+    holds.active++;
+    holds.created++;
+    *holdID = (uint64_t)hold->generation << 32 | index;
+    pthread_mutex_unlock(&holdLock);
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_HOLD, start);
+    return 1;
+}
+
+// Pay for a held seat: the hold becomes a booking. Fails once the hold has expired.
+int storeCommitHold(uint64_t holdID, const char *name, char *refNo, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_rdlock(&storeLock);
+    pthread_mutex_lock(&holdLock);
+    expireHoldsLocked(holdTick());
+    SeatHold *hold = findHoldLocked(holdID);
+    if (!hold) {
+        pthread_mutex_unlock(&holdLock);
+        pthread_rwlock_unlock(&storeLock);
+        *error = "hold not found or expired";
+        metricRecord(METRIC_PAY, start);
+        return 0;
+    }
+    Flight *flight = findFlight(hold->map->flightID);
+    uint32_t code = flight->code, date = flight->departure;
+    int seatNumber = hold->seatNumber;
+    float price = seatFare(hold->map, flight->price, seatNumber);
+    SeatClaim claim;
+    beginSeatClaim(&claim, flight);
+    commitSeatBit(hold->map, seatNumber);
+    endSeatClaim(&claim);
+    freeHoldEntry((uint32_t)holdID);
+    holds.committed++;
+    pthread_mutex_unlock(&holdLock);
+    pthread_rwlock_unlock(&storeLock);
+
+    int booked = recordBooking(&claim, code, date, price, seatNumber, name, refNo);
+    if (!booked) {
+        *error = "flight not found";
+    }
+    metricRecord(METRIC_PAY, start);
+    return booked;
+}
+
+// Give a held seat back before its hold expires
+int storeReleaseHold(uint64_t holdID, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_rdlock(&storeLock);
+    pthread_mutex_lock(&holdLock);
+    expireHoldsLocked(holdTick());
+    SeatHold *hold = findHoldLocked(holdID);
+    if (hold) {
+        releaseSeatBit(hold->map, hold->seatNumber);
+        freeHoldEntry((uint32_t)holdID);
+        holds.released++;
+    } else {
+        *error = "hold not found or expired";
+    }
+    pthread_mutex_unlock(&holdLock);
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_RELEASE, start);
+    return hold != NULL;
+}
+
+// Release the holds that are due; the server calls this every tick
+void storeExpireHolds() {
+    pthread_rwlock_rdlock(&storeLock);
+    pthread_mutex_lock(&holdLock);
+    expireHoldsLocked(holdTick());
+    pthread_mutex_unlock(&holdLock);
+    pthread_rwlock_unlock(&storeLock);
+}
+
+// Forget the holds on a flight's seat map before the map is freed
+void dropFlightHolds(SeatMap *map) {
+    pthread_mutex_lock(&holdLock);
+    for (uint32_t i = 0; i < holds.capacity && holds.active > 0; i++) {
+        if (holds.entries[i].map == map) {
+            freeHoldEntry(i);
+            holds.released++;
+        }
+    }
+    pthread_mutex_unlock(&holdLock);
+}
+
+// Copy of the hold counters, with lapsed holds expired first
+HoldCounts storeHoldCounts() {
+    storeExpireHolds();
+    pthread_mutex_lock(&holdLock);
+    HoldCounts counts = {holds.active, holds.created, holds.committed, holds.released, holds.expired};
+    pthread_mutex_unlock(&holdLock);
+    return counts;
+}
+
+// Request cancellation of a booking from any thread
+int storeCancel(const char *refNo, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_wrlock(&storeLock);
+    Booking *booking = findStoredBooking(refNo);
+    int ok = 0;
+    if (!booking) {
+        *error = "booking not found";
+    } else if (booking->archived) {
+        *error = "booking is archived";
+    } else if (!requestCancellation(booking)) {
+        *error = "cancellation already requested";
+    } else {
+        journalAppend("C,%s", refNo);
+        ok = 1;
+    }
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_CANCEL, start);
+    return ok;
+}
+
+// Rebuild the flight snapshot from the flight list and publish it. Caller holds the
+// store lock exclusively.
+void publishFlights() {
+    if (routeIndex.dirty) {
+        rebuildRouteIndex();
+    }
+    int count = routeIndex.count;
+    size_t slotCount = 16;
+    while (slotCount < (size_t)count * 2) {
+        slotCount *= 2;
+    }
+    FlightSnapshot *snapshot = (FlightSnapshot *)malloc(sizeof(FlightSnapshot) + count * sizeof(FlightEntry) +
+                                                        slotCount * sizeof(int32_t));
+    if (!snapshot) {
+        printf("Memory allocation failed for flight snapshot.\n");
+        exit(1);
+    }
+    snapshot->version = flightListVersion;
+    snapshot->count = count;
+    snapshot->mask = slotCount - 1;
+    snapshot->slots = (int32_t *)(snapshot->entries + count);
+    memset(snapshot->slots, 0xFF, slotCount * sizeof(int32_t));
+    for (int i = 0; i < count; i++) {
+        const Flight *flight = routeIndex.entries[i].flight;
+        FlightEntry *entry = &snapshot->entries[i];
+        memcpy(entry->flightID, flight->flightID, sizeof(entry->flightID));
+        memcpy(entry->date, flight->date, sizeof(entry->date));
+        strcpy(entry->time, flightTime(flight));
+        entry->from = flight->from;
+        entry->to = flight->to;
+        entry->price = flight->price;
+        entry->dateKey = routeIndex.entries[i].date;
+        entry->seats = flight->seats;
+        size_t slot = hashRefNo(flight->flightID) & snapshot->mask;
+        while (snapshot->slots[slot] >= 0) {
+            slot = (slot + 1) & snapshot->mask;
+        }
+        snapshot->slots[slot] = i;
+    }
+    FlightSnapshot *old = flightSnapshot;
+    __atomic_store_n(&flightSnapshot, snapshot, __ATOMIC_RELEASE);
+    if (old) {
+        epochRetire(old, free);
+    }
+}
+
+// Enter an epoch and return the current flight snapshot, publishing a fresh one first if
+// flights were added or removed since. Writers never publish, so a run of ADDFLIGHTs
+// costs one rebuild when it is next read rather than one per flight.
+static FlightSnapshot *enterFlights() {
+    epochEnter();
+    FlightSnapshot *snapshot = __atomic_load_n(&flightSnapshot, __ATOMIC_ACQUIRE);
+    if (!snapshot || snapshot->version != __atomic_load_n(&flightListVersion, __ATOMIC_ACQUIRE)) {
+        epochExit();
+        pthread_rwlock_wrlock(&storeLock);
+        if (!flightSnapshot || flightSnapshot->version != flightListVersion) {
+            publishFlights();
+        }
+        pthread_rwlock_unlock(&storeLock);
+        epochEnter();
+        snapshot = __atomic_load_n(&flightSnapshot, __ATOMIC_ACQUIRE);
+    }
+    return snapshot;
+}
+
+static const FlightEntry *snapshotFind(const FlightSnapshot *snapshot, const char *flightID) {
+    size_t slot = hashRefNo(flightID) & snapshot->mask;
+    while (snapshot->slots[slot] >= 0) {
+        const FlightEntry *entry = &snapshot->entries[snapshot->slots[slot]];
+        if (strcmp(entry->flightID, flightID) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & snapshot->mask;
+    }
+    return NULL;
+}
+
+// First snapshot entry not ordered before (route, date), route as in RouteEntry
+static int snapshotLowerBound(const FlightSnapshot *snapshot, uint64_t route, int date) {
+    int low = 0, high = snapshot->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        const FlightEntry *entry = &snapshot->entries[mid];
+        uint64_t key = (uint64_t)entry->from << 32 | entry->to;
+        int order = (key > route) - (key < route);
+        if (order == 0) order = (entry->dateKey > date) - (entry->dateKey < date);
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Copy the fields a reader shows. They are fixed once a booking is indexed, except the
+// cancellation flag, which is read atomically.
+static void readBooking(const Booking *booking, Booking *copy) {
+    memset(copy, 0, sizeof(*copy));
+    memcpy(copy->refNo, booking->refNo, sizeof(copy->refNo));
+    memcpy(copy->name, booking->name, sizeof(copy->name));
+    copy->flight = booking->flight;
+    copy->date = booking->date;
+    copy->archived = booking->archived;
+    copy->seatNumber = booking->seatNumber;
+    copy->paise = booking->paise;
+    copy->cancelRequested = __atomic_load_n(&booking->cancelRequested, __ATOMIC_ACQUIRE);
+}
+
+// Copy a booking out of the store from any thread, without a lock: the published index
+// is read inside an epoch. A refNo missing from memory may belong to an archive, which
+// is loaded under the exclusive lock.
+int storeView(const char *refNo, Booking *copy) {
+    double start = nowNanos();
+    epochEnter();
+    Booking *booking = bookingIndexRead(&bookingIndex, refNo);
+    if (booking && __atomic_load_n(&booking->removed, __ATOMIC_ACQUIRE)) {
+        booking = NULL;  // Its flight was removed, the refund is on its way
+    }
+    if (booking) {
+        readBooking(booking, copy);
+    }
+    epochExit();
+    if (!booking && archiveCount > 0) {
+        pthread_rwlock_wrlock(&storeLock);
+        booking = findStoredBooking(refNo);
+        if (booking) {
+            readBooking(booking, copy);
+        }
+        pthread_rwlock_unlock(&storeLock);
+    }
+    metricRecord(METRIC_LOOKUP, start);
+    return booking != NULL;
+}
+
+// Seats still available on a flight, -1 if it does not exist; reads the flight snapshot
+int storeSeatsRemaining(const char *flightID) {
+    FlightSnapshot *snapshot = enterFlights();
+    const FlightEntry *entry = snapshotFind(snapshot, flightID);
+    int remaining = entry && entry->seats ? seatsRemaining(entry->seats) : -1;
+    epochExit();
+    return remaining;
+}
+
+// Search a route from any thread, on the flight snapshot. The reply lists up to limit
+// flights, the first by date and time: "OK <total> <flightID>,<date>,<time>,<price>,<seats left>;..."
+void storeSearch(const char *source, const char *destination, const char *date, int limit, char *reply,
+                 size_t replySize) {
+    double start = nowNanos();
+    FlightSnapshot *snapshot = enterFlights();
+    int anyDate = !date || strcmp(date, "*") == 0;
+    int day = anyDate ? 0 : dateKey(date);
+    uint32_t from = findString(&airportDictionary, source), to = findString(&airportDictionary, destination);
+    uint64_t route = (uint64_t)from << 32 | to;
+    int first = 0, last = 0;
+    if (from != UINT32_MAX && to != UINT32_MAX) {
+        first = snapshotLowerBound(snapshot, route, day);
+        last = snapshotLowerBound(snapshot, route, anyDate ? INT_MAX : day + 1);
+    }
+    if (limit <= 0 || limit > SEARCH_PAGE_SIZE) {
+        limit = SEARCH_PAGE_SIZE;
+    }
+    size_t length = snprintf(reply, replySize, "OK %d", last - first);
+    for (int i = first; i < last && i - first < limit; i++) {
+        const FlightEntry *flight = &snapshot->entries[i];
+        char entry[96];
+        int size = snprintf(entry, sizeof(entry), "%c%s,%s,%s,%.2f,%d", i > first ? ';' : ' ', flight->flightID,
+                            flight->date, flight->time, flight->price,
+                            flight->seats ? seatsRemaining(flight->seats) : 0);
+        if (length + size + 2 > replySize) {
+            break;
+        }
+        memcpy(reply + length, entry, size);
+        length += size;
+    }
+    epochExit();
+    metricRecord(METRIC_SEARCH, start);
+    reply[length++] = '\n';
+    reply[length] = '\0';
+}
+
+// Drop a booking whose cancellation was approved and journal the approval; the freed
+// seat is written after the journal record
+void approveBooking(const char *refNo) {
+    Booking *booking = bookingIndexFind(&bookingIndex, refNo);
+    SeatClaim release;
+    beginSeatClaim(&release, booking ? flightByCode(booking->flight) : NULL);
+    removeBooking(refNo);
+    endSeatClaim(&release);
+    char line[JOURNAL_LINE_SIZE];
+    journalSeatChange(&release, line, (size_t)snprintf(line, sizeof(line), "A,%s\n", refNo), 1);
+}
+
+// Approve a pending cancellation from any thread: drop the booking and free its seat
+int storeApprove(const char *refNo, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_wrlock(&storeLock);
+    Booking *booking = findStoredBooking(refNo);
+    int ok = 0;
+    if (!booking) {
+        *error = "booking not found";
+    } else if (booking->archived) {
+        *error = "booking is archived";
+    } else if (!booking->cancelRequested) {
+        *error = "no cancellation requested";
+    } else {
+        approveBooking(refNo);
+        ok = 1;
+    }
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_APPROVE, start);
+    return ok;
+}
+
+// Reject a pending cancellation from any thread: the booking stays as it was
+int storeReject(const char *refNo, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_wrlock(&storeLock);
+    Booking *booking = findStoredBooking(refNo);
+    int ok = 0;
+    if (!booking) {
+        *error = "booking not found";
+    } else if (booking->archived) {
+        *error = "booking is archived";
+    } else if (!booking->cancelRequested) {
+        *error = "no cancellation requested";
+    } else {
+        resolveCancelRequest(refNo);
+        journalAppend("R,%s", refNo);
+        ok = 1;
+    }
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_REJECT, start);
+    return ok;
+}
+
+// Approve every pending cancellation on a flight from any thread, -1 if there is no such flight
+int storeApproveFlight(const char *flightID, const char **error) {
+    double start = nowNanos();
+    pthread_rwlock_wrlock(&storeLock);
+    int approved = -1;
+    Flight *flight = findFlight((char *)flightID);
+    if (!flight) {
+        *error = "flight not found";
+    } else if (flight->archived) {
+        *error = "flight is archived";
+    } else {
+        // The freed seats are written once the journal has the approvals
+        int deferred = seatWritesDeferred;
+        seatWritesDeferred = 1;
+        approved = approveFlightCancellations(flightID);
+        if (approved > 0) {
+            journalAppend("M,%s", flightID);
+        }
+        seatWritesDeferred = deferred;
+        if (flight->seats && flight->seats->dirty && !deferred) {
+            flushSeatMap(flight->seats);
+        }
+    }
+    pthread_rwlock_unlock(&storeLock);
+    metricRecord(METRIC_APPROVE_FLIGHT, start);
+    return approved;
+}
+
+// Journal a new flight with its seat layout and overbooking allowance
+static void journalFlight(const Flight *flight) {
+    char layout[SEAT_LAYOUT_SIZE];
+    formatSeatLayout(&flight->seats->layout, layout, sizeof(layout));
+    journalAppend("F,%s,%s,%s,%s,%s,%.2f,%s,%u", flight->flightID, flight->date, flightTime(flight),
+                  flightSource(flight), flightDestination(flight), flight->price, layout,
+                  flight->seats->layout.overbookLimit);
+}
+
+// Add a flight with an empty seat map from any thread
+int storeAddFlight(const Flight *details, const SeatLayout *layout, const char **error) {
+    pthread_rwlock_wrlock(&storeLock);
+    int ok = 0;
+    if (findFlight((char *)details->flightID)) {
+        *error = "flight already exists";
+    } else {
+        Flight *flight = allocFlight();
+        *flight = *details;
+        dropSeatMap(flight->flightID);
+        registerFlightLayout(flight, layout);
+        journalFlight(flight);
+        ok = 1;
+    }
+    pthread_rwlock_unlock(&storeLock);
+    return ok;
+}
+
+// Remove a flight from any thread
+int storeRemoveFlight(const char *flightID, const char **error) {
+    pthread_rwlock_wrlock(&storeLock);
+    Flight *flight = findFlight((char *)flightID);
+    int ok = 0;
+    if (flight && flight->archived) {
+        *error = "flight is archived";
+    } else if (deleteFlight(flightID)) {
+        // The bookings are refunded by the removal worker; the journal record covers them
+        journalAppend("X,%s", flightID);
+        pthread_mutex_lock(&removalLock);
+        int worker = removals.workerStarted;
+        pthread_mutex_unlock(&removalLock);
+        if (!worker) {
+            finishFlightRemovals();  // Only the server runs a worker, refund right away
+        }
+        ok = 1;
+    } else {
+        *error = "flight not found";
+    }
+    pthread_rwlock_unlock(&storeLock);
+    return ok;
+}
+
+// Print a view from its cache, rendering it again only when the version of what it
+// shows has moved on since the last render
+static void showView(ViewCache *cache, uint64_t version, void (*render)(FILE *, const void *),
+                     const void *arg) {
+    pthread_mutex_lock(&viewCacheLock);
+    if (!cache->text || cache->version != version) {
+        free(cache->text);
+        cache->text = NULL;
+        cache->length = 0;
+        FILE *out = open_memstream(&cache->text, &cache->length);
+        if (!out) {
+            pthread_mutex_unlock(&viewCacheLock);
+            printf("Error rendering view.\n");
+            return;
+        }
+        render(out, arg);
+        fclose(out);
+        cache->version = version;
+        cache->renders++;
+    } else {
+        cache->hits++;
+    }
+    fwrite(cache->text, 1, cache->length, stdout);
+    pthread_mutex_unlock(&viewCacheLock);
+}
+
+static void renderFlightList(FILE *out, const void *arg) {
+    (void)arg;
+    fprintf(out, "\n=== Available Flights ===\n");
+    fprintf(out, "FlightID  |    Source   |   Destination | Date | Time | Price\n");
+    Flight *current = flightHead;
+    while (current) {
+        fprintf(out, "%s       |  %s     |     %s     | %s   | %s   |%.2f\n",
+                current->flightID, flightSource(current), flightDestination(current),
+                current->date, flightTime(current), current->price);
+        current = current->next;
+    }
+}
+
+// Display available flights
+void viewAvailableFlights() {
+    showView(&flightListView, flightListVersion, renderFlightList, NULL);
+}
+
+// Seat availability of a flight cabin by cabin, one row per line
+static void renderSeatAvailability(FILE *out, const void *arg) {
+    const Flight *flight = (const Flight *)arg;
+    SeatMap *seats = flight->seats;
+    fprintf(out, "\nAvailable Seats (X = Booked): %d remaining\n", seatsRemaining(seats));
+    for (uint32_t c = 0; c < seats->layout.cabinCount; c++) {
+        const CabinSpec *cabin = &seats->layout.cabins[c];
+        int first = seats->cabins[c].firstSeat;
+        fprintf(out, "\n%s (%c): fare %.2f, %d free\n", cabinName(cabin->code), cabin->code,
+                flight->price * cabin->priceFactor, seats->cabins[c].freeSeats);
+        for (int i = 0; i < (int)cabin->seats; i++) {
+            if (!isSeatBooked(seats, first + i)) {
+                fprintf(out, "%6d", first + i);
+            } else {
+                fprintf(out, "%6c", 'X');
+            }
+            if ((i + 1) % cabin->rowSeats == 0 || i + 1 == (int)cabin->seats) {
+                fprintf(out, "\n");
+            }
+        }
+    }
+}
+
+void showSeatAvailability(Flight *flight) {
+    showView(&flight->seats->availability, __atomic_load_n(&flight->seats->version, __ATOMIC_ACQUIRE),
+             renderSeatAvailability, flight);
+}
+
+// DD/MM/YYYY as a sortable YYYYMMDD number, 0 if the date is malformed
+int dateKey(const char *date) {
+    int parts[3] = {0, 0, 0}, part = 0, digits = 0;
+    for (const char *c = date; *c; c++) {
+        if (*c >= '0' && *c <= '9') {
+            parts[part] = parts[part] * 10 + (*c - '0');
+            digits++;
+        } else if (*c == '/' && digits > 0 && part < 2) {
+            part++;
+            digits = 0;
+        } else {
+            return 0;
+        }
+    }
+    if (part != 2 || digits == 0) {
+        return 0;
+    }
+    return parts[2] * 10000 + parts[1] * 100 + parts[0];
+}
+
+// Order flights by route, date, time and then price. Routes are ordered by airport code,
+// which keeps each route's flights together without comparing names.
+static int compareRouteEntries(const void *a, const void *b) {
+    const RouteEntry *x = (const RouteEntry *)a, *y = (const RouteEntry *)b;
+    int order = (x->route > y->route) - (x->route < y->route);
+    if (order == 0) order = (x->date > y->date) - (x->date < y->date);
+    if (order == 0) order = strcmp(flightTime(x->flight), flightTime(y->flight));
+    if (order == 0) order = (x->flight->price > y->flight->price) - (x->flight->price < y->flight->price);
+    return order;
+}
+
+// Rebuild the sorted route index after flights were added or removed
+void rebuildRouteIndex() {
+    int count = 0;
+    for (Flight *f = flightHead; f; f = f->next) {
+        count++;
+    }
+    if (count > routeIndex.capacity) {
+        free(routeIndex.entries);
+        routeIndex.capacity = count + count / 2;
+        routeIndex.entries = (RouteEntry *)malloc(routeIndex.capacity * sizeof(RouteEntry));
+        if (!routeIndex.entries) {
+            printf("Error allocating route index.\n");
+            exit(1);
+        }
+    }
+    int i = 0;
+    for (Flight *f = flightHead; f; f = f->next, i++) {
+        routeIndex.entries[i].route = (uint64_t)f->from << 32 | f->to;
+        routeIndex.entries[i].date = packedDateKey(f->departure);
+        routeIndex.entries[i].flight = f;
+    }
+    qsort(routeIndex.entries, count, sizeof(RouteEntry), compareRouteEntries);
+    routeIndex.count = count;
+    routeIndex.dirty = 0;
+}
+
+// First index entry not ordered before (route, date)
+static int routeLowerBound(uint64_t route, int date) {
+    int low = 0, high = routeIndex.count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        const RouteEntry *entry = &routeIndex.entries[mid];
+        int order = (entry->route > route) - (entry->route < route);
+        if (order == 0) order = (entry->date > date) - (entry->date < date);
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Find flights on a route, optionally on one date (NULL or "*" for any date) and
+// within a price range. Results are sorted by date and time; offset and limit select
+// one page of them. Returns how many results were stored, *total gets the full count.
+int searchFlights(const char *source, const char *destination, const char *date,
+                  float minPrice, float maxPrice, int offset, int limit,
+                  Flight **results, int *total) {
+    double start = nowNanos();
+    if (routeIndex.dirty) {
+        rebuildRouteIndex();
+    }
+    int anyDate = !date || strcmp(date, "*") == 0;
+    int day = anyDate ? 0 : dateKey(date);
+    uint32_t from = findString(&airportDictionary, source), to = findString(&airportDictionary, destination);
+    uint64_t route = (uint64_t)from << 32 | to;
+    int first = 0, last = 0;
+    if (from != UINT32_MAX && to != UINT32_MAX) {
+        first = routeLowerBound(route, day);
+        last = routeLowerBound(route, anyDate ? INT_MAX : day + 1);
+    }
+
+    int matched = 0, stored = 0;
+    for (int i = first; i < last; i++) {
+        Flight *flight = routeIndex.entries[i].flight;
+        if (flight->price < minPrice || flight->price > maxPrice) {
+            continue;
+        }
+        if (matched >= offset && stored < limit) {
+            results[stored++] = flight;
+        }
+        matched++;
+    }
+    *total = matched;
+    metricRecord(METRIC_SEARCH, start);
+    return stored;
+}
+
+static void printSearchResults(Flight **results, int count, int total, int page, int pageSize) {
+    printf("\n=== Matching Flights (page %d, %d of %d) ===\n", page, count, total);
+    printf("FlightID  |    Source   |   Destination | Date | Time | Price | Seats Left\n");
+    for (int i = 0; i < count; i++) {
+        Flight *flight = results[i];
+        printf("%s       |  %s     |     %s     | %s   | %s   |%.2f | %d\n",
+               flight->flightID, flightSource(flight), flightDestination(flight), flight->date,
+               flightTime(flight), flight->price, flight->seats ? seatsRemaining(flight->seats) : 0);
+    }
+    if (total > page * pageSize) {
+        printf("More results on page %d.\n", page + 1);
+    }
+}
+
+// Interactive route search
+void searchFlightsMenu() {
+    char source[30], destination[30], date[15];
+    float maxPrice;
+    int page = 1;
+    printf("\nEnter Source: ");
+    scanf("%29s", source);
+    printf("Enter Destination: ");
+    scanf("%29s", destination);
+    printf("Enter Date (DD/MM/YYYY or * for any): ");
+    scanf("%14s", date);
+    printf("Enter Maximum Price (0 for any): ");
+    if (scanf("%f", &maxPrice) != 1 || maxPrice <= 0) {
+        maxPrice = FLT_MAX;
+    }
+
+    Flight *results[SEARCH_PAGE_SIZE];
+    while (1) {
+        int total;
+        int count = searchFlights(source, destination, date, 0, maxPrice,
+                                  (page - 1) * SEARCH_PAGE_SIZE, SEARCH_PAGE_SIZE, results, &total);
+        if (total == 0) {
+            printf("No flights found.\n");
+            return;
+        }
+        printSearchResults(results, count, total, page, SEARCH_PAGE_SIZE);
+        if (total <= page * SEARCH_PAGE_SIZE) {
+            return;
+        }
+        char more[10];
+        printf("Show next page? (y/n): ");
+        scanf("%9s", more);
+        if (more[0] != 'y' && more[0] != 'Y') {
+            return;
+        }
+        page++;
+    }
+}
+
+// Non-interactive search: search <source> <destination> [date|*] [--min-price P]
+// [--max-price P] [--page N] [--page-size N]
+int runSearchCommand(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s search <source> <destination> [date|*] [--min-price P] [--max-price P] "
+               "[--page N] [--page-size N]\n", argv[0]);
+        return 1;
+    }
+    const char *date = "*";
+    float minPrice = 0, maxPrice = FLT_MAX;
+    int page = 1, pageSize = SEARCH_PAGE_SIZE;
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--min-price") == 0 && i + 1 < argc) {
+            minPrice = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-price") == 0 && i + 1 < argc) {
+            maxPrice = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
+            page = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+            pageSize = atoi(argv[++i]);
+        } else {
+            date = argv[i];
+        }
+    }
+    if (page < 1) page = 1;
+    if (pageSize < 1) pageSize = SEARCH_PAGE_SIZE;
+
+    Flight **results = (Flight **)malloc(pageSize * sizeof(Flight *));
+    int total;
+    int count = searchFlights(argv[2], argv[3], date, minPrice, maxPrice,
+                              (page - 1) * pageSize, pageSize, results, &total);
+    if (total == 0) {
+        printf("No flights found.\n");
+    } else {
+        printSearchResults(results, count, total, page, pageSize);
+    }
+    free(results);
+    return 0;
+}
+
+// Function to book a flight
+void bookFlight() {
+    char flightID[10];
+    printf("\nEnter Flight ID to book: ");
+    scanf("%s", flightID);
+
+    Flight *flight = findFlight(flightID);
+    if (!flight) {
+        printf("Flight not found.\n");
+        return;
+    }
+
+    SeatMap *seats = flight->seats;
+    if (!seats) {
+        printf("Error: Seat data for flight %s not found.\n", flightID);
+        return;
+    }
+
+    // Display seat availability, rendered again only after the seats changed
+    showSeatAvailability(flight);
+
+    // A cabin letter takes the best free seat of that cabin
+    char choice[10];
+    printf("\nEnter seat number, or cabin letter for the best free seat: ");
+    scanf("%9s", choice);
+    int seatNumber = atoi(choice);
+    if (seatNumber == 0 && findCabin(seats, choice[0]) >= 0) {
+        seatNumber = bestSeat(seats, findCabin(seats, choice[0]));
+    }
+
+    // Hold the seat while the passenger pays; it is only booked once payment is confirmed
+    uint64_t holdID;
+    const char *error;
+    if (!storeHold(flightID, seatNumber, &holdID, &error)) {
+        printf("Invalid or already booked seat.\n");
+        return;
+    }
+
+    char name[30];
+    printf("Enter your name: ");
+    scanf("%29s", name);
+
+    // Payment prompt
+    char paymentConfirmation[10];
+    printf("Pay amount %.2f within %g seconds (type PAY to confirm payment): ",
+           seatFare(seats, flight->price, seatNumber), holdTtlSeconds());
+    scanf("%9s", paymentConfirmation);
+
+    // Check if the user typed "PAY"
+    char refNo[REFNO_SIZE];
+    if (strcasecmp(paymentConfirmation, "PAY") != 0) {
+        storeReleaseHold(holdID, &error);
+        printf("Payment not confirmed. Booking cancelled.\n");
+    } else if (storeCommitHold(holdID, name, refNo, &error)) {
+        printf("Booking successful! Your reference number is: %s\n", refNo);
+        printf("Seat %d booked successfully on flight %s.\n", seatNumber, flightID);
+    } else {
+        printf("Seat hold expired before payment. Booking cancelled.\n");
+    }
+}
+
+// Book seats for a whole group in one go: every passenger gets a seat or nobody does
+void bookGroup() {
+    char flightID[10];
+    printf("\nEnter Flight ID to book: ");
+    scanf("%9s", flightID);
+
+    Flight *flight = findFlight(flightID);
+    if (!flight || !flight->seats) {
+        printf("Flight not found.\n");
+        return;
+    }
+    showSeatAvailability(flight);
+
+    char cabin[10], together[10];
+    int count;
+    printf("\nEnter cabin letter: ");
+    scanf("%9s", cabin);
+    int index = findCabin(flight->seats, cabin[0]);
+    if (index < 0) {
+        printf("No such cabin on this flight.\n");
+        return;
+    }
+    printf("Number of passengers (up to %d): ", GROUP_MAX_SIZE);
+    if (scanf("%d", &count) != 1 || count <= 0 || count > GROUP_MAX_SIZE) {
+        printf("Invalid group size.\n");
+        return;
+    }
+    printf("Seat the group together? (y/n): ");
+    scanf("%9s", together);
+
+    // Each passenger's name; '*' books the rest under the lead passenger's
+    static char names[GROUP_MAX_SIZE][30];
+    const char *nameList[GROUP_MAX_SIZE];
+    int nameCount = 0;
+    while (nameCount < count) {
+        printf("Passenger %d name%s: ", nameCount + 1, nameCount ? " ('*' for the lead's name for the rest)" : "");
+        scanf("%29s", names[nameCount]);
+        if (nameCount > 0 && strcmp(names[nameCount], "*") == 0) {
+            break;
+        }
+        nameList[nameCount] = names[nameCount];
+        nameCount++;
+    }
+
+    char paymentConfirmation[10];
+    printf("Pay amount %.2f for %d seats (type PAY to confirm payment): ",
+           flight->price * flight->seats->layout.cabins[index].priceFactor * count, count);
+    scanf("%9s", paymentConfirmation);
+    if (strcasecmp(paymentConfirmation, "PAY") != 0) {
+        printf("Payment not confirmed. Booking cancelled.\n");
+        return;
+    }
+
+    static int seats[GROUP_MAX_SIZE];
+    char groupRef[REFNO_SIZE], refNo[REFNO_SIZE];
+    const char *error;
+    if (!storeBookGroup(flightID, cabin[0], count, tolower((unsigned char)together[0]) == 'y', nameList,
+                        nameCount, groupRef, seats, &error)) {
+        printf("Group booking failed: %s. Nothing was booked.\n", error);
+        return;
+    }
+    printf("Group booking successful! Your group reference number is: %s\n", groupRef);
+    for (int i = 0; i < count; i++) {
+        groupMemberRef(groupRef, i, refNo);
+        printf("  %s  seat %d  %s\n", refNo, seats[i], nameList[i < nameCount ? i : 0]);
+    }
+}
+
+
+
+void viewTicket() {
+    char refNo[REFNO_SIZE];
+    printf("\nEnter Reference Number: ");
+    scanf("%15s", refNo);
+
+    Booking current;
+    char date[DATE_TEXT_SIZE];
+    if (storeView(refNo, &current)) {
+        printf("\n=== Booking Details ===\n");
+        printf("Reference Number: %s\n", current.refNo);
+        printf("Name: %s\n", current.name);
+        printf("Flight ID: %s\n", flightName(current.flight));
+        printf("Date: %s\n", dateText(current.date, date));
+        printf("Payment: %.2f Rs\n", current.paise / 100.0);
+        return;
+    }
+    printf("No booking found with the given reference number.\n");
+}
+
+
+// Cancel a booking
+void trimWhitespace(char *str) {
+    char *end;
+    // Skip leading whitespace
+    while (*str == ' ' || *str == '\t') str++; 
+    if (*str == 0)  // If the string is all whitespace
+        return;
+    
+    end = str + strlen(str) - 1;
+    
+    // Skip trailing whitespace
+    while (end > str && (*end == ' ' || *end == '\t')) end--; 
+    
+    // Null-terminate the string at the last non-whitespace character
+    *(end + 1) = '\0';
+}
+
+
+// Function to cancel a booking
+// Cancel a booking
+
+void cancelBooking() {
+    char refNo[REFNO_SIZE];
+    printf("\nEnter Reference Number to Request Cancellation: ");
+    scanf("%15s", refNo);
+
+    const char *error = NULL;
+    if (storeCancel(refNo, &error)) {
+        printf("Cancellation request sent to admin for approval.\n");
+    } else if (strcmp(error, "cancellation already requested") == 0) {
+        printf("Cancellation already requested for this booking.\n");
+    } else {
+        printf("No booking found with the given reference number.\n");
+    }
+}
+
+
+
+
+void createCancellationFileIfNotExists() {
+    FILE *file = fopen("cancellation_requests.csv", "a");
+    if (!file) {
+        printf("Error creating or accessing the cancellation request file.\n");
+        exit(1);
+    }
+    fclose(file);
+}
+
+// Admin menu for managing flights
+void adminMenu() {
+    int choice;
+
+    while (1) {
+        printf("\n=== Admin Menu ===\n");
+        printf("1. View Cancellation Requests\n");
+        printf("2. Approve Cancellation Request\n");
+        printf("3. Add Flight\n");
+        printf("4. Remove Flight\n");
+        printf("5. View Total Payments\n");
+        printf("6. View Available Flights\n");
+        printf("7. Exit\n");
+        printf("8. Reject Cancellation Request\n");
+        printf("9. Approve All Cancellations for a Flight\n");
+        printf("10. Revenue and Occupancy Report\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+
+        switch (choice) {
+            case 1:
+                viewCancelRequests();
+                break;
+            case 2:
+                {
+                    char refNo[REFNO_SIZE];
+                    printf("\nEnter Reference Number to Approve Cancellation: ");
+                    scanf("%15s", refNo);
+                    approveCancellationFromRequest(refNo);
+                }
+                break;
+            case 3:
+                addFlight();
+                break;
+            case 4:
+                removeFlight();
+                break;
+            case 5:
+                viewTotalPayments();
+                break;
+            case 6:
+                viewAvailableFlights();
+                break;
+            case 7:
+                return;
+            case 8:
+                rejectCancelRequest();
+                break;
+            case 9:
+                approveFlightCancellationsMenu();
+                break;
+            case 10:
+                viewRevenueReport();
+                break;
+            default:
+                printf("Invalid choice.\n");
+                break;
+        }
+    }
+}
+
+
+// View cancel requests
+void viewCancelRequests() {
+    printf("\n=== Cancellation Requests ===\n");
+    char date[DATE_TEXT_SIZE];
+    for (size_t i = cancelQueue.head; i < cancelQueue.tail; i++) {
+        CancelRequest *current = cancelQueue.slots[i];
+        if (current) {
+            printf("RefNo: %s | Name: %s | FlightID: %s | Date: %s | Payment: %.2f Rs\n",
+                   current->refNo, current->name, flightName(current->flight), dateText(current->date, date),
+                   current->paise / 100.0);
+        }
+    }
+
+    if (cancelQueue.live == 0) {
+        printf("No cancellation requests found.\n");
+    }
+}
+
+
+// Function for admin authentication
+void adminAuthentication() {
+    char username[20], password[20];
+    
+    // Hardcoded admin credentials for simplicity
+    char adminUsername[] = "admin";
+    char adminPassword[] = "admin123";  // Replace with a more secure password in real apps
+
+    printf("\n=== Admin Authentication ===\n");
+    printf("Enter Admin Username: ");
+    scanf("%s", username);
+    printf("Enter Admin Password: ");
+    scanf("%s", password);
+
+    // Check if the credentials match
+    if (strcmp(username, adminUsername) == 0 && strcmp(password, adminPassword) == 0) {
+        printf("Authentication successful. Welcome, Admin!\n");
+        adminMenu();  // Grant access to admin menu
+    } else {
+        printf("Invalid credentials. Access denied.\n");
+    }
+}
+
+
+// Reject cancel request, keeping the booking
+void rejectCancelRequest() {
+    char refNo[REFNO_SIZE];
+    printf("\nEnter booking reference number to reject cancellation: ");
+    scanf("%15s", refNo);
+
+    const char *error = NULL;
+    if (storeReject(refNo, &error)) {
+        printf("Booking %s cancellation rejected.\n", refNo);
+        return;
+    }
+
+    printf("No cancellation request found for this booking.\n");
+}
+
+// Approve every pending cancellation on one flight
+void approveFlightCancellationsMenu() {
+    char flightID[10];
+    printf("\nEnter Flight ID to approve all cancellations: ");
+    scanf("%9s", flightID);
+
+    const char *error = NULL;
+    int approved = storeApproveFlight(flightID, &error);
+    if (approved < 0) {
+        printf("Flight not found.\n");
+        return;
+    }
+    printf("%d cancellation(s) approved on flight %s.\n", approved, flightID);
+}
+
+// Add a new flight
+void addFlight() {
+    Flight *newFlight = allocFlight();
+    char time[10], source[30], destination[30];
+
+    // Input details for the new flight
+    printf("Enter Flight ID: ");
+    scanf("%s", newFlight->flightID);
+    printf("Enter Date (DD/MM/YYYY): ");
+    scanf("%s", newFlight->date);
+    printf("Enter Time (HH:MM): ");
+    scanf("%9s", time);
+    printf("Enter Source: ");
+    scanf("%29s", source);
+    printf("Enter Destination: ");
+    scanf("%29s", destination);
+    setFlightText(newFlight, time, source, destination);
+    printf("Enter Price: ");
+    scanf("%f", &newFlight->price);
+
+    // A seat count gives one economy cabin; cabins are given front to back. An
+    // overbooking allowance may follow on the same line, so no extra prompt is needed.
+    char line[SEAT_LAYOUT_SIZE + 16], layoutText[SEAT_LAYOUT_SIZE];
+    unsigned overbookLimit = 0;
+    SeatLayout layout;
+    printf("Enter Number of Seats or Cabins, optionally followed by tickets to sell beyond them "
+           "(e.g. 180, or F8x4+B24x4+E144x6 5): ");
+    if (scanf(" %111[^\n]", line) != 1 || sscanf(line, "%95s %u", layoutText, &overbookLimit) < 1 ||
+        !parseSeatLayout(layoutText, &layout)) {
+        defaultSeatLayout(&layout, DEFAULT_SEAT_COUNT);
+    }
+    layout.overbookLimit = overbookLimit;
+
+    if (findFlight(newFlight->flightID)) {
+        printf("Flight '%s' already exists.\n", newFlight->flightID);
+        freeFlight(newFlight);
+        return;
+    }
+
+    // Add the flight to the linked list with an empty seat bitmap
+    dropSeatMap(newFlight->flightID);
+    registerFlightLayout(newFlight, &layout);
+
+    // Record the flight in the journal
+    journalFlight(newFlight);
+
+    printf("Flight '%s' added successfully with %d seats initialized as available.\n",
+           newFlight->flightID, newFlight->seats->seatCount);
+}
+
+
+// Function to remove a flight
+void removeFlight() {
+    char flightID[10];
+    printf("Enter the flight ID to remove: ");
+    scanf("%s", flightID);
+
+    const char *error = NULL;
+    if (storeRemoveFlight(flightID, &error)) {
+        printf("Flight removed successfully.\n");
+        return;
+    }
+
+    printf("Cannot remove flight: %s.\n", error);
+}
+
+// Sum of all booking payments, from the running totals
+double totalPayments() {
+    return totals.revenue / 100.0;
+}
+
+// Function to view total payments
+void viewTotalPayments() {
+    printf("Total payments: %.2f\n", totalPayments());
+    printArchivedTotals();
+}
+
+// Revenue and occupancy from the running totals
+void viewRevenueReport() {
+    printf("\n=== Revenue and Occupancy ===\n");
+    printf("Bookings: %ld | Revenue: %.2f Rs\n", totals.bookings, totals.revenue / 100.0);
+    printArchivedTotals();
+    BookingQuery pending = {NULL, 0, 0, 1};
+    QueryResult pendingTotal = queryBookings(&pending);
+    printf("Pending cancellations: %ld | Revenue at stake: %.2f Rs\n", pendingTotal.count, pendingTotal.paise / 100.0);
+    HoldCounts holdCounts = storeHoldCounts();
+    printf("Seat holds: %ld active | %ld created, %ld paid, %ld released, %ld expired\n", holdCounts.active,
+           holdCounts.created, holdCounts.committed, holdCounts.released, holdCounts.expired);
+    RemovalCounts removed = storeRemovalCounts();
+    printf("Removed flights: %ld bookings refunded (%.2f Rs) | %ld awaiting refund\n", removed.refunded,
+           removed.refundedPaise / 100.0, removed.pending);
+
+    printf("\nBy flight:\n");
+    for (Flight *flight = flightHead; flight; flight = flight->next) {
+        Aggregate *entry = aggregateLookup(&totals.byFlight, flight->flightID, 0);
+        int seatCount = flight->seats ? flight->seats->seatCount : 0;
+        int sold = flight->seats ? seatCount - seatsRemaining(flight->seats) - flight->seats->seatsHeld : 0;
+        printf("%-10s %-10s %s-%s | Seats sold: %d/%d (%.1f%%) | Revenue: %.2f Rs\n",
+               flight->flightID, flight->date, flightSource(flight), flightDestination(flight), sold, seatCount,
+               seatCount ? 100.0 * sold / seatCount : 0.0, entry ? entry->revenue / 100.0 : 0.0);
+    }
+
+    printf("\nBy route:\n");
+    for (size_t i = 0; i < totals.byRoute.capacity; i++) {
+        Aggregate *entry = &totals.byRoute.slots[i];
+        if (entry->key[0] && entry->bookings > 0) {
+            printf("%-20s | Bookings: %ld | Revenue: %.2f Rs\n", entry->key, entry->bookings, entry->revenue / 100.0);
+        }
+    }
+
+    printf("\nBy date:\n");
+    for (size_t i = 0; i < totals.byDate.capacity; i++) {
+        Aggregate *entry = &totals.byDate.slots[i];
+        if (entry->key[0] && entry->bookings > 0) {
+            printf("%-20s | Bookings: %ld | Revenue: %.2f Rs\n", entry->key, entry->bookings, entry->revenue / 100.0);
+        }
+    }
+}
+
+// Read the running totals from any thread: the whole store, or one flight with its seats
+int storeStats(const char *flightID, char *reply, size_t replySize) {
+    pthread_rwlock_rdlock(&storeLock);
+    int ok = 1;
+    if (!flightID) {
+        snprintf(reply, replySize, "OK %ld %.2f\n", totals.bookings, totals.revenue / 100.0);
+    } else {
+        Flight *flight = findFlight((char *)flightID);
+        Aggregate *entry = aggregateLookup(&totals.byFlight, flightID, 0);
+        if (flight && flight->seats) {
+            int remaining = seatsRemaining(flight->seats);
+            int sold = flight->seats->seatCount - remaining - flight->seats->seatsHeld;
+            snprintf(reply, replySize, "OK %ld %.2f %d %d\n", entry ? entry->bookings : 0L,
+                     entry ? entry->revenue / 100.0 : 0.0, sold, remaining);
+        } else {
+            ok = 0;
+        }
+    }
+    pthread_rwlock_unlock(&storeLock);
+    return ok;
+}
+
+// Execute one text command against the store and write a one-line reply.
+// Flight management and approvals are only accepted when allowAdmin is set.
+void executeCommand(char *line, char *reply, size_t replySize, int allowAdmin) {
+    char *save = NULL;
+    char *verb = strtok_r(line, " \t\r\n", &save);
+    const char *error = "unknown command";
+
+    if (!verb) {
+        snprintf(reply, replySize, "ERR empty command\n");
+        return;
+    }
+    if (strcasecmp(verb, "BOOK") == 0) {
+        char *flightID = strtok_r(NULL, " \t\r\n", &save);
+        char *seat = strtok_r(NULL, " \t\r\n", &save);
+        char *name = strtok_r(NULL, " \t\r\n", &save);
+        char refNo[REFNO_SIZE];
+        int seatNumber;
+        if (!flightID || !seat || !name) {
+            error = "usage: BOOK <flightID> <seat|F|B|E> <name>";
+        } else if (isalpha((unsigned char)seat[0]) && !seat[1]) {
+            // A cabin class instead of a seat: the best free seat is assigned
+            if (storeBookCabin(flightID, seat[0], name, refNo, &seatNumber, &error)) {
+                snprintf(reply, replySize, "OK %s %d\n", refNo, seatNumber);
+                return;
+            }
+        } else if (storeBook(flightID, atoi(seat), name, refNo, &error)) {
+            snprintf(reply, replySize, "OK %s\n", refNo);
+            return;
+        }
+    } else if (strcasecmp(verb, "BOOKGROUP") == 0) {
+        char *flightID = strtok_r(NULL, " \t\r\n", &save);
+        char *cabin = strtok_r(NULL, " \t\r\n", &save);
+        char *size = strtok_r(NULL, " \t\r\n", &save);
+        char *name = strtok_r(NULL, " \t\r\n", &save);
+        int adjacent = name && strcasecmp(name, "ADJACENT") == 0;
+        if (adjacent) {
+            name = strtok_r(NULL, " \t\r\n", &save);
+        }
+        int count = size ? atoi(size) : 0;
+        if (!flightID || !cabin || cabin[1] || count <= 0 || !name) {
+            error = "usage: BOOKGROUP <flightID> <F|B|E> <count> [ADJACENT] <name> [name...]";
+        } else if (count > GROUP_MAX_SIZE) {
+            error = "group size out of range";
+        } else {
+            const char *names[GROUP_MAX_SIZE];
+            int seats[GROUP_MAX_SIZE], nameCount = 0;
+            char groupRef[REFNO_SIZE];
+            while (name && nameCount < count) {
+                names[nameCount++] = name;
+                name = strtok_r(NULL, " \t\r\n", &save);
+            }
+            if (storeBookGroup(flightID, cabin[0], count, adjacent, names, nameCount, groupRef, seats, &error)) {
+                // Seats as ranges, e.g. "1-12,19-22"; a reply too short for them all ends in "..."
+                int used = snprintf(reply, replySize, "OK %s ", groupRef);
+                for (int i = 0; i < count && used < (int)replySize; i++) {
+                    int last = i;
+                    while (last + 1 < count && seats[last + 1] == seats[last] + 1) {
+                        last++;
+                    }
+                    char range[32];
+                    int length = last > i ? snprintf(range, sizeof(range), "%s%d-%d", i ? "," : "", seats[i], seats[last])
+                                          : snprintf(range, sizeof(range), "%s%d", i ? "," : "", seats[i]);
+                    if (used + length + 5 > (int)replySize) {
+                        used += snprintf(reply + used, replySize - used, "...");
+                        break;
+                    }
+                    memcpy(reply + used, range, length + 1);
+                    used += length;
+                    i = last;
+                }
+                snprintf(reply + used, replySize - used, "\n");
+                return;
+            }
+        }
+    } else if (strcasecmp(verb, "GROUP") == 0) {
+        char *groupRef = strtok_r(NULL, " \t\r\n", &save);
+        char *offset = strtok_r(NULL, " \t\r\n", &save);
+        if (!groupRef) {
+            error = "usage: GROUP <groupRef> [offset]";
+        } else if (storeGroup(groupRef, offset ? atoi(offset) : 0, GROUP_PAGE_SIZE, reply, replySize)) {
+            return;
+        } else {
+            error = "group not found";
+        }
+    } else if (strcasecmp(verb, "HOLD") == 0) {
+        char *flightID = strtok_r(NULL, " \t\r\n", &save);
+        char *seat = strtok_r(NULL, " \t\r\n", &save);
+        uint64_t holdID;
+        if (!flightID || !seat) {
+            error = "usage: HOLD <flightID> <seat>";
+        } else if (storeHold(flightID, atoi(seat), &holdID, &error)) {
+            snprintf(reply, replySize, "OK H%llx %g\n", (unsigned long long)holdID, holdTtlSeconds());
+            return;
+        }
+    } else if (strcasecmp(verb, "PAY") == 0) {
+        char *holdID = strtok_r(NULL, " \t\r\n", &save);
+        char *name = strtok_r(NULL, " \t\r\n", &save);
+        char refNo[REFNO_SIZE];
+        if (!holdID || !name || holdID[0] != 'H') {
+            error = "usage: PAY <holdID> <name>";
+        } else if (storeCommitHold(strtoull(holdID + 1, NULL, 16), name, refNo, &error)) {
+            snprintf(reply, replySize, "OK %s\n", refNo);
+            return;
+        }
+    } else if (strcasecmp(verb, "RELEASE") == 0) {
+        char *holdID = strtok_r(NULL, " \t\r\n", &save);
+        if (!holdID || holdID[0] != 'H') {
+            error = "usage: RELEASE <holdID>";
+        } else if (storeReleaseHold(strtoull(holdID + 1, NULL, 16), &error)) {
+            snprintf(reply, replySize, "OK\n");
+            return;
+        }
+    } else if (strcasecmp(verb, "METRICS") == 0) {
+        const char *path = dumpMetrics();
+        if (path) {
+            snprintf(reply, replySize, "OK %s\n", path);
+            return;
+        }
+        error = "could not write metrics";
+    } else if (strcasecmp(verb, "HOLDS") == 0) {
+        HoldCounts counts = storeHoldCounts();
+        snprintf(reply, replySize, "OK %ld %ld %ld %ld %ld\n", counts.active, counts.created,
+                 counts.committed, counts.released, counts.expired);
+        return;
+    } else if (strcasecmp(verb, "CANCEL") == 0) {
+        char *refNo = strtok_r(NULL, " \t\r\n", &save);
+        if (!refNo) {
+            error = "usage: CANCEL <refNo>";
+        } else if (storeCancel(refNo, &error)) {
+            snprintf(reply, replySize, "OK\n");
+            return;
+        }
+    } else if (strcasecmp(verb, "VIEW") == 0) {
+        char *refNo = strtok_r(NULL, " \t\r\n", &save);
+        Booking booking;
+        if (!refNo) {
+            error = "usage: VIEW <refNo>";
+        } else if (storeView(refNo, &booking)) {
+            char date[DATE_TEXT_SIZE];
+            snprintf(reply, replySize, "OK %s,%s,%s,%s,%d,%.2f,%d\n", booking.refNo, booking.name,
+                     flightName(booking.flight), dateText(booking.date, date), booking.seatNumber,
+                     booking.paise / 100.0, booking.cancelRequested);
+            return;
+        } else {
+            error = "booking not found";
+        }
+    } else if (strcasecmp(verb, "SEATS") == 0) {
+        char *flightID = strtok_r(NULL, " \t\r\n", &save);
+        int remaining = flightID ? storeSeatsRemaining(flightID) : -1;
+        if (remaining >= 0) {
+            snprintf(reply, replySize, "OK %d\n", remaining);
+            return;
+        }
+        error = flightID ? "flight not found" : "usage: SEATS <flightID>";
+    } else if (strcasecmp(verb, "SEARCH") == 0) {
+        char *source = strtok_r(NULL, " \t\r\n", &save);
+        char *destination = strtok_r(NULL, " \t\r\n", &save);
+        char *date = strtok_r(NULL, " \t\r\n", &save);
+        char *limit = strtok_r(NULL, " \t\r\n", &save);
+        if (source && destination) {
+            storeSearch(source, destination, date, limit ? atoi(limit) : SEARCH_PAGE_SIZE, reply, replySize);
+            return;
+        }
+        error = "usage: SEARCH <source> <destination> [date|*] [limit]";
+    } else if (allowAdmin && strcasecmp(verb, "APPROVE") == 0) {
+        char *refNo = strtok_r(NULL, " \t\r\n", &save);
+        if (!refNo) {
+            error = "usage: APPROVE <refNo>";
+        } else if (storeApprove(refNo, &error)) {
+            snprintf(reply, replySize, "OK\n");
+            return;
+        }
+    } else if (allowAdmin && strcasecmp(verb, "REJECT") == 0) {
+        char *refNo = strtok_r(NULL, " \t\r\n", &save);
+        if (!refNo) {
+            error = "usage: REJECT <refNo>";
+        } else if (storeReject(refNo, &error)) {
+            snprintf(reply, replySize, "OK\n");
+            return;
+        }
+    } else if (allowAdmin && strcasecmp(verb, "APPROVEFLIGHT") == 0) {
+        char *flightID = strtok_r(NULL, " \t\r\n", &save);
+        int approved;
+        if (!flightID) {
+            error = "usage: APPROVEFLIGHT <flightID>";
+        } else if ((approved = storeApproveFlight(flightID, &error)) >= 0) {
+            snprintf(reply, replySize, "OK %d\n", approved);
+            return;
+        }
+    } else if (allowAdmin && strcasecmp(verb, "STATS") == 0) {
+        if (storeStats(strtok_r(NULL, " \t\r\n", &save), reply, replySize)) {
+            return;
+        }
+        error = "flight not found";
+    } else if (allowAdmin && strcasecmp(verb, "ADDFLIGHT") == 0) {
+        Flight flight;
+        char time[10], source[30], destination[30];
+        char layoutText[SEAT_LAYOUT_SIZE];
+        unsigned overbookLimit = 0;
+        SeatLayout layout;
+        memset(&flight, 0, sizeof(flight));
+        if (sscanf(save ? save : "", "%9s %14s %9s %29s %29s %f %95s %u", flight.flightID, flight.date,
+                   time, source, destination, &flight.price, layoutText,
+                   &overbookLimit) < 7 ||
+            !parseSeatLayout(layoutText, &layout)) {
+            error = "usage: ADDFLIGHT <flightID> <date> <time> <source> <destination> <price> <seats|cabins> [overbook]";
+        } else {
+            setFlightText(&flight, time, source, destination);
+            layout.overbookLimit = overbookLimit;
+            if (storeAddFlight(&flight, &layout, &error)) {
+                snprintf(reply, replySize, "OK\n");
+                return;
+            }
+        }
+    } else if (allowAdmin && strcasecmp(verb, "REMOVEFLIGHT") == 0) {
+        char *flightID = strtok_r(NULL, " \t\r\n", &save);
+        if (!flightID) {
+            error = "usage: REMOVEFLIGHT <flightID>";
+        } else if (storeRemoveFlight(flightID, &error)) {
+            snprintf(reply, replySize, "OK\n");
+            return;
+        }
+    }
+    snprintf(reply, replySize, "ERR %s\n", error);
+}
+
+// Start a group of journal records that are flushed and fsynced together
+void journalBeginGroup() {
+    pthread_mutex_lock(&journalLock);
+    journalGroupDepth++;
+    pthread_mutex_unlock(&journalLock);
+    seatWritesDeferred = 1;
+}
+
+// Persist a group: one journal flush and fsync, then one write per changed seat map
+void journalEndGroup() {
+    pthread_mutex_lock(&journalLock);
+    int closed = journalGroupDepth > 0 && --journalGroupDepth == 0;
+    if (closed) {
+        syncJournalLocked();
+    }
+    pthread_mutex_unlock(&journalLock);
+
+    if (closed) {
+        seatWritesDeferred = 0;
+        flushDirtySeatMaps();
+    }
+}
+
+// Execute a command stream (one operation per line) in groups of groupSize operations.
+// Every group is persisted with a single flush; a COMMIT line ends a group early.
+int runBatch(FILE *input, int groupSize) {
+    char line[512];
+    char reply[REPLY_SIZE];
+    long lineNumber = 0, operations = 0, failures = 0, commits = 0;
+    int inGroup = 0;
+
+    double start = nowNanos();
+    while (fgets(line, sizeof(line), input)) {
+        lineNumber++;
+        char *text = line + strspn(line, " \t");
+        if (*text == '\n' || *text == '\r' || *text == '\0' || *text == '#') {
+            continue;
+        }
+        if (strncasecmp(text, "COMMIT", 6) == 0) {
+            if (inGroup) {
+                journalEndGroup();
+                commits++;
+                inGroup = 0;
+            }
+            continue;
+        }
+        if (!inGroup) {
+            journalBeginGroup();
+            inGroup = 1;
+        }
+
+        executeCommand(text, reply, sizeof(reply), 1);
+        printf("%ld %s", lineNumber, reply);
+        operations++;
+        failures += strncmp(reply, "OK", 2) != 0;
+
+        if (operations % groupSize == 0) {
+            journalEndGroup();
+            commits++;
+            inGroup = 0;
+        }
+    }
+    if (inGroup) {
+        journalEndGroup();
+        commits++;
+    }
+    double elapsedMs = (nowNanos() - start) / 1e6;
+
+    fprintf(stderr, "%ld operations (%ld failed) in %ld commits, %.1f ms, %.0f ops/sec\n",
+            operations, failures, commits, elapsedMs,
+            elapsedMs > 0 ? operations / (elapsedMs / 1e3) : 0.0);
+    return failures ? 1 : 0;
+}
+
+static volatile sig_atomic_t serverStopping = 0;
+
+static void stopServer(int signal) {
+    (void)signal;
+    serverStopping = 1;
+}
+
+// Release lapsed seat holds every tick, even while no client is active
+static void *holdReaper(void *arg) {
+    (void)arg;
+    int ticks = 0;
+    while (!serverStopping) {
+        usleep(HOLD_TICK_MS * 1000);
+        storeExpireHolds();
+        if (++ticks % METRICS_DUMP_TICKS == 0) {
+            dumpMetrics();
+        }
+    }
+    return NULL;
+}
+
+// Parse "<host>:<port>" for TCP; an empty host or "localhost" is the loopback address
+static int parseTcpAddress(const char *address, struct sockaddr_in *in) {
+    const char *colon = strrchr(address, ':');
+    char host[64];
+    if (!colon || colon - address >= (long)sizeof(host) || atoi(colon + 1) <= 0 || atoi(colon + 1) > 65535) {
+        return 0;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+    memset(in, 0, sizeof(*in));
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)atoi(colon + 1));
+    if (!host[0] || strcmp(host, "localhost") == 0) {
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return 1;
+    }
+    return inet_pton(AF_INET, host, &in->sin_addr) == 1;
+}
+
+// Connect to a server address as accepted by serve. Returns a blocking socket or -1.
+static int connectServer(const char *address) {
+    int fd;
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct sockaddr_in in;
+        if (!parseTcpAddress(address + 4, &in) || (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&in, sizeof(in)) != 0) {
+            close(fd);
+            return -1;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    } else {
+        struct sockaddr_un un;
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        strncpy(un.sun_path, address, sizeof(un.sun_path) - 1);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&un, sizeof(un)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Thousands of connections need more descriptors than the usual soft limit
+static void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Listen on a Unix socket path, or on TCP for "tcp:<host>:<port>". Unix sockets are
+// created with the given permissions. Returns a non-blocking listener or -1.
+static int openListener(const char *address, mode_t mode) {
+    int listener;
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct sockaddr_in in;
+        if (!parseTcpAddress(address + 4, &in) || (listener = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            return -1;
+        }
+        int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(listener, (struct sockaddr *)&in, sizeof(in)) != 0) {
+            close(listener);
+            return -1;
+        }
+    } else {
+        struct sockaddr_un un;
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        strncpy(un.sun_path, address, sizeof(un.sun_path) - 1);
+        unlink(address);
+        if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            return -1;
+        }
+        if (bind(listener, (struct sockaddr *)&un, sizeof(un)) != 0 || chmod(address, mode) != 0) {
+            close(listener);
+            return -1;
+        }
+    }
+    if (listen(listener, SERVER_BACKLOG) != 0) {
+        close(listener);
+        return -1;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    return listener;
+}
+
+// Append bytes to a connection's pending replies
+static void queueOutput(Connection *connection, const void *data, size_t length) {
+    if (connection->outLength + length > connection->outCapacity) {
+        size_t capacity = connection->outCapacity ? connection->outCapacity : 1024;
+        while (capacity < connection->outLength + length) {
+            capacity *= 2;
+        }
+        char *out = (char *)realloc(connection->out, capacity);
+        if (!out) {
+            printf("Memory allocation failed for connection output.\n");
+            exit(1);
+        }
+        connection->out = out;
+        connection->outCapacity = capacity;
+    }
+    memcpy(connection->out + connection->outLength, data, length);
+    connection->outLength += length;
+}
+
+static void putFrameHeader(unsigned char *header, int code, size_t length, uint32_t tag) {
+    header[0] = FRAME_MAGIC;
+    header[1] = (unsigned char)code;
+    header[2] = (unsigned char)(length & 0xFF);
+    header[3] = (unsigned char)(length >> 8);
+    for (int i = 0; i < 4; i++) {
+        header[4 + i] = (unsigned char)(tag >> (8 * i));
+    }
+}
+
+static size_t frameLength(const unsigned char *header) {
+    return header[2] | (size_t)header[3] << 8;
+}
+
+static uint32_t frameTag(const unsigned char *header) {
+    return header[4] | (uint32_t)header[5] << 8 | (uint32_t)header[6] << 16 | (uint32_t)header[7] << 24;
+}
+
+// Turn a binary request into the text command it stands for. Fields must be non-empty
+// and free of whitespace, since the command splits on it. Returns 0 if malformed.
+static int frameCommand(const unsigned char *frame, char *line, size_t lineSize) {
+    int op = frame[1];
+    size_t length = frameLength(frame);
+    if (op <= 0 || op >= FRAME_OPS) {
+        return 0;
+    }
+    size_t used = (size_t)snprintf(line, lineSize, "%s", frameVerbs[op]);
+    const unsigned char *field = frame + FRAME_HEADER_SIZE, *end = field + length;
+    while (field < end) {
+        const unsigned char *stop = (const unsigned char *)memchr(field, '\0', end - field);
+        if (!stop) {
+            stop = end;
+        }
+        if (stop == field || used + 1 + (stop - field) + 1 > lineSize) {
+            return 0;
+        }
+        line[used++] = ' ';
+        for (const unsigned char *c = field; c < stop; c++) {
+            if (*c <= ' ' || *c == 0x7F) {
+                return 0;
+            }
+            line[used++] = (char)*c;
+        }
+        field = stop + 1;
+    }
+    line[used] = '\0';
+    return 1;
+}
+
+// Answer one binary request. The reply frame carries the text reply without its
+// OK/ERR word, which becomes the status byte, and without the newline.
+static void answerFrame(Connection *connection, const unsigned char *frame) {
+    char line[FRAME_MAX_PAYLOAD + 32];
+    char reply[REPLY_SIZE];
+    if (frameCommand(frame, line, sizeof(line))) {
+        executeCommand(line, reply, sizeof(reply), connection->admin);
+    } else {
+        snprintf(reply, sizeof(reply), "ERR malformed request\n");
+    }
+    int failed = strncmp(reply, "OK", 2) != 0;
+    const char *text = reply + (failed ? 3 : 2);
+    if (*text == ' ') {
+        text++;
+    }
+    size_t length = strcspn(text, "\n");
+    unsigned char header[FRAME_HEADER_SIZE];
+    putFrameHeader(header, failed, length, frameTag(frame));
+    queueOutput(connection, header, sizeof(header));
+    queueOutput(connection, text, length);
+}
+
+// Answer every complete request in the input, in order, until the pending replies reach
+// CONNECTION_OUTPUT_LIMIT; blocked is set if that stopped it. Returns -1 for a request
+// the connection cannot recover from.
+static int processInput(Connection *connection) {
+    size_t used = 0;
+    connection->blocked = 0;
+    while (used < connection->inLength && !connection->quit) {
+        if (connection->outLength - connection->outSent >= CONNECTION_OUTPUT_LIMIT) {
+            connection->blocked = 1;
+            break;
+        }
+        unsigned char *request = (unsigned char *)connection->in + used;
+        size_t available = connection->inLength - used;
+        if (request[0] == FRAME_MAGIC) {
+            if (available < FRAME_HEADER_SIZE) {
+                break;
+            }
+            size_t length = frameLength(request);
+            if (length > FRAME_MAX_PAYLOAD) {
+                return -1;
+            }
+            if (available < FRAME_HEADER_SIZE + length) {
+                break;
+            }
+            answerFrame(connection, request);
+            used += FRAME_HEADER_SIZE + length;
+        } else {
+            char *newline = (char *)memchr(request, '\n', available);
+            if (!newline) {
+                break;
+            }
+            *newline = '\0';
+            char *line = (char *)request;
+            if (strncasecmp(line, "QUIT", 4) == 0) {
+                connection->quit = 1;
+            } else {
+                char reply[REPLY_SIZE];
+                executeCommand(line, reply, sizeof(reply), connection->admin);
+                queueOutput(connection, reply, strlen(reply));
+            }
+            used += newline - line + 1;
+        }
+    }
+    memmove(connection->in, connection->in + used, connection->inLength - used);
+    connection->inLength -= used;
+    // A full buffer without a complete request can never make progress
+    return connection->inLength == CONNECTION_INPUT_SIZE && !connection->blocked && !connection->quit ? -1 : 0;
+}
+
+// Read what the socket has; at end of input the connection is closed once the requests
+// already read are answered. Returns -1 on error.
+static int readInput(Connection *connection) {
+    while (connection->inLength < CONNECTION_INPUT_SIZE) {
+        ssize_t got = read(connection->fd, connection->in + connection->inLength,
+                           CONNECTION_INPUT_SIZE - connection->inLength);
+        if (got > 0) {
+            connection->inLength += got;
+        } else if (got == 0) {
+            connection->eof = 1;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Write pending replies. Returns -1 on error.
+static int writeOutput(Connection *connection) {
+    while (connection->outSent < connection->outLength) {
+        ssize_t sent = write(connection->fd, connection->out + connection->outSent,
+                             connection->outLength - connection->outSent);
+        if (sent > 0) {
+            connection->outSent += sent;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else if (sent < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    connection->outSent = connection->outLength = 0;
+    return 0;
+}
+
+// Wait for input while there is room to answer it, and for the socket to drain while
+// replies are pending
+static void watchConnection(EventLoop *loop, Connection *connection) {
+    size_t pending = connection->outLength - connection->outSent;
+    uint32_t events = 0;
+    if (pending > 0) {
+        events |= EPOLLOUT;
+    }
+    if (!connection->quit && !connection->eof && !connection->blocked) {
+        events |= EPOLLIN;
+    }
+    if (events != connection->events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = connection;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+static void closeConnection(EventLoop *loop, Connection *connection) {
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection->out);
+    free(connection);
+    __atomic_fetch_sub(&serverConnections, 1, __ATOMIC_RELAXED);
+}
+
+// Event loop thread: serve the connections handed to it until they close. Each one is
+// only ever touched by this thread, so connections need no locking of their own.
+static void *runEventLoop(void *arg) {
+    EventLoop *loop = (EventLoop *)arg;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (1) {
+        int ready = epoll_wait(loop->epollFd, events, SERVER_MAX_EVENTS, -1);
+        for (int i = 0; i < ready; i++) {
+            Connection *connection = (Connection *)events[i].data.ptr;
+            int failed = (events[i].events & EPOLLERR) || writeOutput(connection) < 0;
+            if (!failed && (events[i].events & (EPOLLIN | EPOLLHUP))) {
+                failed = readInput(connection) < 0;
+            }
+            // Keep answering while the replies drain straight away, since buffered
+            // requests bring no further events
+            do {
+                failed = failed || processInput(connection) < 0 || writeOutput(connection) < 0;
+            } while (!failed && connection->blocked && connection->outLength == 0);
+            int done = connection->quit || (connection->eof && !connection->blocked);
+            if (failed || (done && connection->outLength == 0)) {
+                closeConnection(loop, connection);
+            } else {
+                watchConnection(loop, connection);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Open the listeners and start the event loops. A Unix socket also gets an admin
+// socket beside it, "<path>.admin", that only the server's user can connect to.
+static int startServer(Server *server, const char *address, int workers) {
+    memset(server, 0, sizeof(*server));
+    raiseFileLimit();
+    server->listeners[0] = openListener(address, SERVER_SOCKET_MODE);
+    if (server->listeners[0] < 0) {
+        printf("Error listening on %s.\n", address);
+        return 0;
+    }
+    server->listenerCount = 1;
+    if (strncmp(address, "tcp:", 4) != 0) {
+        snprintf(server->adminAddress, sizeof(server->adminAddress), "%s.admin", address);
+        server->listeners[1] = openListener(server->adminAddress, 0600);
+        if (server->listeners[1] < 0) {
+            printf("Error listening on %s.\n", server->adminAddress);
+            close(server->listeners[0]);
+            return 0;
+        }
+        server->listenerCount = 2;
+    }
+
+    server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    server->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for (int i = 0; i <= server->listenerCount; i++) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(server->epollFd, EPOLL_CTL_ADD, i < server->listenerCount ? server->listeners[i] : server->wakeFd,
+                  &event);
+    }
+    server->loops = (EventLoop *)calloc(workers, sizeof(EventLoop));
+    if (!server->loops) {
+        printf("Memory allocation failed for event loops.\n");
+        exit(1);
+    }
+    for (int i = 0; i < workers; i++) {
+        EventLoop *loop = &server->loops[i];
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epollFd < 0 || pthread_create(&loop->thread, NULL, runEventLoop, loop) != 0) {
+            printf("Error starting event loop %d.\n", i);
+            exit(1);
+        }
+        pthread_detach(loop->thread);
+    }
+    server->loopCount = workers;
+    return 1;
+}
+
+// Accept clients and hand them to the event loops in turn, until the server is stopped
+static void acceptClients(Server *server) {
+    struct epoll_event events[3];
+    while (!serverStopping) {
+        int ready = epoll_wait(server->epollFd, events, 3, -1);
+        for (int i = 0; i < ready; i++) {
+            if ((int)events[i].data.u32 == server->listenerCount) {
+                continue;  // Woken by wakeServer
+            }
+            int admin = events[i].data.u32 == 1;
+            int fd;
+            while ((fd = accept4(server->listeners[admin], NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                Connection *connection = (Connection *)calloc(1, sizeof(Connection));
+                if (!connection) {
+                    close(fd);
+                    continue;
+                }
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));  // Fails harmlessly on Unix sockets
+                connection->fd = fd;
+                connection->admin = admin;
+                connection->events = EPOLLIN;
+                EventLoop *loop = &server->loops[server->accepted++ % server->loopCount];
+                __atomic_fetch_add(&serverConnections, 1, __ATOMIC_RELAXED);
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.ptr = connection;
+                if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                    closeConnection(loop, connection);
+                }
+            }
+        }
+    }
+}
+
+// Stop acceptClients running on another thread; it returns once serverStopping is set
+static void wakeServer(Server *server) {
+    uint64_t one = 1;
+    if (write(server->wakeFd, &one, sizeof(one)) != sizeof(one)) {
+        printf("Error waking the server.\n");
+    }
+}
+
+static void stopListening(Server *server, const char *address) {
+    for (int i = 0; i < server->listenerCount; i++) {
+        close(server->listeners[i]);
+    }
+    close(server->wakeFd);
+    close(server->epollFd);
+    if (strncmp(address, "tcp:", 4) != 0) {
+        unlink(address);
+        unlink(server->adminAddress);
+    }
+}
+
+// Serve clients on a socket, each worker thread running an event loop over its share
+int runServer(const char *socketPath, int workers) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;  // No SA_RESTART so epoll_wait returns on a signal
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Threads started here leave the stop signals to the accepting thread
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    Server server;
+    if (!startServer(&server, socketPath, workers)) {
+        return 1;
+    }
+    pthread_t reaper;
+    pthread_create(&reaper, NULL, holdReaper, NULL);
+    pthread_detach(reaper);
+    startRemovalWorker();
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (server.listenerCount > 1) {
+        printf("Serving on %s (admin %s) with %d event loops.\n", socketPath, server.adminAddress, workers);
+    } else {
+        printf("Serving on %s with %d event loops.\n", socketPath, workers);
+    }
+    fflush(stdout);
+
+    acceptClients(&server);
+
+    stopListening(&server, socketPath);
+    dumpMetrics();
+    pthread_rwlock_wrlock(&storeLock);
+    compactJournal();
+    printf("Server stopped.\n");
+    return 0;
+}
+
+// Monotonic clock in nanoseconds, used for timing
+double nowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Small xorshift generator so benchmark key selection stays cheap
+static unsigned long long benchRandom(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Measure refNo lookup latency through the index against a linear list scan
+static void benchBookingIndex() {
+    size_t sizes[] = {10000, 100000, 1000000};
+    size_t lookups = 1000000;
+
+    printf("bookings | index hit ns | index miss ns | list scan ns\n");
+    for (int s = 0; s < 3; s++) {
+        size_t n = sizes[s];
+        BookingIndex index = {NULL, 0, 0, 0};
+        Booking *records = (Booking *)calloc(n, sizeof(Booking));
+        if (!records) {
+            printf("Error allocating benchmark bookings.\n");
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            sprintf(records[i].refNo, "B%08zu", i);
+            records[i].next = (i + 1 < n) ? &records[i + 1] : NULL;
+            bookingIndexInsert(&index, &records[i]);
+        }
+
+        unsigned long long seed = 88172645463325252ULL;
+        size_t found = 0;
+        double start = nowNanos();
+        for (size_t j = 0; j < lookups; j++) {
+            found += bookingIndexFind(&index, records[benchRandom(&seed) % n].refNo) != NULL;
+        }
+        double hitNs = (nowNanos() - start) / lookups;
+
+        char missKeys[1024][10];
+        for (int k = 0; k < 1024; k++) {
+            sprintf(missKeys[k], "M%08d", k);
+        }
+        start = nowNanos();
+        for (size_t j = 0; j < lookups; j++) {
+            found += bookingIndexFind(&index, missKeys[j & 1023]) != NULL;
+        }
+        double missNs = (nowNanos() - start) / lookups;
+
+        // The old strcmp walk over the list, with fewer probes since each is O(n)
+        size_t scans = 100000000 / n;
+        start = nowNanos();
+        for (size_t j = 0; j < scans; j++) {
+            const char *key = records[benchRandom(&seed) % n].refNo;
+            for (Booking *current = records; current; current = current->next) {
+                if (strcmp(current->refNo, key) == 0) {
+                    found++;
+                    break;
+                }
+            }
+        }
+        double scanNs = (nowNanos() - start) / scans;
+
+        printf("%8zu | %12.1f | %13.1f | %12.1f\n", n, hitNs, missNs, scanNs);
+        if (found != lookups + scans) {
+            printf("Warning: %zu lookups returned unexpected results.\n", found);
+        }
+        releaseIndexSlots(index.slots);
+        free(records);
+    }
+}
+
+static long fileSize(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 ? (long)info.st_size : 0;
+}
+
+// Bytes in the files under a directory, or the size of a plain file
+static long directoryBytes(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return fileSize(path);
+    }
+    long total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            total += directoryBytes(child);
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+// Delete a directory and everything under it
+static void removeDirectory(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        remove(path);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            removeDirectory(child);
+        }
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Compare startup load time of the CSV files against the binary shards
+static void benchStartup() {
+    int bookings = 1000000, flights = 10000;
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return;
+    }
+
+    for (int i = 0; i < flights; i++) {
+        Flight *flight = allocFlight();
+        sprintf(flight->flightID, "F%05d", i);
+        sprintf(flight->date, "%02d/%02d/2025", i % 28 + 1, i % 12 + 1);
+        char time[10], source[30], destination[30];
+        sprintf(time, "%02d:%02d", i % 24, i % 60);
+        sprintf(source, "CITY%03d", i % 500);
+        sprintf(destination, "CITY%03d", (i * 7 + 1) % 500);
+        setFlightText(flight, time, source, destination);
+        flight->price = 1000 + i % 9000;
+        flight->seats = NULL;
+        flight->next = flightHead;
+        flightHead = flight;
+    }
+    for (int i = 0; i < bookings; i++) {
+        Booking *booking = allocBooking();
+        char text[DATE_TEXT_SIZE];
+        sprintf(booking->refNo, "B%08d", i);
+        sprintf(booking->name, "Passenger%d", i);
+        sprintf(text, "F%05d", i % flights);
+        booking->flight = flightCode(text, 1);
+        sprintf(text, "%02d/%02d/2025", i % flights % 28 + 1, i % flights % 12 + 1);
+        booking->date = packDate(text);
+        booking->seatNumber = i % 200 + 1;
+        booking->paise = (1000 + i % 9000) * 100;
+        booking->cancelRequested = 0;
+        linkBooking(booking);
+        if (i % 100 == 0) {
+            requestCancellation(booking);
+        }
+    }
+    exportCSV();
+    saveSnapshot();
+    freeStore();
+
+    double start = nowNanos();
+    loadDataFromCSV();
+    loadFlightsFromFile();
+    loadCancelRequestsFromFile();
+    double csvMs = (nowNanos() - start) / 1e6;
+    size_t csvCount = bookingIndex.count;
+    freeStore();
+
+    start = nowNanos();
+    loadSnapshot();
+    double snapshotMs = (nowNanos() - start) / 1e6;
+    size_t snapshotCount = bookingIndex.count;
+    freeStore();
+
+    long csvBytes = fileSize(DESKTOP_PATH) + fileSize(FLIGHT_FILE) + fileSize("cancellation_requests.csv");
+    printf("\nformat   | bookings | bytes     | load ms\n");
+    printf("csv      | %8zu | %9ld | %7.1f\n", csvCount, csvBytes, csvMs);
+    printf("shards   | %8zu | %9ld | %7.1f\n", snapshotCount, directoryBytes(SHARD_DIR), snapshotMs);
+    printf("speedup  | %.1fx\n", csvMs / snapshotMs);
+
+    remove(DESKTOP_PATH);
+    remove(FLIGHT_FILE);
+    remove("cancellation_requests.csv");
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+}
+
+// Resident set size of this process in bytes
+static long residentBytes() {
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file) {
+        if (fscanf(file, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(file);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Build, churn and scan 1M bookings allocated either with malloc or from the booking pool
+static void benchAllocVariant(int usePool) {
+    int count = 1000000;
+    Booking **nodes = (Booking **)malloc(count * sizeof(Booking *));
+    long before = residentBytes();
+
+    double start = nowNanos();
+    for (int i = 0; i < count; i++) {
+        nodes[i] = usePool ? allocBooking() : (Booking *)malloc(sizeof(Booking));
+        sprintf(nodes[i]->refNo, "B%08d", i);
+        nodes[i]->paise = (1000 + i % 9000) * 100;
+    }
+    // Cancel a third of the bookings and book replacements, as approvals do
+    for (int i = 0; i < count; i += 3) {
+        if (usePool) {
+            freeBooking(nodes[i]);
+        } else {
+            free(nodes[i]);
+        }
+    }
+    for (int i = 0; i < count; i += 3) {
+        nodes[i] = usePool ? allocBooking() : (Booking *)malloc(sizeof(Booking));
+        sprintf(nodes[i]->refNo, "C%08d", i);
+        nodes[i]->paise = (1000 + i % 9000) * 100;
+    }
+    Booking *list = NULL;
+    for (int i = count - 1; i >= 0; i--) {
+        nodes[i]->next = list;
+        list = nodes[i];
+    }
+    double buildMs = (nowNanos() - start) / 1e6;
+    long rss = residentBytes() - before;
+
+    // Full walk summing every payment, best of five
+    double scanMs = 0;
+    float total = 0;
+    for (int run = 0; run < 5; run++) {
+        start = nowNanos();
+        total = 0;
+        for (Booking *current = list; current; current = current->next) {
+            total += current->paise / 100.0;
+        }
+        double ms = (nowNanos() - start) / 1e6;
+        if (run == 0 || ms < scanMs) {
+            scanMs = ms;
+        }
+    }
+
+    printf("%-6s | %8.1f | %8.1f | %7.2f | %.0f\n", usePool ? "pool" : "malloc",
+           rss / 1048576.0, buildMs, scanMs, total);
+    free(nodes);
+}
+
+// Compare malloc and the slab pool for RSS and full-scan time, each in a fresh process
+static void benchAllocator() {
+    printf("alloc  |   RSS MB | build ms | scan ms | total\n");
+    for (int usePool = 0; usePool <= 1; usePool++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            benchAllocVariant(usePool);
+            fflush(stdout);
+            _exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+}
+
+typedef struct StressWorker {
+    pthread_t thread;
+    int id;
+    int seatCount;
+    int booked;
+} StressWorker;
+
+// Try every seat of the stress flight in a thread-specific order
+static void *stressWorker(void *arg) {
+    StressWorker *worker = (StressWorker *)arg;
+    char refNo[REFNO_SIZE], name[30];
+    const char *error;
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL * (worker->id + 1);
+    sprintf(name, "Thread%d", worker->id);
+    for (int i = 0; i < worker->seatCount; i++) {
+        int seat = (int)(benchRandom(&seed) % worker->seatCount) + 1;
+        worker->booked += storeBook("STRESS", seat, name, refNo, &error);
+    }
+    return NULL;
+}
+
+// Hammer a single flight from many threads and check no seat is ever sold twice
+static void benchSeatStress(int threads) {
+    int seatCount = 200;
+    int rounds = 50;
+    int failures = 0;
+    double elapsedMs = 0;
+    long attempts = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        Flight *flight = allocFlight();
+        memset(flight, 0, sizeof(Flight));
+        strcpy(flight->flightID, "STRESS");
+        strcpy(flight->date, "01/01/2025");
+        setFlightText(flight, "", "", "");
+        flight->price = 1000;
+        registerFlight(flight, seatCount);
+
+        StressWorker *workers = (StressWorker *)calloc(threads, sizeof(StressWorker));
+        double start = nowNanos();
+        for (int i = 0; i < threads; i++) {
+            workers[i].id = i;
+            workers[i].seatCount = seatCount * 4;
+            pthread_create(&workers[i].thread, NULL, stressWorker, &workers[i]);
+        }
+        int booked = 0;
+        for (int i = 0; i < threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+            booked += workers[i].booked;
+            attempts += workers[i].seatCount;
+        }
+        elapsedMs += (nowNanos() - start) / 1e6;
+
+        // Every seat must be held by exactly one booking
+        int *owners = (int *)calloc(seatCount + 1, sizeof(int));
+        for (Booking *b = head; b; b = b->next) {
+            owners[b->seatNumber]++;
+        }
+        for (int seat = 1; seat <= seatCount; seat++) {
+            if (owners[seat] != 1 || !isSeatBooked(flight->seats, seat)) {
+                failures++;
+            }
+        }
+        if (booked != seatCount - seatsRemaining(flight->seats)) {
+            failures++;
+        }
+        free(owners);
+        free(workers);
+        deleteFlight("STRESS");
+        freeStore();
+    }
+
+    printf("threads=%d rounds=%d attempts=%ld attempts/sec=%.0f double-booked or lost seats=%d\n",
+           threads, rounds, attempts, attempts / (elapsedMs / 1e3), failures);
+}
+
+// First seat of the front row with k adjacent free seats, found seat by seat; 0 if none
+static int scanForRun(SeatMap *map, int k) {
+    int rowSeats = map->layout.cabins[0].rowSeats;
+    for (int rowStart = 1; rowStart <= map->seatCount; rowStart += rowSeats) {
+        int run = 0;
+        for (int seat = rowStart; seat < rowStart + rowSeats && seat <= map->seatCount; seat++) {
+            run = isSeatBooked(map, seat) ? 0 : run + 1;
+            if (run == k) {
+                return seat - k + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Fill one economy cabin with parties of one to six, by the free-run index or by scanning
+// seat by seat, adding each request's time to the band of how full the cabin was
+static int fillCabin(const char *layoutText, int scan, unsigned long long seed, double *ns, long *requests,
+                     long *split) {
+    SeatLayout layout;
+    parseSeatLayout(layoutText, &layout);
+    SeatMap *map = createSeatMap("BENCH", &layout);
+    int seats[DEFAULT_ROW_SEATS], failures = 0;
+    while (map->seatsBooked < map->seatCount) {
+        int party = (int)(benchRandom(&seed) % DEFAULT_ROW_SEATS) + 1;
+        if (party > map->seatCount - map->seatsBooked) {
+            party = map->seatCount - map->seatsBooked;
+        }
+        double full = (double)map->seatsBooked / map->seatCount;
+        int band = full < 0.5 ? 0 : full < 0.9 ? 1 : 2;
+        int expected = scan ? 0 : scanForRun(map, party);
+        double start = nowNanos();
+        if (scan) {
+            int first = scanForRun(map, party);
+            for (int i = 0, seat = first ? first : 1; i < party; seat++) {
+                if (claimSeat(map, seat)) {
+                    seats[i++] = seat;
+                }
+            }
+        } else if (!allocateSeats(map, 0, party, 0, seats)) {
+            failures++;
+            break;
+        }
+        ns[band] += nowNanos() - start;
+        requests[band]++;
+        // The index must pick the very seats a front-to-back scan would
+        if (!scan && expected && seats[0] != expected) {
+            failures++;
+        }
+        if (!scan && seats[party - 1] - seats[0] != party - 1) {
+            (*split)++;
+        }
+    }
+    if (!scan) {
+        failures += checkSeatIndex(map);
+    }
+    dropSeatMap("BENCH");
+    return failures;
+}
+
+// Seat assignment cost as aircraft fill up, for the free-run index against a seat-by-seat
+// scan, then the overbooking allowance of a full cabin
+static int benchSeatAllocation(int rounds) {
+    const char *layouts[] = {"E180x6", "E3000x6", "E30000x6"};
+    const char *bands[] = {"0-50%", "50-90%", "90-100%"};
+    int failures = 0;
+    printf("cabin    | fill    | index ns/request | scan ns/request\n");
+    for (int l = 0; l < 3; l++) {
+        double ns[2][3] = {{0}};
+        long requests[2][3] = {{0}}, split = 0;
+        for (int round = 0; round < rounds; round++) {
+            unsigned long long seed = 0x9E3779B97F4A7C15ULL * (round + 1);
+            for (int scan = 0; scan < 2; scan++) {
+                failures += fillCabin(layouts[l], scan, seed, ns[scan], requests[scan], &split);
+            }
+        }
+        for (int b = 0; b < 3; b++) {
+            printf("%-8s | %-7s | %16.0f | %15.0f\n", layouts[l], bands[b],
+                   requests[0][b] ? ns[0][b] / requests[0][b] : 0.0, requests[1][b] ? ns[1][b] / requests[1][b] : 0.0);
+        }
+        printf("%-8s | parties split across rows: %ld of %ld\n", layouts[l], split,
+               requests[0][0] + requests[0][1] + requests[0][2]);
+    }
+
+    // Tickets past the last seat stop at the allowance and come back on cancellation
+    SeatLayout layout;
+    parseSeatLayout("F4x2@3+E12x6", &layout);
+    layout.overbookLimit = 5;
+    SeatMap *map = createSeatMap("BENCH", &layout);
+    int seats[16], sold = 0;
+    failures += !allocateSeats(map, 1, 12, 0, seats) || allocateSeats(map, 1, 1, 0, seats);
+    for (int i = 0; i < 10; i++) {
+        sold += claimOverbooked(map);
+    }
+    for (int i = 0; i < sold; i++) {
+        releaseSeat(map, SEAT_OVERBOOKED);
+    }
+    failures += sold != 5 || map->overbooked != 0 || findCabin(map, 'F') != 0 || map->cabins[0].freeSeats != 4;
+    printf("overbooking: %d of 10 tickets sold past a full cabin with an allowance of 5\n", sold);
+    dropSeatMap("BENCH");
+
+    printf("misplaced parties or index mismatches: %d\n", failures);
+    return failures ? 1 : 0;
+}
+
+// Whether a cached view holds exactly what rendering it now would produce
+static int viewCurrent(const ViewCache *cache, void (*render)(FILE *, const void *), const void *arg) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    render(out, arg);
+    fclose(out);
+    int same = cache->text && length == cache->length && memcmp(text, cache->text, length) == 0;
+    free(text);
+    return same;
+}
+
+// The flight listing and a seat availability grid, rendered on every call against served
+// from the view cache, then checks that adding a flight and booking a seat invalidate them
+static int benchViews(int flights) {
+    int rounds = 200;
+    flights = flights < 100000 ? flights : 99999;
+    for (int i = 0; i < flights; i++) {
+        Flight *flight = allocFlight();
+        memset(flight, 0, sizeof(Flight));
+        sprintf(flight->flightID, "F%05d", i % 100000);
+        sprintf(flight->date, "%02d/%02d/2025", i % 28 + 1, i % 12 + 1);
+        char time[10], source[30], destination[30];
+        sprintf(time, "%02d:%02d", i % 24, i % 60);
+        sprintf(source, "CITY%03d", i % 200);
+        sprintf(destination, "CITY%03d", (i * 7 + 1) % 200);
+        setFlightText(flight, time, source, destination);
+        flight->price = 1000 + i % 9000;
+        SeatLayout layout;
+        parseSeatLayout("F8x4+B24x4+E144x6", &layout);
+        registerFlightLayout(flight, &layout);
+    }
+    Flight *flight = findFlight("F00000");
+    ViewCache *grid = &flight->seats->availability;
+
+    fflush(stdout);
+    int devnull = open("/dev/null", O_WRONLY);
+    int console = dup(STDOUT_FILENO);
+    dup2(devnull, STDOUT_FILENO);
+
+    double ns[4];
+    for (int cached = 0; cached < 2; cached++) {
+        double start = nowNanos();
+        for (int r = 0; r < rounds; r++) {
+            flightListView.version = cached ? flightListView.version : 0;
+            viewAvailableFlights();
+            fflush(stdout);
+        }
+        ns[cached] = (nowNanos() - start) / rounds;
+        start = nowNanos();
+        for (int r = 0; r < rounds * 100; r++) {
+            grid->version = cached ? grid->version : 0;
+            showSeatAvailability(flight);
+            fflush(stdout);
+        }
+        ns[2 + cached] = (nowNanos() - start) / (rounds * 100);
+    }
+
+    // A new flight and a booked seat must each be seen by the next view
+    int failures = 0;
+    uint64_t renders = flightListView.renders;
+    Flight *added = allocFlight();
+    memset(added, 0, sizeof(Flight));
+    strcpy(added->flightID, "NEW1");
+    strcpy(added->date, "01/01/2025");
+    setFlightText(added, "", "", "");
+    registerFlight(added, DEFAULT_SEAT_COUNT);
+    viewAvailableFlights();
+    failures += flightListView.renders != renders + 1 || !viewCurrent(&flightListView, renderFlightList, NULL);
+    renders = grid->renders;
+    claimSeat(flight->seats, 1);
+    showSeatAvailability(flight);
+    showSeatAvailability(flight);
+    failures += grid->renders != renders + 1 || !viewCurrent(grid, renderSeatAvailability, flight);
+
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+
+    printf("view                     | rendered ns | cached ns | speedup\n");
+    printf("list of %6d flights   | %11.0f | %9.0f | %6.0fx\n", flights + 1, ns[0], ns[1],
+           ns[1] > 0 ? ns[0] / ns[1] : 0.0);
+    printf("availability, %4d seats | %11.0f | %9.0f | %6.0fx\n", flight->seats->seatCount, ns[2], ns[3],
+           ns[3] > 0 ? ns[2] / ns[3] : 0.0);
+    printf("stale views after a change: %d\n", failures);
+
+    char flightID[10];
+    for (int i = 0; i < flights; i++) {
+        sprintf(flightID, "F%05d", i % 100000);
+        deleteFlight(flightID);
+    }
+    deleteFlight("NEW1");
+    freeStore();
+    return failures ? 1 : 0;
+}
+
+// Route search latency over a large synthetic schedule against a full list scan
+static void benchRouteSearch() {
+    int sizes[] = {10000, 100000, 500000};
+    int cities = 200;
+    int queries = 100000;
+    Flight *results[SEARCH_PAGE_SIZE];
+
+    printf("flights | build ms | search ns | matches/query | list scan ns\n");
+    for (int s = 0; s < 3; s++) {
+        int n = sizes[s];
+        for (int i = 0; i < n; i++) {
+            Flight *flight = allocFlight();
+            sprintf(flight->flightID, "F%06d", i);
+            sprintf(flight->date, "%02d/%02d/2025", i % 28 + 1, (i / 28) % 12 + 1);
+            char time[10], source[30], destination[30];
+            sprintf(time, "%02d:%02d", (i * 7) % 24, (i * 13) % 60);
+            sprintf(source, "CITY%03d", i % cities);
+            sprintf(destination, "CITY%03d", (i / cities) % cities);
+            setFlightText(flight, time, source, destination);
+            flight->price = 1000 + (i * 37) % 9000;
+            flight->seats = NULL;
+            flight->next = flightHead;
+            flightHead = flight;
+            internFlight(flight);
+        }
+
+        double start = nowNanos();
+        rebuildRouteIndex();
+        double buildMs = (nowNanos() - start) / 1e6;
+
+        char source[30], destination[30], date[15];
+        unsigned long long seed = 2463534242ULL;
+        long matches = 0;
+        start = nowNanos();
+        for (int q = 0; q < queries; q++) {
+            int i = (int)(benchRandom(&seed) % n);
+            sprintf(source, "CITY%03d", i % cities);
+            sprintf(destination, "CITY%03d", (i / cities) % cities);
+            sprintf(date, "%02d/%02d/2025", i % 28 + 1, (i / 28) % 12 + 1);
+            int total;
+            searchFlights(source, destination, date, 0, 5000, 0, SEARCH_PAGE_SIZE, results, &total);
+            matches += total;
+        }
+        double searchNs = (nowNanos() - start) / queries;
+
+        // What answering the same question from the flight list costs
+        int scans = 200;
+        start = nowNanos();
+        for (int q = 0; q < scans; q++) {
+            int i = (int)(benchRandom(&seed) % n);
+            sprintf(source, "CITY%03d", i % cities);
+            sprintf(destination, "CITY%03d", (i / cities) % cities);
+            sprintf(date, "%02d/%02d/2025", i % 28 + 1, (i / 28) % 12 + 1);
+            for (Flight *f = flightHead; f; f = f->next) {
+                if (strcmp(flightSource(f), source) == 0 && strcmp(flightDestination(f), destination) == 0 &&
+                    strcmp(f->date, date) == 0 && f->price <= 5000) {
+                    matches++;
+                }
+            }
+        }
+        double scanNs = (nowNanos() - start) / scans;
+
+        printf("%7d | %8.1f | %9.1f | %13.2f | %12.0f\n", n, buildMs, searchNs,
+               (double)matches / (queries + scans), scanNs);
+        freeStore();
+    }
+}
+
+// Fill the store with a synthetic schedule: flights with seat maps and bookings spread
+// over them, every 50th booking with a pending cancellation
+void generateDataset(int flights, int seatsPerFlight, long bookings) {
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < flights; i++) {
+        Flight *flight = allocFlight();
+        memset(flight, 0, sizeof(Flight));
+        snprintf(flight->flightID, sizeof(flight->flightID), "F%06u", (unsigned)i % 1000000u);
+        sprintf(flight->date, "%02d/%02d/2025", i % 28 + 1, (i / 28) % 12 + 1);
+        char time[10], source[30], destination[30];
+        sprintf(time, "%02d:%02d", (i * 7) % 24, (i * 13) % 60);
+        sprintf(source, "CITY%03d", i % 200);
+        sprintf(destination, "CITY%03d", (i / 200 + 1 + i % 199) % 200);
+        setFlightText(flight, time, source, destination);
+        flight->price = 1000 + (i * 37) % 9000;
+        registerFlight(flight, seatsPerFlight);
+    }
+
+    Flight **byIndex = (Flight **)malloc(flights * sizeof(Flight *));
+    int i = flights;
+    for (Flight *f = flightHead; f; f = f->next) {
+        byIndex[--i] = f;
+    }
+    for (long b = 0; b < bookings; b++) {
+        // Fill flights evenly: booking b takes the next free seat of flight b % flights
+        Flight *flight = byIndex[b % flights];
+        int seat = (int)(b / flights) + 1;
+        if (seat > seatsPerFlight || !claimSeat(flight->seats, seat)) {
+            continue;
+        }
+        Booking *booking = allocBooking();
+        snprintf(booking->refNo, sizeof(booking->refNo), "B%08lu", (unsigned long)b % 100000000UL);
+        snprintf(booking->name, sizeof(booking->name), "Passenger%d", (int)(benchRandom(&seed) % 1000000));
+        booking->flight = flight->code;
+        booking->date = flight->departure;
+        booking->seatNumber = seat;
+        booking->paise = toPaise(flight->price);
+        booking->cancelRequested = 0;
+        linkBooking(booking);
+        if (b % 50 == 0) {
+            requestCancellation(booking);
+        }
+    }
+    free(byIndex);
+}
+
+// generate <dir> [--flights N] [--seats N] [--bookings N]: write a synthetic dataset
+// as CSV files, seat inventory and snapshot into dir
+int runGenerate(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s generate <dir> [--flights N] [--seats N] [--bookings N]\n", argv[0]);
+        return 1;
+    }
+    int flights = 1000, seats = DEFAULT_SEAT_COUNT;
+    long bookings = 100000;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--flights") == 0) flights = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seats") == 0) seats = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--bookings") == 0) bookings = atol(argv[i + 1]);
+    }
+    mkdir(argv[2], 0755);
+    if (chdir(argv[2]) != 0 || flights <= 0 || seats <= 0) {
+        printf("Error preparing dataset directory %s.\n", argv[2]);
+        return 1;
+    }
+    if (access(SEAT_INVENTORY_FILE, F_OK) == 0 || access(SHARD_DIR, F_OK) == 0 || access(SNAPSHOT_FILE, F_OK) == 0) {
+        printf("%s already holds a dataset.\n", argv[2]);
+        return 1;
+    }
+    loadSeatInventory();
+    generateDataset(flights, seats, bookings);
+    int ok = exportCSV() && saveSnapshot();
+    printf("Generated %d flights and %zu bookings in %s\n", flights, bookingIndex.count, argv[2]);
+    return ok ? 0 : 1;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Emit one benchmark result as a JSON line
+static void reportBench(FILE *out, const char *name, long ops, long failed, double totalNs,
+                        double *samples, long sampleCount, uint64_t bytes) {
+    double p50 = 0, p99 = 0;
+    if (sampleCount > 0) {
+        qsort(samples, sampleCount, sizeof(double), compareDoubles);
+        p50 = samples[(long)(0.50 * (sampleCount - 1))];
+        p99 = samples[(long)(0.99 * (sampleCount - 1))];
+    }
+    fprintf(out, "{\"bench\":\"%s\",\"ops\":%ld,\"failed\":%ld,\"ops_per_sec\":%.1f,"
+                 "\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"total_ms\":%.3f,\"bytes_written\":%llu}\n",
+            name, ops, failed, totalNs > 0 ? ops / (totalNs / 1e9) : 0.0, p50, p99,
+            totalNs / 1e6, (unsigned long long)bytes);
+    fflush(out);
+}
+
+// Generate a dataset in a scratch directory and time each hot path on it.
+// bench suite [--flights N] [--seats N] [--bookings N] [--ops N] [--output file]
+static int benchSuite(int argc, char *argv[]) {
+    int flights = 1000, seats = DEFAULT_SEAT_COUNT;
+    long bookings = 100000, ops = 5000;
+    FILE *out = stdout;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--flights") == 0) flights = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seats") == 0) seats = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--bookings") == 0) bookings = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "--ops") == 0) ops = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "--output") == 0 && !(out = fopen(argv[i + 1], "w"))) {
+            printf("Error opening %s.\n", argv[i + 1]);
+            return 1;
+        }
+    }
+    if (flights <= 0 || seats <= 0 || ops <= 0) {
+        printf("Flights, seats and ops must be positive.\n");
+        return 1;
+    }
+
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    // Keep the progress messages of the loaders out of the results
+    int console = dup(STDOUT_FILENO);
+    if (out == stdout) {
+        out = fdopen(dup(STDOUT_FILENO), "w");
+    }
+    if (!freopen("/dev/null", "w", stdout)) {
+        return 1;
+    }
+
+    loadSeatInventory();
+    openJournal();
+    generateDataset(flights, seats, bookings);
+    uint64_t written = bytesWritten;
+    double start = nowNanos();
+    exportCSV();
+    reportBench(out, "save_csv", 1, 0, nowNanos() - start, NULL, 0, bytesWritten - written);
+    written = bytesWritten;
+    start = nowNanos();
+    saveSnapshot();
+    reportBench(out, "save_snapshot", 1, 0, nowNanos() - start, NULL, 0, bytesWritten - written);
+    freeStore();
+
+    start = nowNanos();
+    loadDataFromCSV();
+    loadFlightsFromFile();
+    loadCancelRequestsFromFile();
+    reportBench(out, "load_csv", 1, 0, nowNanos() - start, NULL, 0, 0);
+    freeStore();
+    start = nowNanos();
+    loadSnapshot();
+    reportBench(out, "load_snapshot", 1, 0, nowNanos() - start, NULL, 0, 0);
+    attachSeatMaps();
+
+    double *samples = (double *)malloc(ops * sizeof(double));
+    unsigned long long seed = 88172645463325252ULL;
+    char flightID[10], refNo[REFNO_SIZE];
+    const char *error;
+    long failed = 0;
+
+    double total = 0;
+    for (long i = 0; i < ops; i++) {
+        snprintf(flightID, sizeof(flightID), "F%06u", (unsigned)(benchRandom(&seed) % flights) % 1000000u);
+        start = nowNanos();
+        failed += findFlight(flightID) == NULL;
+        samples[i] = nowNanos() - start;
+        total += samples[i];
+    }
+    reportBench(out, "find_flight", ops, failed, total, samples, ops, 0);
+
+    // Booking: seat claim, seat inventory write and journal append
+    written = bytesWritten;
+    total = 0;
+    failed = 0;
+    for (long i = 0; i < ops; i++) {
+        snprintf(flightID, sizeof(flightID), "F%06u", (unsigned)(benchRandom(&seed) % flights) % 1000000u);
+        int seat = (int)(benchRandom(&seed) % seats) + 1;
+        start = nowNanos();
+        failed += !storeBook(flightID, seat, "Bench", refNo, &error);
+        samples[i] = nowNanos() - start;
+        total += samples[i];
+    }
+    reportBench(out, "book", ops, failed, total, samples, ops, bytesWritten - written);
+
+    // Cancellation request: what used to rewrite all of details.csv
+    written = bytesWritten;
+    total = 0;
+    failed = 0;
+    for (long i = 0; i < ops; i++) {
+        snprintf(refNo, sizeof(refNo), "B%08lu",
+                 (unsigned long)(benchRandom(&seed) % (bookings ? bookings : 1)) % 100000000UL);
+        start = nowNanos();
+        failed += !storeCancel(refNo, &error);
+        samples[i] = nowNanos() - start;
+        total += samples[i];
+    }
+    reportBench(out, "cancel_request", ops, failed, total, samples, ops, bytesWritten - written);
+
+    int scans = 20;
+    total = 0;
+    for (int i = 0; i < scans; i++) {
+        start = nowNanos();
+        volatile double sum = totalPayments();
+        (void)sum;
+        samples[i] = nowNanos() - start;
+        total += samples[i];
+    }
+    reportBench(out, "total_payments", scans, 0, total, samples, scans, 0);
+
+    written = bytesWritten;
+    start = nowNanos();
+    compactJournal();
+    reportBench(out, "compact_journal", 1, 0, nowNanos() - start, NULL, 0, bytesWritten - written);
+
+    free(samples);
+    freeStore();
+    const char *files[] = {DESKTOP_PATH, FLIGHT_FILE, "cancellation_requests.csv", SNAPSHOT_FILE,
+                           SEAT_INVENTORY_FILE, JOURNAL_FILE};
+    for (int i = 0; i < 6; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    fclose(out);
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    return 0;
+}
+
+// Ingestion speed of details.csv: the old fgets/sscanf parse, the mapped tokenizer alone,
+// and a full load into the store
+static int benchCSV(long rows) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+
+    FILE *file = fopen(DESKTOP_PATH, "w");
+    if (!file) {
+        printf("Error opening %s.\n", DESKTOP_PATH);
+        return 1;
+    }
+    for (long i = 0; i < rows; i++) {
+        fprintf(file, "B%08lu,Passenger%ld,F%05ld,%02ld/%02ld/2025,%ld,%ld.%02ld,%d\n",
+                (unsigned long)i % 100000000UL, i % 100000, i % 10000, i % 28 + 1, i % 12 + 1,
+                i % 200 + 1, 1000 + i % 9000, i % 100, i % 50 == 0);
+    }
+    fclose(file);
+    struct stat info;
+    stat(DESKTOP_PATH, &info);
+    double megabytes = info.st_size / 1e6;
+    printf("rows=%ld size_mb=%.1f\n", rows, megabytes);
+
+    Booking booking;
+    char flightID[10], date[DATE_TEXT_SIZE];
+    double payment;
+    long parsed = 0;
+    double start = nowNanos();
+    file = fopen(DESKTOP_PATH, "r");
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        parsed += sscanf(line, "%15[^,],%29[^,],%9[^,],%14[^,],%d,%lf,%d", booking.refNo, booking.name,
+                         flightID, date, &booking.seatNumber, &payment,
+                         &booking.cancelRequested) == 7;
+    }
+    fclose(file);
+    double ms = (nowNanos() - start) / 1e6;
+    printf("fgets+sscanf parse | %8ld rows | %8.1f ms | %7.1f MB/s\n", parsed, ms, megabytes / (ms / 1e3));
+
+    CsvReader reader;
+    CsvField fields[CSV_MAX_FIELDS];
+    int count;
+    parsed = 0;
+    start = nowNanos();
+    csvOpen(&reader, DESKTOP_PATH);
+    while ((count = csvNextRow(&reader, fields)) >= 0) {
+        parsed += parseBookingRow(fields, count, &booking) == NULL;
+    }
+    csvClose(&reader);
+    ms = (nowNanos() - start) / 1e6;
+    printf("mapped parse       | %8ld rows | %8.1f ms | %7.1f MB/s\n", parsed, ms, megabytes / (ms / 1e3));
+
+    int console = dup(STDOUT_FILENO);  // Silence the loader's message
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    start = nowNanos();
+    loadDataFromCSV();
+    ms = (nowNanos() - start) / 1e6;
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+    printf("full load          | %8zu rows | %8.1f ms | %7.1f MB/s\n", bookingIndex.count, ms, megabytes / (ms / 1e3));
+
+    freeStore();
+    remove(DESKTOP_PATH);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
+
+// Load the same generated dataset from CSV and from the snapshot with 1 to 32 loader
+// threads. Speedups are relative to one thread and need as many cores to show.
+static int benchParallelLoad(long bookings) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int flights = bookings / 100 > 0 ? (int)(bookings / 100) : 1;
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    generateDataset(flights, DEFAULT_SEAT_COUNT, bookings);
+    exportCSV();
+    saveSnapshot();
+    freeStore();
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+
+    static const int threadCounts[] = {1, 2, 4, 8, 16, 32};
+    double csvBase = 0, snapshotBase = 0;
+    printf("cpus=%ld bookings=%ld flights=%d\n", sysconf(_SC_NPROCESSORS_ONLN), bookings, flights);
+    printf("threads | csv ms   | speedup | snapshot ms | speedup | bookings\n");
+    for (int i = 0; i < 6; i++) {
+        loaderThreads = threadCounts[i];
+        fflush(stdout);
+        dup2(devnull, STDOUT_FILENO);
+        memset(&startupReport, 0, sizeof(startupReport));
+        double start = nowNanos();
+        loadDataFromCSV();
+        loadFlightsFromFile();
+        loadCancelRequestsFromFile();
+        double csvMs = (nowNanos() - start) / 1e6;
+        size_t csvCount = bookingIndex.count;
+        freeStore();
+        memset(&startupReport, 0, sizeof(startupReport));
+        start = nowNanos();
+        loadSnapshot();
+        double snapshotMs = (nowNanos() - start) / 1e6;
+        size_t snapshotCount = bookingIndex.count;
+        freeStore();
+        fflush(stdout);
+        dup2(console, STDOUT_FILENO);
+
+        if (i == 0) {
+            csvBase = csvMs;
+            snapshotBase = snapshotMs;
+        }
+        printf("%7d | %8.1f | %6.2fx | %11.1f | %6.2fx | %zu/%zu\n", loaderThreads, csvMs, csvBase / csvMs,
+               snapshotMs, snapshotBase / snapshotMs, csvCount, snapshotCount);
+    }
+    loaderThreads = 0;
+    close(console);
+    close(devnull);
+
+    const char *files[] = {DESKTOP_PATH, FLIGHT_FILE, "cancellation_requests.csv", SNAPSHOT_FILE,
+                           SEAT_INVENTORY_FILE, JOURNAL_FILE};
+    for (int i = 0; i < 6; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
+
+// Hold a million seats, pay for and release some, then let the rest lapse. Idle ticks
+// only visit one wheel bucket, against scanning every outstanding hold.
+static int benchHolds(long count) {
+    int seatsPerFlight = 1000;
+    int flights = (int)((count + seatsPerFlight - 1) / seatsPerFlight);
+    for (int i = 0; i < flights; i++) {
+        Flight *flight = allocFlight();
+        memset(flight, 0, sizeof(Flight));
+        snprintf(flight->flightID, sizeof(flight->flightID), "H%06d", i % 1000000);
+        strcpy(flight->date, "01/01/2026");
+        setFlightText(flight, "10:00", "DEL", "BOM");
+        flight->price = 5000;
+        registerFlight(flight, seatsPerFlight);
+    }
+    Flight **byIndex = (Flight **)malloc(flights * sizeof(Flight *));
+    uint64_t *ids = (uint64_t *)malloc(count * sizeof(uint64_t));
+    if (!byIndex || !ids) {
+        printf("Error allocating benchmark holds.\n");
+        return 1;
+    }
+    int f = flights;
+    for (Flight *flight = flightHead; flight; flight = flight->next) {
+        byIndex[--f] = flight;
+    }
+
+    const char *error;
+    long failed = 0;
+    double start = nowNanos();
+    for (long i = 0; i < count; i++) {
+        failed += !storeHold(byIndex[i / seatsPerFlight]->flightID, (int)(i % seatsPerFlight) + 1, &ids[i], &error);
+    }
+    double holdNs = (nowNanos() - start) / count;
+
+    char refNo[REFNO_SIZE];
+    start = nowNanos();
+    for (long i = 0; i < count; i += 10) {
+        failed += !storeCommitHold(ids[i], "Passenger", refNo, &error);
+    }
+    double commitNs = (nowNanos() - start) / ((count + 9) / 10);
+    start = nowNanos();
+    for (long i = 1; i < count; i += 10) {
+        failed += !storeReleaseHold(ids[i], &error);
+    }
+    double releaseNs = (nowNanos() - start) / ((count + 8) / 10);
+
+    // A minute of idle ticks with the remaining holds outstanding
+    int ticks = 60 * 1000 / HOLD_TICK_MS;
+    uint64_t now = holds.tick;
+    start = nowNanos();
+    for (int t = 1; t <= ticks; t++) {
+        pthread_mutex_lock(&holdLock);
+        expireHoldsLocked(now + t);
+        pthread_mutex_unlock(&holdLock);
+    }
+    double tickNs = (nowNanos() - start) / ticks;
+    long outstanding = holds.active;
+
+    // What one tick would cost if every hold had to be checked instead
+    long due = 0;
+    start = nowNanos();
+    for (uint32_t i = 0; i < holds.capacity; i++) {
+        due += holds.entries[i].map && holds.entries[i].expiresAt <= now + ticks;
+    }
+    double scanNs = nowNanos() - start;
+
+    start = nowNanos();
+    pthread_mutex_lock(&holdLock);
+    expireHoldsLocked(now + ticks + (uint64_t)(holdTtlSeconds() * 1000 / HOLD_TICK_MS) + 1);
+    pthread_mutex_unlock(&holdLock);
+    double expireMs = (nowNanos() - start) / 1e6;
+
+    long available = 0;
+    for (int i = 0; i < flights; i++) {
+        available += seatsRemaining(byIndex[i]->seats);
+    }
+    HoldCounts counts = storeHoldCounts();
+    printf("holds=%ld flights=%d failed=%ld due_early=%ld\n", count, flights, failed, due);
+    printf("hold %.0f ns | pay %.0f ns | release %.0f ns\n", holdNs, commitNs, releaseNs);
+    printf("idle tick with %ld holds outstanding: %.0f ns (full scan %.0f ns)\n", outstanding, tickNs, scanNs);
+    printf("expire %ld holds: %.1f ms\n", counts.expired, expireMs);
+    printf("created=%ld paid=%ld released=%ld expired=%ld active=%ld seats available=%ld booked=%zu\n", counts.created,
+           counts.committed, counts.released, counts.expired, counts.active, available, bookingIndex.count);
+    int mismatch = failed || due || counts.active || available + (long)bookingIndex.count != (long)flights * seatsPerFlight;
+    free(ids);
+    free(byIndex);
+    freeStore();
+    return mismatch;
+}
+
+static void *metricsWorker(void *arg) {
+    long count = *(long *)arg;
+    for (long i = 0; i < count; i++) {
+        metricRecord(METRIC_LOOKUP, nowNanos());
+    }
+    return NULL;
+}
+
+// Cost of recording a sample next to the clock reads it needs, and of rendering the exposition
+static int benchMetrics(long count, int threads) {
+    double start = nowNanos();
+    volatile double sink = 0;
+    for (long i = 0; i < count; i++) {
+        sink = nowNanos();
+    }
+    (void)sink;
+    double clockNs = (nowNanos() - start) / count;
+
+    start = nowNanos();
+    for (long i = 0; i < count; i++) {
+        metricRecord(METRIC_BOOK, nowNanos());
+    }
+    double recordNs = (nowNanos() - start) / count;
+
+    pthread_t workers[MAX_LOADER_THREADS];
+    threads = threads < 1 ? 1 : threads > MAX_LOADER_THREADS ? MAX_LOADER_THREADS : threads;
+    start = nowNanos();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, metricsWorker, &count);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double parallelMs = (nowNanos() - start) / 1e6;
+
+    FILE *devNull = fopen("/dev/null", "w");
+    if (!devNull) {
+        printf("Error opening /dev/null.\n");
+        return 1;
+    }
+    start = nowNanos();
+    writeMetrics(devNull);
+    double renderUs = (nowNanos() - start) / 1e3;
+    fclose(devNull);
+
+    printf("samples=%ld threads=%d\n", count, threads);
+    printf("clock read %.1f ns | clock read + record %.1f ns | record overhead %.1f ns\n", clockNs, recordNs,
+           recordNs - clockNs);
+    printf("%d threads x %ld samples: %.1f ms (%.1f ns per sample)\n", threads, count, parallelMs,
+           parallelMs * 1e6 / ((double)count * threads));
+    printf("render exposition: %.0f us\n", renderUs);
+    writeMetrics(stdout);
+    return 0;
+}
+
+// Time report queries over the booking columns with each scan kernel against walking the list
+static int benchColumns(long rows) {
+    int flights = 1000;
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    Booking *list = NULL;
+    double start = nowNanos();
+    for (long i = 0; i < rows; i++) {
+        Booking *booking = allocBooking();
+        memset(booking, 0, sizeof(Booking));
+        int flight = (int)(benchRandom(&seed) % flights);
+        char text[DATE_TEXT_SIZE];
+        snprintf(text, sizeof(text), "F%06d", flight);
+        booking->flight = flightCode(text, 1);
+        snprintf(text, sizeof(text), "%02d/%02d/2025", flight % 28 + 1, (flight / 28) % 12 + 1);
+        booking->date = packDate(text);
+        booking->paise = 100000 + benchRandom(&seed) % 900000;
+        booking->cancelRequested = i % 50 == 0;
+        booking->next = list;
+        list = booking;
+        appendBookingRow(booking);
+    }
+    printf("rows=%ld build_ms=%.0f column_bytes/row=%zu\n", rows, (nowNanos() - start) / 1e6,
+           3 * sizeof(uint32_t) + sizeof(uint8_t));
+
+    const char *names[] = {"one flight", "pending cancellations", "one month"};
+    BookingQuery queries[3];
+    memset(queries, 0, sizeof(queries));
+    queries[0].flightID = "F000042";
+    queries[1].pendingOnly = 1;
+    queries[2].fromDate = 20250301;
+    queries[2].toDate = 20250331;
+
+    int supported = bestScanKernel();
+    int failed = 0;
+    printf("query                 | matches | list ms | scalar ms | sse2 ms | avx2 ms\n");
+    for (int q = 0; q < 3; q++) {
+        // The list walk a report would do without the columns: every node visited
+        start = nowNanos();
+        long listCount = 0;
+        int64_t listPaise = 0;
+        uint32_t code = queries[q].flightID ? flightCode(queries[q].flightID, 0) : 0;
+        for (Booking *b = list; b; b = b->next) {
+            int date = (queries[q].fromDate || queries[q].toDate) ? packedDateKey(b->date) : 0;
+            if ((!queries[q].flightID || b->flight == code) &&
+                date >= queries[q].fromDate && (!queries[q].toDate || date <= queries[q].toDate) &&
+                (!queries[q].pendingOnly || b->cancelRequested)) {
+                listCount++;
+                listPaise += b->paise;
+            }
+        }
+        double listMs = (nowNanos() - start) / 1e6;
+
+        ColumnFilter filter;
+        filter.anyFlight = queries[q].flightID == NULL;
+        filter.flight = filter.anyFlight ? 0 : flightCode(queries[q].flightID, 0);
+        filter.fromDate = queries[q].fromDate;
+        filter.toDate = queries[q].toDate ? queries[q].toDate : INT32_MAX - 1;
+        filter.statusMask = filter.statusValue = queries[q].pendingOnly ? STATUS_CANCEL_REQUESTED : 0;
+
+        double kernelMs[3] = {0, 0, 0};
+        for (int kernel = SCAN_SCALAR; kernel <= SCAN_AVX2; kernel++) {
+            if (kernel > supported) {
+                continue;
+            }
+            QueryResult result = {0, 0};
+            for (int run = 0; run < 5; run++) {  // Best of five
+                start = nowNanos();
+                result = scanColumns(&filter, kernel);
+                double ms = (nowNanos() - start) / 1e6;
+                if (run == 0 || ms < kernelMs[kernel - SCAN_SCALAR]) {
+                    kernelMs[kernel - SCAN_SCALAR] = ms;
+                }
+            }
+            if (result.count != listCount || result.paise != listPaise) {
+                printf("Kernel %d disagrees on '%s': %ld rows, %lld paise; list has %ld rows, %lld paise\n",
+                       kernel, names[q], result.count, (long long)result.paise, listCount, (long long)listPaise);
+                failed = 1;
+            }
+        }
+        printf("%-21s | %7ld | %7.1f | %9.2f | %7.2f | %7.2f\n", names[q], listCount, listMs,
+               kernelMs[0], kernelMs[1], kernelMs[2]);
+    }
+    freeStore();
+    return failed;
+}
+
+typedef struct RefNoWorker {
+    pthread_t thread;
+    uint64_t *values;
+    long count;
+    long unordered;
+} RefNoWorker;
+
+static void *refNoWorker(void *arg) {
+    RefNoWorker *worker = (RefNoWorker *)arg;
+    char refNo[REFNO_SIZE];
+    for (long i = 0; i < worker->count; i++) {
+        generateRefNo(refNo);
+        worker->values[i] = decodeRefNo(refNo);
+        if (i > 0 && worker->values[i] <= worker->values[i - 1]) {
+            worker->unordered++;
+        }
+    }
+    return NULL;
+}
+
+static int compareUint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Generate 10M reference numbers from several threads and check none repeats
+static int benchRefNo(int threads) {
+    long total = 10000000;
+    threads = threads > 0 ? threads : 1;  // The ids are split evenly between the threads
+    uint64_t *values = (uint64_t *)malloc(total * sizeof(uint64_t));
+    RefNoWorker *workers = (RefNoWorker *)calloc(threads, sizeof(RefNoWorker));
+    if (!values || !workers) {
+        printf("Error allocating reference numbers.\n");
+        return 1;
+    }
+
+    double start = nowNanos();
+    for (int i = 0; i < threads; i++) {
+        workers[i].values = values + i * (total / threads);
+        workers[i].count = (i == threads - 1) ? total - i * (total / threads) : total / threads;
+        pthread_create(&workers[i].thread, NULL, refNoWorker, &workers[i]);
+    }
+    long unordered = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        unordered += workers[i].unordered;
+    }
+    double elapsedMs = (nowNanos() - start) / 1e6;
+
+    qsort(values, total, sizeof(uint64_t), compareUint64);
+    long collisions = 0;
+    for (long i = 1; i < total; i++) {
+        collisions += values[i] == values[i - 1];
+    }
+    char sample[REFNO_SIZE];
+    generateRefNo(sample);
+    printf("threads=%d ids=%ld ids/sec=%.0f collisions=%ld out-of-order=%ld sample=%s\n",
+           threads, total, total / (elapsedMs / 1e3), collisions, unordered, sample);
+    free(values);
+    free(workers);
+    return collisions || unordered ? 1 : 0;
+}
+
+// Sharded storage: a full save against the compaction that follows one booking, then
+// startup with every date live against startup with the first half of the year archived,
+// and the refNo lookup that has to unpack an archived day
+static int benchShards(long bookings) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int flights = bookings / 100 > 0 ? (int)(bookings / 100) : 1;
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    generateDataset(flights, DEFAULT_SEAT_COUNT, bookings);
+
+    uint64_t written = bytesWritten;
+    double start = nowNanos();
+    saveSnapshot();
+    double fullMs = (nowNanos() - start) / 1e6;
+    uint64_t fullBytes = bytesWritten - written;
+
+    Booking *extra = allocBooking();
+    *extra = *head;
+    generateRefNo(extra->refNo);
+    linkBooking(extra);
+    written = bytesWritten;
+    start = nowNanos();
+    saveSnapshot();
+    double oneMs = (nowNanos() - start) / 1e6;
+    uint64_t oneBytes = bytesWritten - written;
+    freeStore();
+
+    memset(&startupReport, 0, sizeof(startupReport));
+    start = nowNanos();
+    loadSnapshot();
+    double liveMs = (nowNanos() - start) / 1e6;
+    size_t liveCount = bookingIndex.count;
+    char refNo[REFNO_SIZE] = "";
+    int earliest = INT_MAX;
+    for (Booking *b = head; b; b = b->next) {
+        if (packedDateKey(b->date) < earliest) {
+            earliest = packedDateKey(b->date);
+            strcpy(refNo, b->refNo);
+        }
+    }
+    freeStore();
+
+    start = nowNanos();
+    int days = archiveShards(20250701);
+    double archiveMs = (nowNanos() - start) / 1e6;
+    memset(&startupReport, 0, sizeof(startupReport));
+    start = nowNanos();
+    scanArchives();
+    loadSnapshot();
+    double halfMs = (nowNanos() - start) / 1e6;
+    size_t halfCount = bookingIndex.count;
+    uint64_t rawBytes = 0, packedBytes = 0;
+    for (int i = 0; i < archiveCount; i++) {
+        rawBytes += archives[i].header.rawSize;
+        packedBytes += archives[i].header.packedSize;
+    }
+    start = nowNanos();
+    Booking *found = findStoredBooking(refNo);
+    double coldMs = (nowNanos() - start) / 1e6;
+    start = nowNanos();
+    found = findStoredBooking(refNo);
+    double warmNs = nowNanos() - start;
+    freeStore();
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+
+    printf("bookings=%ld flights=%d\n", bookings, flights);
+    printf("save        | ms       | bytes written\n");
+    printf("all shards  | %8.1f | %ld\n", fullMs, (long)fullBytes);
+    printf("one booking | %8.1f | %ld (%.4f%% of a full save)\n", oneMs, (long)oneBytes,
+           fullBytes ? 100.0 * oneBytes / fullBytes : 0.0);
+    printf("startup       | ms       | bookings in memory\n");
+    printf("all live      | %8.1f | %zu\n", liveMs, liveCount);
+    printf("half archived | %8.1f | %zu (%.2fx faster)\n", halfMs, halfCount, halfMs > 0 ? liveMs / halfMs : 0.0);
+    printf("archived %d days in %.1f ms: %.1f MB packed into %.1f MB (%.2fx)\n", days, archiveMs, rawBytes / 1e6,
+           packedBytes / 1e6, packedBytes ? (double)rawBytes / packedBytes : 0.0);
+    printf("archived lookup: %.2f ms unpacking its day, then %.0f ns (%s)\n", coldMs, warmNs,
+           found ? "found" : "missing");
+
+    const char *files[] = {SEAT_INVENTORY_FILE, JOURNAL_FILE};
+    for (int i = 0; i < 2; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return found ? 0 : 1;
+}
+
+// Flight removal: the admin call and lookups while the worker refunds a large flight in
+// batches, against unlinking the same number of bookings in one pass over the booking list
+static int benchRemoval(long bookings) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int flights = 10;
+    int seatsPerFlight = (int)((bookings + flights - 1) / flights);
+    if (seatsPerFlight > MAX_LAYOUT_SEATS) {
+        seatsPerFlight = MAX_LAYOUT_SEATS;
+    }
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    generateDataset(flights, seatsPerFlight, (long)flights * seatsPerFlight);
+    startRemovalWorker();
+
+    // Remove the first flight and look up bookings of the others until it is refunded
+    const char *error;
+    double start = nowNanos();
+    int removed = storeRemoveFlight("F000000", &error);
+    double removeUs = (nowNanos() - start) / 1e3;
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    char refNo[REFNO_SIZE];
+    Booking copy;
+    long lookups = 0, missing = 0, sampleCapacity = 1 << 22;
+    double *samples = (double *)malloc(sampleCapacity * sizeof(double));
+    while (samples && lookups < sampleCapacity && (storeRemovalCounts().pending > 0 || removals.head)) {
+        long b = (long)(benchRandom(&seed) % ((unsigned long long)flights * seatsPerFlight));
+        if (b % flights < 2) {
+            continue;  // The removed flight and the one removed below
+        }
+        snprintf(refNo, sizeof(refNo), "B%08lu", (unsigned long)b % 100000000UL);
+        double began = nowNanos();
+        missing += !storeView(refNo, &copy);
+        samples[lookups++] = nowNanos() - began;
+    }
+    double cleanupMs = (nowNanos() - start) / 1e6;
+    double p50 = 0, p99 = 0, worst = 0;
+    if (lookups > 0) {
+        qsort(samples, lookups, sizeof(double), compareDoubles);
+        p50 = samples[(long)(0.50 * (lookups - 1))];
+        p99 = samples[(long)(0.99 * (lookups - 1))];
+        worst = samples[lookups - 1];
+    }
+    free(samples);
+    pthread_rwlock_wrlock(&storeLock);
+    finishFlightRemovals();  // In case sampling stopped first
+    pthread_rwlock_unlock(&storeLock);
+
+    // The same cascade done inline: every booking is visited to find the flight's
+    uint32_t inlineCode = flightCode("F000001", 0), queuedCode = flightCode("F000000", 0);
+    start = nowNanos();
+    pthread_rwlock_wrlock(&storeLock);
+    deleteFlight("F000001");
+    pthread_mutex_lock(&removalLock);
+    FlightRemoval *job = removals.head;
+    removals.head = removals.tail = NULL;
+    removals.pending = 0;
+    pthread_mutex_unlock(&removalLock);
+    while (job && job->bookings) {
+        unlinkFlightBooking(job->bookings);  // Back to the plain booking list only
+    }
+    free(job);
+    FILE *refunds = fopen(REFUND_FILE, "a");
+    long scanned = 0, cascaded = 0;
+    for (Booking *booking = head, *next; booking; booking = next) {
+        next = booking->next;
+        scanned++;
+        if (booking->flight == inlineCode) {
+            char date[DATE_TEXT_SIZE];
+            fprintf(refunds, "%s,%s,%s,%s,%.2f\n", booking->refNo, booking->name, flightName(booking->flight),
+                    dateText(booking->date, date), booking->paise / 100.0);
+            dequeueCancelRequest(booking);
+            unlinkBooking(booking);
+            freeBooking(booking);
+            cascaded++;
+        }
+    }
+    fclose(refunds);
+    pthread_rwlock_unlock(&storeLock);
+    double inlineMs = (nowNanos() - start) / 1e6;
+
+    long left = 0, lines = 0;
+    for (Booking *booking = head; booking; booking = booking->next) {
+        left += booking->flight == queuedCode || booking->flight == inlineCode;
+    }
+    refunds = fopen(REFUND_FILE, "r");
+    for (int c; refunds && (c = fgetc(refunds)) != EOF;) {
+        lines += c == '\n';
+    }
+    if (refunds) {
+        fclose(refunds);
+    }
+    int mismatches = checkAggregates();
+    RemovalCounts counts = storeRemovalCounts();
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+
+    printf("flights=%d bookings per flight=%d\n", flights, seatsPerFlight);
+    printf("remove call: %.1f us | refunded %ld bookings in the background in %.1f ms\n", removeUs,
+           counts.refunded, cleanupMs);
+    printf("lookups during cleanup: %ld, p50 %.0f ns, p99 %.0f ns, worst %.1f us, %ld missing\n", lookups, p50,
+           p99, worst / 1e3, missing);
+    printf("inline cascade: %ld bookings scanned, %ld refunded, store locked for %.1f ms\n", scanned, cascaded,
+           inlineMs);
+    printf("bookings left on removed flights: %ld | refund lines: %ld | aggregate mismatches: %d\n", left, lines,
+           mismatches);
+    int failed = !removed || missing || left || mismatches || lines != counts.refunded + cascaded;
+
+    freeStore();
+    const char *files[] = {SEAT_INVENTORY_FILE, JOURNAL_FILE, REFUND_FILE};
+    for (int i = 0; i < 3; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return failed;
+}
+
+typedef struct LoadOptions {
+    int connections;
+    int pipeline;                // Requests in flight per connection
+    long requests;
+    int flights;                 // Shape of the generated dataset being served
+    long bookings;
+    int bookPercent;             // Requests that book a seat, the rest search, count seats and view tickets
+    int text;                    // Use the line protocol instead of binary frames
+} LoadOptions;
+
+typedef struct LoadResult {
+    long completed, failed;
+    double elapsedNs, p50, p99, p999, worst;
+} LoadResult;
+
+typedef struct LoadClient {
+    int fd;
+    long sent, received;
+    double *sentAt;              // Send time of each request in flight, by number modulo pipeline
+    size_t inLength;
+    char in[CONNECTION_INPUT_SIZE];
+    size_t outLength, outSent;
+    char *out;
+    unsigned long long seed;
+} LoadClient;
+
+// Queue one request of the mix against a dataset from generateDataset
+static void queueLoadRequest(LoadClient *client, const LoadOptions *options, unsigned long long number) {
+    int op, kind = (int)(benchRandom(&client->seed) % 100);
+    int f = (int)(benchRandom(&client->seed) % options->flights);
+    char fields[4][32];
+    int count = 0;
+    snprintf(fields[0], sizeof(fields[0]), "F%06u", (unsigned)f % 1000000u);
+    if (kind < options->bookPercent) {
+        op = OP_BOOK;
+        strcpy(fields[1], "E");
+        snprintf(fields[2], sizeof(fields[2]), "Load%llu", number % 100000000ULL);
+        count = 3;
+    } else if (kind < options->bookPercent + 10) {
+        op = OP_SEARCH;
+        snprintf(fields[0], sizeof(fields[0]), "CITY%03d", f % 200);
+        snprintf(fields[1], sizeof(fields[1]), "CITY%03d", (f / 200 + 1 + f % 199) % 200);
+        strcpy(fields[2], "*");
+        strcpy(fields[3], "5");
+        count = 4;
+    } else if (kind < options->bookPercent + 20) {
+        op = OP_SEATS;
+        count = 1;
+    } else {
+        op = OP_VIEW;
+        long b = (long)(benchRandom(&client->seed) % options->bookings);
+        snprintf(fields[0], sizeof(fields[0]), "B%08lu", (unsigned long)b % 100000000UL);
+        count = 1;
+    }
+
+    char *out = client->out + client->outLength;
+    size_t length = 0;
+    if (options->text) {
+        length = sprintf(out, "%s", frameVerbs[op]);
+        for (int i = 0; i < count; i++) {
+            length += sprintf(out + length, " %s", fields[i]);
+        }
+        out[length++] = '\n';
+    } else {
+        length = FRAME_HEADER_SIZE;
+        for (int i = 0; i < count; i++) {
+            size_t size = strlen(fields[i]) + (i + 1 < count);  // NUL between fields
+            memcpy(out + length, fields[i], size);
+            length += size;
+        }
+        putFrameHeader((unsigned char *)out, op, length - FRAME_HEADER_SIZE, (uint32_t)number);
+    }
+    client->outLength += length;
+}
+
+// Take complete replies off a client's input, recording each one's latency
+static void takeLoadReplies(LoadClient *client, const LoadOptions *options, LoadResult *result, double *samples) {
+    size_t used = 0;
+    while (used < client->inLength) {
+        char *reply = client->in + used;
+        size_t available = client->inLength - used, size;
+        int failed;
+        if (options->text) {
+            char *newline = (char *)memchr(reply, '\n', available);
+            if (!newline) {
+                break;
+            }
+            size = newline - reply + 1;
+            failed = strncmp(reply, "OK", 2) != 0;
+        } else {
+            if (available < FRAME_HEADER_SIZE ||
+                available < FRAME_HEADER_SIZE + frameLength((unsigned char *)reply)) {
+                break;
+            }
+            size = FRAME_HEADER_SIZE + frameLength((unsigned char *)reply);
+            failed = reply[1] != 0;
+        }
+        samples[result->completed++] = nowNanos() - client->sentAt[client->received % options->pipeline];
+        result->failed += failed;
+        client->received++;
+        used += size;
+    }
+    memmove(client->in, client->in + used, client->inLength - used);
+    client->inLength -= used;
+}
+
+// Drive a server with many pipelined connections from one epoll loop and measure
+// requests per second and latency. Returns 0 if connecting or the socket failed.
+static int generateLoad(const char *address, const LoadOptions *options, LoadResult *result) {
+    memset(result, 0, sizeof(*result));
+    raiseFileLimit();
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    LoadClient *clients = (LoadClient *)calloc(options->connections, sizeof(LoadClient));
+    double *samples = (double *)malloc(options->requests * sizeof(double));
+    double *sentAt = (double *)calloc((size_t)options->connections * options->pipeline, sizeof(double));
+    char *out = (char *)malloc((size_t)options->connections * options->pipeline * 128);
+    if (epollFd < 0 || !clients || !samples || !sentAt || !out) {
+        printf("Error allocating load generator.\n");
+        exit(1);
+    }
+    int ok = 1, opened = 0;
+    for (; opened < options->connections; opened++) {
+        LoadClient *client = &clients[opened];
+        client->fd = connectServer(address);
+        if (client->fd < 0) {
+            printf("Error connecting to %s (connection %d).\n", address, opened + 1);
+            ok = 0;
+            break;
+        }
+        fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+        client->sentAt = sentAt + (size_t)opened * options->pipeline;
+        client->out = out + (size_t)opened * options->pipeline * 128;
+        client->seed = 0x9E3779B97F4A7C15ULL * (opened + 1);
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.ptr = client;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client->fd, &event);
+    }
+
+    long issued = 0;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    double start = nowNanos();
+    while (ok && result->completed < options->requests) {
+        int ready = epoll_wait(epollFd, events, SERVER_MAX_EVENTS, 1000);
+        if (ready == 0) {
+            printf("Load generator timed out waiting for replies.\n");
+            ok = 0;
+        }
+        for (int i = 0; i < ready && ok; i++) {
+            LoadClient *client = (LoadClient *)events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                ssize_t got = read(client->fd, client->in + client->inLength, sizeof(client->in) - client->inLength);
+                if (got <= 0 && !(got < 0 && errno == EAGAIN)) {
+                    printf("Server closed a load connection.\n");
+                    ok = 0;
+                    break;
+                }
+                if (got > 0) {
+                    client->inLength += got;
+                    takeLoadReplies(client, options, result, samples);
+                }
+            }
+            // Top the connection up to the pipeline depth, then send what is queued
+            if (client->outSent == client->outLength) {
+                client->outSent = client->outLength = 0;
+                while (client->sent - client->received < options->pipeline && issued < options->requests) {
+                    client->sentAt[client->sent % options->pipeline] = nowNanos();
+                    queueLoadRequest(client, options, (unsigned long long)issued++);
+                    client->sent++;
+                }
+            }
+            if (client->outSent < client->outLength) {
+                ssize_t sent = write(client->fd, client->out + client->outSent, client->outLength - client->outSent);
+                if (sent > 0) {
+                    client->outSent += sent;
+                }
+            }
+            struct epoll_event event;
+            event.events = EPOLLIN | (client->outSent < client->outLength ? EPOLLOUT : 0);
+            event.data.ptr = client;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, client->fd, &event);
+        }
+    }
+    result->elapsedNs = nowNanos() - start;
+
+    if (result->completed > 0) {
+        qsort(samples, result->completed, sizeof(double), compareDoubles);
+        result->p50 = samples[(long)(0.50 * (result->completed - 1))];
+        result->p99 = samples[(long)(0.99 * (result->completed - 1))];
+        result->p999 = samples[(long)(0.999 * (result->completed - 1))];
+        result->worst = samples[result->completed - 1];
+    }
+    for (int i = 0; i < opened; i++) {
+        close(clients[i].fd);
+    }
+    close(epollFd);
+    free(out);
+    free(sentAt);
+    free(samples);
+    free(clients);
+    return ok;
+}
+
+static void printLoadResult(const LoadOptions *options, const LoadResult *result) {
+    printf("%-6s | %5d | %3d | %9ld | %9.0f | %8.1f | %8.1f | %8.1f | %8.1f | %ld\n", options->text ? "text" : "binary",
+           options->connections, options->pipeline, result->completed,
+           result->elapsedNs > 0 ? result->completed / (result->elapsedNs / 1e9) : 0.0, result->p50 / 1e3,
+           result->p99 / 1e3, result->p999 / 1e3, result->worst / 1e3, result->failed);
+}
+
+static const char *loadHeader =
+    "proto  | conns | pip |  requests |  req/sec  |  p50 us  |  p99 us  | p999 us  |  max us  | ERR replies\n";
+
+// loadgen <socket> [--connections N] [--pipeline N] [--requests N] [--flights N]
+// [--bookings N] [--book PERCENT] [--text]: load a server serving a generated dataset
+int runLoadGenerator(int argc, char *argv[]) {
+    LoadOptions options = {1000, 8, 1000000, 1000, 100000, 5, 0};
+    const char *address = argc >= 3 && argv[2][0] != '-' ? argv[2] : SERVER_SOCKET;
+    for (int i = address == argv[2] ? 3 : 2; i < argc; i++) {
+        if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) options.connections = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) options.pipeline = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) options.requests = atol(argv[++i]);
+        else if (strcmp(argv[i], "--flights") == 0 && i + 1 < argc) options.flights = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bookings") == 0 && i + 1 < argc) options.bookings = atol(argv[++i]);
+        else if (strcmp(argv[i], "--book") == 0 && i + 1 < argc) options.bookPercent = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--text") == 0) options.text = 1;
+        else {
+            printf("Usage: %s loadgen [socket] [--connections N] [--pipeline N] [--requests N] [--flights N] "
+                   "[--bookings N] [--book PERCENT] [--text]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.connections <= 0 || options.pipeline <= 0 || options.requests <= 0 || options.flights <= 0 ||
+        options.bookings <= 0 || options.bookPercent < 0 || options.bookPercent > 80) {
+        printf("Connections, pipeline, requests, flights and bookings must be positive, --book at most 80.\n");
+        return 1;
+    }
+    LoadResult result;
+    int ok = generateLoad(address, &options, &result);
+    printf("%s", loadHeader);
+    printLoadResult(&options, &result);
+    return ok ? 0 : 1;
+}
+
+static void *acceptorThread(void *arg) {
+    acceptClients((Server *)arg);
+    return NULL;
+}
+
+// Event-driven server: a generated dataset served in this process, driven by the load
+// generator over 10 and 1,000 connections, with and without pipelining, in both protocols
+static int benchServer(long requests) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    generateDataset(1000, DEFAULT_SEAT_COUNT, 100000);
+    Server server;
+    int started = startServer(&server, SERVER_SOCKET, SERVER_WORKERS);
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+    if (!started) {
+        return 1;
+    }
+    pthread_t acceptor;
+    pthread_create(&acceptor, NULL, acceptorThread, &server);
+
+    LoadOptions runs[] = {
+        {10, 1, requests, 1000, 100000, 5, 0},
+        {10, 16, requests, 1000, 100000, 5, 0},
+        {1000, 1, requests, 1000, 100000, 5, 0},
+        {1000, 16, requests, 1000, 100000, 5, 0},
+        {1000, 16, requests, 1000, 100000, 5, 1},
+    };
+    int failed = 0;
+    printf("%s", loadHeader);
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        LoadResult result;
+        failed |= !generateLoad(SERVER_SOCKET, &runs[i], &result);
+        printLoadResult(&runs[i], &result);
+        // Only bookings may fail, once a flight is full
+        failed |= result.failed > result.completed * runs[i].bookPercent / 100;
+    }
+
+    serverStopping = 1;
+    wakeServer(&server);
+    pthread_join(acceptor, NULL);
+    serverStopping = 0;
+    stopListening(&server, SERVER_SOCKET);
+    const char *files[] = {SEAT_INVENTORY_FILE, JOURNAL_FILE, METRICS_FILE};
+    for (int i = 0; i < 3; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return failed;
+}
+
+typedef struct ReadWorker {
+    pthread_t thread;
+    int locked;
+    unsigned long long seed;
+    long reads;
+    long missing;
+    long anomalies;
+} ReadWorker;
+
+// Bookings the writer made last, so readers also look up ones about to be freed
+static struct {
+    pthread_mutex_t lock;
+    char refNos[64][REFNO_SIZE];
+    long count;
+} recentBookings = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static volatile int readersStopping;
+
+static void *readWorker(void *arg) {
+    ReadWorker *worker = (ReadWorker *)arg;
+    char refNo[REFNO_SIZE], flightID[10];
+    Booking copy;
+    while (!readersStopping) {
+        unsigned long long r = benchRandom(&worker->seed);
+        if (worker->locked) {
+            pthread_rwlock_rdlock(&storeLock);
+        }
+        if (r % 5 == 0) {
+            snprintf(flightID, sizeof(flightID), "F%06u", (unsigned)(r >> 8) % 1000);
+            worker->missing += storeSeatsRemaining(flightID) < 0;
+        } else if (r % 16 == 1) {
+            pthread_mutex_lock(&recentBookings.lock);
+            long count = recentBookings.count;
+            strcpy(refNo, recentBookings.refNos[(r >> 8) % 64]);
+            pthread_mutex_unlock(&recentBookings.lock);
+            if (count >= 64 && storeView(refNo, &copy) && strcmp(copy.refNo, refNo) != 0) {
+                worker->anomalies++;
+            }
+        } else {
+            snprintf(refNo, sizeof(refNo), "B%08lu", (unsigned long)((r >> 8) % 100000));
+            if (!storeView(refNo, &copy)) {
+                worker->missing++;
+            } else if (strcmp(copy.refNo, refNo) != 0 || copy.seatNumber <= 0) {
+                worker->anomalies++;
+            }
+        }
+        if (worker->locked) {
+            pthread_rwlock_unlock(&storeLock);
+        }
+        worker->reads++;
+    }
+    return NULL;
+}
+
+// Book a seat, then cancel and approve it, so every write frees a booking under the readers
+static void *bookingChurner(void *arg) {
+    long *writes = (long *)arg;
+    unsigned long long seed = 0xC2B2AE3D27D4EB4FULL;
+    char refNo[REFNO_SIZE], flightID[10];
+    const char *error;
+    int seat;
+    while (!readersStopping) {
+        snprintf(flightID, sizeof(flightID), "F%06u", (unsigned)(benchRandom(&seed) % 1000));
+        if (!storeBookCabin(flightID, 'E', "Churn", refNo, &seat, &error)) {
+            continue;
+        }
+        pthread_mutex_lock(&recentBookings.lock);
+        strcpy(recentBookings.refNos[recentBookings.count++ % 64], refNo);
+        pthread_mutex_unlock(&recentBookings.lock);
+        storeCancel(refNo, &error);
+        storeApprove(refNo, &error);
+        (*writes)++;
+    }
+    return NULL;
+}
+
+// Lookups and seat counts from 1 to 8 threads while one thread books and cancels,
+// on the published snapshots against the same calls under the shared store lock
+static int benchReadPath(int maxThreads) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    generateDataset(1000, DEFAULT_SEAT_COUNT, 100000);
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+
+    int failed = 0;
+    printf("mode      | threads | reads/sec   | per thread  | writes/sec | missing | anomalies\n");
+    for (int locked = 0; locked <= 1; locked++) {
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            ReadWorker *workers = (ReadWorker *)calloc(threads, sizeof(ReadWorker));
+            pthread_t writer;
+            long writes = 0;
+            readersStopping = 0;
+            double start = nowNanos();
+            pthread_create(&writer, NULL, bookingChurner, &writes);
+            for (int i = 0; i < threads; i++) {
+                workers[i].locked = locked;
+                workers[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+                pthread_create(&workers[i].thread, NULL, readWorker, &workers[i]);
+            }
+            usleep(500000);
+            readersStopping = 1;
+            long reads = 0, missing = 0, anomalies = 0;
+            for (int i = 0; i < threads; i++) {
+                pthread_join(workers[i].thread, NULL);
+                reads += workers[i].reads;
+                missing += workers[i].missing;
+                anomalies += workers[i].anomalies;
+            }
+            pthread_join(writer, NULL);
+            double seconds = (nowNanos() - start) / 1e9;
+            printf("%-9s | %7d | %11.0f | %11.0f | %10.0f | %7ld | %9ld\n", locked ? "locked" : "lock-free",
+                   threads, reads / seconds, reads / seconds / threads, writes / seconds, missing, anomalies);
+            failed |= missing > 0 || anomalies > 0;
+            free(workers);
+        }
+    }
+    size_t pending = epochs.count;
+    drainRetired();
+    int errors = checkAggregates();
+    printf("aggregate mismatches after churn=%d, frees still deferred at the end=%zu\n", errors, pending);
+    failed |= errors > 0;
+
+    freeStore();
+    const char *files[] = {SEAT_INVENTORY_FILE, JOURNAL_FILE, METRICS_FILE};
+    for (int i = 0; i < 3; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return failed;
+}
+
+// Memory per million bookings with interned flight IDs and packed dates, and the cost of
+// finding a booking's flight from its ID text against from its code
+static int benchInterning(long bookings) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int flights = 2000;
+    int seatsPerFlight = (int)((bookings + flights - 1) / flights);
+    if (seatsPerFlight > MAX_LAYOUT_SEATS) {
+        seatsPerFlight = MAX_LAYOUT_SEATS;
+    }
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    long before = residentBytes();
+    generateDataset(flights, seatsPerFlight, (long)flights * seatsPerFlight);
+    long rss = residentBytes() - before;
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+
+    long count = bookingIndex.count;
+    printf("booking record %zu bytes, cancel request %zu bytes; flight ID and date take 8 bytes, 25 as text\n",
+           sizeof(Booking), sizeof(CancelRequest));
+    printf("flight record %zu bytes; time and airports take 12 bytes, 70 as text\n", sizeof(Flight));
+    printf("bookings=%ld store RSS per million bookings=%.1f MB\n", count, rss / 1048576.0 * 1e6 / count);
+    printf("interned: flights=%u airports=%u dates=%u times=%u\n", flightDictionary.count, airportDictionary.count,
+           dateDictionary.count, timeDictionary.count);
+
+    // Every booking's flight, found both ways, in list order
+    int failed = 0;
+    double byName = 0, byCode = 0;
+    for (int run = 0; run < 3; run++) {
+        long found = 0;
+        double start = nowNanos();
+        for (Booking *b = head; b; b = b->next) {
+            found += findFlight((char *)flightName(b->flight)) != NULL;
+        }
+        double nameNs = (nowNanos() - start) / count;
+        start = nowNanos();
+        for (Booking *b = head; b; b = b->next) {
+            found += flightByCode(b->flight) != NULL;
+        }
+        double codeNs = (nowNanos() - start) / count;
+        if (run == 0 || nameNs < byName) byName = nameNs;
+        if (run == 0 || codeNs < byCode) byCode = codeNs;
+        failed |= found != 2 * count;
+    }
+    printf("flight of a booking | by ID %.1f ns | by code %.1f ns\n", byName, byCode);
+
+    // Packed dates must read back as the text they were made from
+    char text[DATE_TEXT_SIZE];
+    const char *dates[] = {"01/01/2025", "31/12/1999", "1/2/2025", "someday", ""};
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(dateText(packDate(dates[i]), text), dates[i]) != 0) {
+            printf("Date '%s' did not survive packing.\n", dates[i]);
+            failed = 1;
+        }
+    }
+
+    freeStore();
+    const char *files[] = {SEAT_INVENTORY_FILE, JOURNAL_FILE, METRICS_FILE};
+    for (int i = 0; i < 3; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return failed;
+}
+
+typedef struct GroupWorker {
+    pthread_t thread;
+    int id;
+    long groups;
+    long turnedAway;
+    long booked;
+    long mismatched;
+} GroupWorker;
+
+// Book groups of 1 to 24 onto the race flight until the cabin turns them away; every
+// group booked must read back whole, member by member and seat by seat
+static void *groupWorker(void *arg) {
+    GroupWorker *worker = (GroupWorker *)arg;
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL * (worker->id + 1);
+    const char *names[] = {"Racer"};
+    char groupRef[REFNO_SIZE], refNo[REFNO_SIZE];
+    const char *error;
+    int seats[24], misses = 0;
+    Booking copy;
+    while (misses < 64) {
+        int count = (int)(benchRandom(&seed) % 24) + 1;
+        if (!storeBookGroup("RACE", 'E', count, (int)(benchRandom(&seed) & 1), names, 1, groupRef, seats, &error)) {
+            worker->turnedAway++;
+            misses++;
+            continue;
+        }
+        misses = 0;
+        worker->groups++;
+        worker->booked += count;
+        for (int i = 0; i < count; i++) {
+            if (groupMemberRef(groupRef, i, refNo) != count || !storeView(refNo, &copy) ||
+                copy.seatNumber != seats[i]) {
+                worker->mismatched++;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Groups of 10, 100 and 1000 booked as one operation against one booking per passenger,
+// then threads racing groups onto one flight: a group is booked whole or not at all
+static int benchGroups(int threads) {
+    char dir[] = "/tmp/ars-bench-XXXXXX";
+    char cwd[4096];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+        printf("Error creating benchmark directory.\n");
+        return 1;
+    }
+    int console = dup(STDOUT_FILENO);  // Silence the loaders' messages
+    int devnull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    loadSeatInventory();
+    openJournal();
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    close(devnull);
+
+    int cabinSeats = 12000, failed = 0;
+    const int sizes[] = {10, 100, 1000};
+    const char *names[] = {"Group"};
+    static int seats[GROUP_MAX_SIZE];
+    char groupRef[REFNO_SIZE], refNo[REFNO_SIZE];
+    const char *error;
+    SeatLayout layout;
+    parseSeatLayout("E12000x6", &layout);
+    printf("group | one by one groups/sec | grouped groups/sec | speedup | bytes/passenger one by one | grouped\n");
+    for (int s = 0; s < 3; s++) {
+        double seconds[2];
+        uint64_t bytes[2];
+        for (int grouped = 0; grouped <= 1; grouped++) {
+            Flight details;
+            memset(&details, 0, sizeof(details));
+            snprintf(details.flightID, sizeof(details.flightID), "G%d%c", sizes[s], grouped ? 'G' : 'S');
+            strcpy(details.date, "01/06/2025");
+            setFlightText(&details, "08:00", "DEL", "BOM");
+            details.price = 1000;
+            failed |= !storeAddFlight(&details, &layout, &error);
+            uint64_t written = bytesWritten;
+            double start = nowNanos();
+            for (int g = 0; g < cabinSeats / sizes[s]; g++) {
+                if (grouped) {
+                    failed |= !storeBookGroup(details.flightID, 'E', sizes[s], 0, names, 1, groupRef, seats, &error);
+                    continue;
+                }
+                for (int i = 0; i < sizes[s]; i++) {
+                    failed |= !storeBookCabin(details.flightID, 'E', names[0], refNo, &seats[i], &error);
+                }
+            }
+            seconds[grouped] = (nowNanos() - start) / 1e9;
+            bytes[grouped] = bytesWritten - written;
+        }
+        int groups = cabinSeats / sizes[s];
+        printf("%5d | %21.0f | %18.0f | %6.1fx | %26.1f | %7.1f\n", sizes[s], groups / seconds[0],
+               groups / seconds[1], seconds[0] / seconds[1], (double)bytes[0] / cabinSeats,
+               (double)bytes[1] / cabinSeats);
+    }
+
+    // Threads race groups onto one small flight until it is full
+    Flight details;
+    memset(&details, 0, sizeof(details));
+    strcpy(details.flightID, "RACE");
+    strcpy(details.date, "01/06/2025");
+    setFlightText(&details, "09:00", "DEL", "BOM");
+    details.price = 1000;
+    parseSeatLayout("E600x6", &layout);
+    failed |= !storeAddFlight(&details, &layout, &error);
+    GroupWorker *workers = (GroupWorker *)calloc(threads, sizeof(GroupWorker));
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i;
+        pthread_create(&workers[i].thread, NULL, groupWorker, &workers[i]);
+    }
+    long groups = 0, turnedAway = 0, booked = 0, mismatched = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        groups += workers[i].groups;
+        turnedAway += workers[i].turnedAway;
+        booked += workers[i].booked;
+        mismatched += workers[i].mismatched;
+    }
+    free(workers);
+
+    // Seats taken must be exactly the groups booked, and the inventory file must agree
+    SeatMap *map = findSeatMap("RACE");
+    uint64_t words[16];
+    int differing = 0;
+    if (pread(fileno(seatInventory), words, map->wordCount * sizeof(uint64_t), map->fileOffset) !=
+        (ssize_t)(map->wordCount * sizeof(uint64_t))) {
+        differing = map->wordCount;
+    }
+    for (int w = 0; w < map->wordCount && !differing; w++) {
+        differing += words[w] != map->bits[w];
+    }
+    int taken = map->seatCount - seatsRemaining(map);
+    int errors = checkSeatIndex(map) + checkAggregates();
+    printf("threads=%d groups booked=%ld turned away=%ld seats taken=%d of %d by %ld passengers\n", threads,
+           groups, turnedAway, taken, map->seatCount, booked);
+    printf("members missing or misplaced=%ld, seat file words differing=%d, index or aggregate mismatches=%d\n",
+           mismatched, differing, errors);
+    failed |= taken != booked || mismatched > 0 || differing > 0 || errors > 0;
+
+    freeStore();
+    const char *files[] = {SEAT_INVENTORY_FILE, JOURNAL_FILE, METRICS_FILE};
+    for (int i = 0; i < 3; i++) {
+        remove(files[i]);
+    }
+    removeDirectory(SHARD_DIR);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+    return failed;
+}
+
+// Run a named benchmark from the command line
+int runBenchmark(int argc, char *argv[]) {
+    const char *name = argv[2];
+    if (strcmp(name, "suite") == 0) {
+        return benchSuite(argc, argv);
+    }
+    if (strcmp(name, "index") == 0) {
+        benchBookingIndex();
+        return 0;
+    }
+    if (strcmp(name, "startup") == 0) {
+        benchStartup();
+        return 0;
+    }
+    if (strcmp(name, "alloc") == 0) {
+        benchAllocator();
+        return 0;
+    }
+    if (strcmp(name, "stress") == 0) {
+        benchSeatStress(SERVER_WORKERS);
+        return 0;
+    }
+    if (strcmp(name, "search") == 0) {
+        benchRouteSearch();
+        return 0;
+    }
+    if (strcmp(name, "refno") == 0) {
+        return benchRefNo(argc >= 4 ? atoi(argv[3]) : SERVER_WORKERS);
+    }
+    if (strcmp(name, "columns") == 0) {
+        return benchColumns(argc >= 4 ? atol(argv[3]) : 10000000);
+    }
+    if (strcmp(name, "csv") == 0) {
+        return benchCSV(argc >= 4 ? atol(argv[3]) : 5000000);
+    }
+    if (strcmp(name, "parallel") == 0) {
+        return benchParallelLoad(argc >= 4 ? atol(argv[3]) : 2000000);
+    }
+    if (strcmp(name, "holds") == 0) {
+        return benchHolds(argc >= 4 && atol(argv[3]) > 0 ? atol(argv[3]) : 1000000);
+    }
+    if (strcmp(name, "metrics") == 0) {
+        return benchMetrics(argc >= 4 && atol(argv[3]) > 0 ? atol(argv[3]) : 10000000,
+                            argc >= 5 ? atoi(argv[4]) : SERVER_WORKERS);
+    }
+    if (strcmp(name, "shards") == 0) {
+        return benchShards(argc >= 4 && atol(argv[3]) > 0 ? atol(argv[3]) : 1000000);
+    }
+    if (strcmp(name, "seats") == 0) {
+        return benchSeatAllocation(argc >= 4 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 3);
+    }
+    if (strcmp(name, "views") == 0) {
+        return benchViews(argc >= 4 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 1000);
+    }
+    if (strcmp(name, "removal") == 0) {
+        return benchRemoval(argc >= 4 && atol(argv[3]) > 0 ? atol(argv[3]) : 1000000);
+    }
+    if (strcmp(name, "server") == 0) {
+        return benchServer(argc >= 4 && atol(argv[3]) > 0 ? atol(argv[3]) : 200000);
+    }
+    if (strcmp(name, "reads") == 0) {
+        return benchReadPath(argc >= 4 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 8);
+    }
+    if (strcmp(name, "intern") == 0) {
+        return benchInterning(argc >= 4 && atol(argv[3]) > 0 ? atol(argv[3]) : 1000000);
+    }
+    if (strcmp(name, "groups") == 0) {
+        return benchGroups(argc >= 4 && atoi(argv[3]) > 0 ? atoi(argv[3]) : SERVER_WORKERS);
+    }
+    printf("Unknown benchmark '%s'. Available: suite, index, startup, alloc, stress, search, refno, columns, csv, parallel, holds, metrics, shards, seats, views, removal, server, reads, intern, groups\n", name);
+    return 1;
+}
+
+// Main function to show menu
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "bench") == 0) {
+        return runBenchmark(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "generate") == 0) {
+        return runGenerate(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "loadgen") == 0) {
+        return runLoadGenerator(argc, argv);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "startup") == 0) {
+        // startup [--threads N] [--csv]: load the store and report where the time went
+        int fromCSV = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) loaderThreads = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--csv") == 0) fromCSV = 1;
+            else {
+                printf("Usage: %s startup [--threads N] [--csv]\n", argv[0]);
+                return 1;
+            }
+        }
+        loadStore(fromCSV);
+        printStartupReport();
+        freeStore();
+        return 0;
+    }
+
+    // "import-csv" rebuilds the snapshot from the CSV files, "export-csv" writes them out
+    int importing = argc >= 2 && strcmp(argv[1], "import-csv") == 0;
+    int exporting = argc >= 2 && strcmp(argv[1], "export-csv") == 0;
+    if (importing && remove(JOURNAL_FILE) == 0) {
+        // The journal holds changes to the old snapshot, not to the imported files
+        printf("Discarded %s; the CSV files replace the stored data.\n", JOURNAL_FILE);
+    }
+    loadStore(importing);
+    if (importing || exporting) {
+        compactJournal();
+        if (exporting) {
+            loadArchives(0, 0);  // The CSV files hold archived days too
+        }
+        return (exporting ? exportCSV() : 1) ? 0 : 1;
+    }
+    if (argc >= 2 && strcmp(argv[1], "archive") == 0) {
+        // archive [--before DD/MM/YYYY] [--list]: pack the shards of past departure dates
+        // into compressed, read-only archives
+        int before = todayKey();
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--before") == 0 && i + 1 < argc && dateKey(argv[i + 1]) > 0) before = dateKey(argv[++i]);
+            else if (strcmp(argv[i], "--list") == 0) before = 0;
+            else {
+                printf("Usage: %s archive [--before DD/MM/YYYY] [--list]\n", argv[0]);
+                freeStore();
+                return 1;
+            }
+        }
+        int days = 0;
+        if (before == 0) {
+            listArchives();
+        } else {
+            compactJournal();  // The shards must hold every change before they are packed
+            days = archiveShards(before);
+            if (days >= 0) {
+                printf("Archived %d days.\n", days);
+            }
+        }
+        freeStore();
+        return days < 0 ? 1 : 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "search") == 0) {
+        return runSearchCommand(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "query") == 0) {
+        // query [--flight ID] [--from DD/MM/YYYY] [--to DD/MM/YYYY] [--pending]
+        BookingQuery query = {NULL, 0, 0, 0};
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--flight") == 0 && i + 1 < argc) query.flightID = argv[++i];
+            else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) query.fromDate = dateKey(argv[++i]);
+            else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) query.toDate = dateKey(argv[++i]);
+            else if (strcmp(argv[i], "--pending") == 0) query.pendingOnly = 1;
+            else {
+                printf("Usage: %s query [--flight ID] [--from DD/MM/YYYY] [--to DD/MM/YYYY] [--pending]\n", argv[0]);
+                return 1;
+            }
+        }
+        loadArchives(query.fromDate, query.toDate);
+        QueryResult result = queryBookings(&query);
+        printf("%ld bookings, %.2f Rs\n", result.count, result.paise / 100.0);
+        freeStore();
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "metrics") == 0) {
+        // metrics: print the Prometheus exposition for this process after loading
+        writeMetrics(stdout);
+        freeStore();
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "check") == 0) {
+        // check: recompute the running totals from scratch and compare
+        int mismatches = checkAggregates();
+        if (mismatches == 0) {
+            printf("Totals consistent: %ld bookings, %.2f revenue.\n", totals.bookings, totals.revenue / 100.0);
+        }
+        freeStore();
+        return mismatches ? 1 : 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0) {
+        // batch [file|-] [--group N]: execute a command stream, then snapshot
+        FILE *input = stdin;
+        int groupSize = BATCH_GROUP_SIZE;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--group") == 0 && i + 1 < argc) {
+                groupSize = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "-") != 0) {
+                input = fopen(argv[i], "r");
+                if (!input) {
+                    printf("Error opening batch file %s.\n", argv[i]);
+                    return 1;
+                }
+            }
+        }
+        int status = runBatch(input, groupSize > 0 ? groupSize : BATCH_GROUP_SIZE);
+        if (input != stdin) {
+            fclose(input);
+        }
+        compactJournal();
+        dumpMetrics();
+        return status;
+    }
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        int workers = argc >= 4 ? atoi(argv[3]) : SERVER_WORKERS;
+        return runServer(argc >= 3 ? argv[2] : SERVER_SOCKET, workers > 0 ? workers : SERVER_WORKERS);
+    }
 
     int choice;
     do {
@@ -803,6 +10787,8 @@ int main() {
         printf("4. Cancel Booking\n");
         printf("5. Admin Menu\n");
         printf("6. Exit\n");
+        printf("7. Search Flights\n");
+        printf("8. Book Group\n");
         printf("Enter your choice: ");
         scanf("%d", &choice);
 
@@ -813,10 +10799,15 @@ int main() {
             case 4: cancelBooking(); break;
             case 5: adminAuthentication(); break;
             case 6: printf("Exiting...\n"); break;
+            case 7: searchFlightsMenu(); break;
+            case 8: bookGroup(); break;
             default: printf("Invalid choice. Try again.\n");
         }
     } while (choice != 6);
 
-    saveDataToCSV();
+    compactJournal();
+    journalSync();
+    dumpMetrics();
+    freeStore();
     return 0;
 }
\ No newline at end of file